@@ -0,0 +1,528 @@
+/**
+ * Microbenchmarks of the calculator's hot paths: the stack, the
+ * backend's operations for every key of the keypad, storage, state
+ * snapshots, whole expressions (as written and optimized), replaying
+ * keystroke tapes, sessions and number formatting, and the memory of
+ * a calculator (bytes per session, sessions per GB). Each benchmark
+ * is calibrated so that a repetition takes at least the given time,
+ * warmed up, then repeated; the mean, standard deviation, min and max
+ * time per operation of the repetitions are written as JSON to stdout
+ * (or a file) so that runs can be compared, e.g.
+ *     bench -o before.json
+ *     bench -f Calculate -r 20
+ * Run `bench -h` for all options. Build with
+ * -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+ */
+#include "backend.hpp"
+#include "engine.hpp"
+#include "format.hpp"
+#include "incremental.hpp"
+#include "journal.hpp"
+#include "keypad.hpp"
+#include "optimizer.hpp"
+#include "program.hpp"
+#include "result_cache.hpp"
+#include "session.hpp"
+#include "stack.hpp"
+#include "tape.hpp"
+#include <algorithm>    // sort, min_element, max_element
+#include <chrono>       // steady_clock, nanoseconds
+#include <cmath>        // sqrt
+#include <cstdio>       // fprintf, fopen, fclose, perror
+#include <cstdlib>      // atoi, atof
+#include <ctime>        // time, gmtime, strftime
+#include <functional>   // function
+#include <memory>       // make_shared
+#include <string>       // string
+#include <thread>       // hardware_concurrency
+#include <utility>      // pair
+#include <vector>       // vector
+#include <unistd.h>     // getopt
+#ifdef __GLIBC__
+#include <malloc.h>     // mallinfo2
+#endif
+
+#ifndef HIP35_BUILD_TYPE
+#define HIP35_BUILD_TYPE ""
+#endif
+
+namespace {
+
+/**
+ * @brief Keeps the compiler from optimizing away a value that's
+ *        otherwise unused
+ */
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+typedef struct {
+    unsigned repetitions;
+    unsigned warmup;
+    // minimum duration of a repetition
+    double min_time_ms;
+    // run only the benchmarks whose names contain it
+    std::string filter;
+    const char* path;
+} Options;
+
+typedef struct {
+    std::string name;
+    // one operation; runs as many times as calibrated
+    std::function<void()> op;
+} Benchmark;
+
+/** @brief Memory of one calculator of a kind */
+typedef struct {
+    std::string name;
+    double bytes;
+} Footprint;
+
+typedef struct {
+    std::string name;
+    unsigned long long iterations;
+    unsigned repetitions;
+    double mean_ns;
+    double stddev_ns;
+    double min_ns;
+    double max_ns;
+} Result;
+
+void PrintUsage(const char* name) {
+    std::fprintf(stderr,
+        "Usage: %s [options]\n"
+        "Runs the microbenchmarks and writes their results as JSON.\n"
+        "  -r N       repetitions (default 10)\n"
+        "  -w N       warm-up repetitions (default 2)\n"
+        "  -t MS      minimum duration of a repetition (default 10)\n"
+        "  -f TEXT    only run benchmarks whose names contain TEXT\n"
+        "  -o FILE    write the JSON to FILE instead of stdout\n",
+        name);
+}
+
+/** @return Nanoseconds it takes to run `op` `iterations` times */
+double Time(const std::function<void()>& op, unsigned long long iterations) {
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < iterations; ++i)
+        op();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+Result Run(const Benchmark& bench, const Options& options) {
+    // double the iterations until a repetition is long enough; this
+    // also warms up the caches and branch predictors
+    const double min_time_ns = options.min_time_ms * 1e6;
+    unsigned long long iterations = 1;
+    while (Time(bench.op, iterations) < min_time_ns && iterations < (1ULL << 40))
+        iterations *= 2;
+    for (unsigned i = 0; i < options.warmup; ++i)
+        Time(bench.op, iterations);
+    std::vector<double> ns_per_op(options.repetitions);
+    for (auto& ns: ns_per_op)
+        ns = Time(bench.op, iterations) / iterations;
+    double mean = 0.0;
+    for (const auto ns: ns_per_op)
+        mean += ns;
+    mean /= ns_per_op.size();
+    double variance = 0.0;
+    for (const auto ns: ns_per_op)
+        variance += (ns - mean) * (ns - mean);
+    // sample variance
+    if (ns_per_op.size() > 1)
+        variance /= ns_per_op.size() - 1;
+    return Result{bench.name, iterations, options.repetitions, mean,
+                  std::sqrt(variance),
+                  *std::min_element(ns_per_op.begin(), ns_per_op.end()),
+                  *std::max_element(ns_per_op.begin(), ns_per_op.end())};
+}
+
+/** @brief Writes a string literal escaping the characters JSON needs */
+void WriteJsonString(std::FILE* out, const std::string& s) {
+    std::fputc('"', out);
+    for (const char c: s) {
+        if (c == '"' || c == '\\')
+            std::fprintf(out, "\\%c", c);
+        else if (static_cast<unsigned char>(c) < 0x20)
+            std::fprintf(out, "\\u%04x", c);
+        else
+            std::fputc(c, out);
+    }
+    std::fputc('"', out);
+}
+
+void WriteJson(std::FILE* out, const std::vector<Result>& results,
+               const std::vector<Footprint>& footprints) {
+    char date[32];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    std::fprintf(out, "{\n  \"context\": {\n");
+    std::fprintf(out, "    \"date\": \"%s\",\n", date);
+    std::fprintf(out, "    \"build_type\": ");
+    WriteJsonString(out, HIP35_BUILD_TYPE);
+    std::fprintf(out, ",\n    \"cpus\": %u\n  },\n", std::thread::hardware_concurrency());
+    std::fprintf(out, "  \"benchmarks\": [");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        std::fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        WriteJsonString(out, r.name);
+        std::fprintf(out, ", \"iterations\": %llu, \"repetitions\": %u, "
+                          "\"mean_ns\": %.3f, \"stddev_ns\": %.3f, "
+                          "\"min_ns\": %.3f, \"max_ns\": %.3f}",
+                     r.iterations, r.repetitions, r.mean_ns, r.stddev_ns,
+                     r.min_ns, r.max_ns);
+    }
+    std::fprintf(out, "\n  ],\n  \"footprints\": [");
+    for (std::size_t i = 0; i < footprints.size(); ++i) {
+        const auto& f = footprints[i];
+        std::fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        WriteJsonString(out, f.name);
+        std::fprintf(out, ", \"bytes\": %.1f, \"per_gb\": %.0f}", f.bytes,
+                     (1 << 30) / f.bytes);
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+}
+
+//-------------------------------------------------------------//
+// Benchmarks                                                  //
+//-------------------------------------------------------------//
+/**
+ * @return The keys of a keypad's map and their long names, e.g.
+ *         (`s`, `SIN`), in a fixed order
+ */
+template <typename Map>
+std::vector<std::pair<std::string, std::string>> SortedKeys(const Map& map) {
+    std::vector<std::pair<std::string, std::string>> keys;
+    for (const auto& kv: map)
+        keys.emplace_back(kv.first, kv.second.long_key);
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+void AddStackBenchmarks(std::vector<Benchmark>& benchmarks) {
+    auto stack = std::make_shared<backend::Stack>();
+    (*stack)[0] = 1.0;
+    benchmarks.push_back({"Stack::ShiftUp", [stack]() {
+        stack->ShiftUp();
+        DoNotOptimize((*stack)[0]);
+    }});
+    benchmarks.push_back({"Stack::ShiftDown", [stack]() {
+        stack->ShiftDown();
+        DoNotOptimize((*stack)[0]);
+    }});
+    benchmarks.push_back({"Stack::RollDown", [stack]() {
+        stack->RollDown();
+        DoNotOptimize((*stack)[0]);
+    }});
+    // lifting and dropping cost the same at any depth
+    auto deep = std::make_shared<backend::Stack>(4096);
+    benchmarks.push_back({"Stack::ShiftUp/4096", [deep]() {
+        deep->ShiftUp();
+        DoNotOptimize((*deep)[0]);
+    }});
+    benchmarks.push_back({"Stack::ShiftDown/4096", [deep]() {
+        deep->ShiftDown();
+        DoNotOptimize((*deep)[0]);
+    }});
+}
+
+void AddBackendBenchmarks(std::vector<Benchmark>& benchmarks) {
+    auto backend = std::make_shared<backend::Backend>(key::keypad);
+    benchmarks.push_back({"Backend::Insert", [backend]() {
+        backend->Insert(0.5);
+        DoNotOptimize(backend->Peek());
+    }});
+    benchmarks.push_back({"Backend::Enter", [backend]() {
+        backend->Enter();
+        DoNotOptimize(backend->Peek());
+    }});
+    // the operands are loaded before each operation so that every
+    // run computes the same values, e.g. no growth to inf or decay to
+    // denormals; subtract Insert and Enter for the operation alone
+    for (const auto& [key, name]: SortedKeys(key::keypad.single_arg_keys)) {
+        benchmarks.push_back({"Backend::Calculate/" + name, [backend, key]() {
+            backend->Insert(0.5);
+            DoNotOptimize(backend->Calculate(key));
+        }});
+    }
+    for (const auto& [key, name]: SortedKeys(key::keypad.double_arg_keys)) {
+        benchmarks.push_back({"Backend::Calculate/" + name, [backend, key]() {
+            backend->Insert(2.0);
+            backend->Enter();
+            backend->Insert(0.5);
+            DoNotOptimize(backend->Calculate(key));
+        }});
+    }
+    // the remaining keys have their own methods; press them through
+    // the engine, which dispatches them as the UI does
+    auto engine = std::make_shared<backend::Engine>(key::keypad);
+    for (const auto& [key, name]: SortedKeys(key::keypad.stack_keys)) {
+        benchmarks.push_back({"Engine::Press/" + name, [engine, key]() {
+            DoNotOptimize(engine->Press(key));
+        }});
+    }
+    benchmarks.push_back({"Backend::Sto", [backend]() {
+        backend->Sto("A");
+        DoNotOptimize(backend->Peek());
+    }});
+    benchmarks.push_back({"Backend::Rcl", [backend]() {
+        backend->Rcl("A");
+        DoNotOptimize(backend->Peek());
+    }});
+    // snapshots: a copy against saving and restoring the plain state
+    benchmarks.push_back({"Backend::Backend(const Backend&)", [backend]() {
+        backend::Backend copy(*backend);
+        DoNotOptimize(copy.Peek());
+    }});
+    auto state = std::make_shared<std::vector<unsigned char>>(backend->StateSize());
+    benchmarks.push_back({"Backend::SaveState", [backend, state]() {
+        backend->SaveState(state->data());
+        DoNotOptimize((*state)[0]);
+    }});
+    benchmarks.push_back({"Backend::LoadState", [backend, state]() {
+        backend->LoadState(state->data());
+        DoNotOptimize(backend->Peek());
+    }});
+    // what a failed key costs with undo enabled
+    auto journal = std::make_shared<backend::Journal>(*backend, 64 << 10);
+    benchmarks.push_back({"Journal::Checkpoint+Rollback", [journal]() {
+        journal->Checkpoint();
+        DoNotOptimize(journal->Rollback());
+    }});
+}
+
+void AddEvalBenchmarks(std::vector<Benchmark>& benchmarks) {
+    // the expressions of test/test.cpp
+    const std::vector<std::string> expressions = {
+        "12 ENTER 6 +",
+        "10 ENTER 5 - 17 ENTER 12 - 4 * /",
+        "1.5 ENTER ENTER ENTER 100 * * *",
+        "2 ENTER 3 + 4 ENTER 5 + * SQRT 6 ENTER 7 + 8 ENTER 9 + * SQRT +",
+        "10 LOG10 2.7 LN +",
+        "2 ENTER 3 + 4 * 5 / 30 SIN / 1.5 CHS ENTER 4 ^ *",
+        "13 ENTER 37 RDN RDN RDN RDN",
+        "60 SIN LASTX 2 / TAN *",
+        "3 STO A 4 ENTER RCL A *",
+        "2 EEX 3 ENTER 3 EEX 3 + 42 +",
+        "123 CLX 2 ENTER 3 *",
+    };
+    auto engine = std::make_shared<backend::Engine>(key::keypad);
+    for (const auto& expression: expressions) {
+        benchmarks.push_back({"Engine::EvalString/" + expression, [engine, expression]() {
+            DoNotOptimize(engine->EvalString(expression));
+        }});
+    }
+    // the same expressions compiled, as written and optimized
+    auto backend = std::make_shared<backend::Backend>(key::keypad);
+    for (const auto& expression: expressions) {
+        const backend::Program program(expression, key::keypad);
+        const backend::Program optimized = backend::Optimize(program);
+        benchmarks.push_back({"Program::Run/" + expression, [backend, program]() {
+            DoNotOptimize(program.Run(*backend));
+        }});
+        benchmarks.push_back({"Program::Run/optimized/" + expression, [backend, optimized]() {
+            DoNotOptimize(optimized.Run(*backend));
+        }});
+    }
+    // a program of 5000 keys whose last operand is edited before
+    // every run; the incremental evaluator presses only the last keys
+    std::string program;
+    for (int i = 0; i < 1250; ++i)
+        program += "1.0001 * 0.5 + ";
+    benchmarks.push_back({"Engine::EvalString/5000 keys", [engine, program]() {
+        DoNotOptimize(engine->EvalString(program));
+    }});
+    auto incremental = std::make_shared<backend::IncrementalEvaluator>(key::keypad);
+    incremental->Eval(program);
+    auto edits = std::make_shared<unsigned>(0);
+    benchmarks.push_back({"IncrementalEvaluator::Eval/5000 keys, last edited",
+                          [incremental, edits]() {
+        incremental->Edit(incremental->size() - 2, (++*edits % 2) ? "0.25" : "0.5");
+        DoNotOptimize(incremental->Eval());
+    }});
+    // a session of 5000 keystrokes recorded as the UI does, replayed
+    // and verified key by key
+    backend::Engine recorder(key::keypad);
+    backend::TapeHeader header = {0, backend::kStackDepth, 0, ""};
+    header.state.resize(recorder.backend().StateSize());
+    recorder.backend().SaveState(&header.state[0]);
+    auto tape = std::make_shared<std::string>();
+    backend::EncodeTapeHeader(header, *tape);
+    backend::TapeEncoder encoder;
+    const std::string session = "12 3.5+2*r#A@?A1.25E2!/v<x";
+    for (int i = 0; i < 5000; ++i) {
+        const char key = session[i % session.size()];
+        recorder.Press(std::string(1, key));
+        const auto registers = recorder.observer().GetState().second;
+        encoder.Encode({static_cast<unsigned char>(key), false, 250000,
+                        registers.first, registers.second}, *tape);
+    }
+    benchmarks.push_back({"ReplayTape/5000 keys", [tape]() {
+        DoNotOptimize(backend::ReplayTape(*tape, key::keypad).mismatches);
+    }});
+    // what a cached evaluation costs instead: normalizing and looking up
+    auto cache = std::make_shared<backend::ResultCache>(1 << 20);
+    for (const auto& expression: expressions) {
+        std::string key;
+        backend::ResultCache::Key(key::keypad, expression, key);
+        cache->Insert(key, 0.0);
+        benchmarks.push_back({"ResultCache::Lookup/" + expression, [cache, expression]() {
+            std::string key;
+            backend::ResultCache::Key(key::keypad, expression, key);
+            double value = 0.0;
+            cache->Lookup(key, value);
+            DoNotOptimize(value);
+        }});
+    }
+}
+
+void AddSessionBenchmarks(std::vector<Benchmark>& benchmarks) {
+    // 100k calculators taking turns on one engine; compare with
+    // Engine::EvalString on the same expression
+    auto pool = std::make_shared<backend::SessionPool>();
+    auto sessions = std::make_shared<std::vector<backend::Session*>>(100000);
+    for (auto& session: *sessions)
+        session = pool->Acquire();
+    auto engine = std::make_shared<backend::Engine>(key::keypad);
+    auto next = std::make_shared<std::size_t>(0);
+    const std::string expression = "3 STO A 4 ENTER RCL A *";
+    benchmarks.push_back({"EvalSession/100000 sessions/" + expression,
+                          [sessions, engine, next, expression]() {
+        backend::Session& session = *(*sessions)[*next];
+        *next = (*next + 1 == sessions->size()) ? 0 : *next + 1;
+        DoNotOptimize(backend::EvalSession(*engine, session, expression));
+    }});
+    benchmarks.push_back({"Session copy", [sessions]() {
+        backend::Session moved = *sessions->front();
+        DoNotOptimize(moved);
+    }});
+    benchmarks.push_back({"SessionPool::Acquire+Release", [pool]() {
+        backend::Session* session = pool->Acquire();
+        DoNotOptimize(session->lastx);
+        pool->Release(session);
+    }});
+}
+
+/**
+ * @brief Bytes per calculator, inline and on the heap, of many
+ *        calculators of each kind; with glibc the heap is measured,
+ *        elsewhere only sessions are, by their pool.
+ */
+std::vector<Footprint> MeasureFootprints() {
+    constexpr std::size_t kCount = 10000;
+    std::vector<Footprint> footprints;
+    backend::SessionPool pool;
+#ifdef __GLIBC__
+    const auto Heap = []() { return static_cast<double>(mallinfo2().uordblks); };
+    {
+        std::vector<std::unique_ptr<backend::Backend>> backends;
+        backends.reserve(kCount);
+        const double before = Heap();
+        for (std::size_t i = 0; i < kCount; ++i)
+            backends.push_back(std::make_unique<backend::Backend>(key::keypad));
+        footprints.push_back({"footprint/Backend", (Heap() - before) / kCount});
+    }
+    {
+        std::vector<std::unique_ptr<backend::Engine>> engines;
+        engines.reserve(kCount);
+        const double before = Heap();
+        for (std::size_t i = 0; i < kCount; ++i)
+            engines.push_back(std::make_unique<backend::Engine>(key::keypad));
+        footprints.push_back({"footprint/Engine", (Heap() - before) / kCount});
+    }
+    std::vector<backend::Session*> sessions(kCount);
+    const double before = Heap();
+    for (auto& session: sessions)
+        session = pool.Acquire();
+    footprints.push_back({"footprint/Session", (Heap() - before) / kCount});
+#else
+    for (std::size_t i = 0; i < kCount; ++i)
+        pool.Acquire();
+    footprints.push_back({"footprint/Session",
+                          static_cast<double>(pool.bytes()) / kCount});
+#endif
+    return footprints;
+}
+
+void AddFormatBenchmarks(std::vector<Benchmark>& benchmarks) {
+    // one value in each of the display's ranges
+    const std::vector<double> values = {0.0, -1.2345e-7, 3.14159, 12345.6,
+                                        6.02e11, -9.1e15, 1.6e300};
+    for (const double num: values) {
+        char name[format::kBufferSize];
+        std::string suffix(name, format::Shortest(name, name + sizeof(name), num));
+        benchmarks.push_back({"format::Display/" + suffix, [num]() {
+            char buf[format::kBufferSize];
+            DoNotOptimize(format::Display(buf, buf + sizeof(buf), num, 30));
+        }});
+        benchmarks.push_back({"format::GenRegister/" + suffix, [num]() {
+            char buf[format::kBufferSize];
+            DoNotOptimize(format::GenRegister(buf, buf + sizeof(buf), num, 12));
+        }});
+        benchmarks.push_back({"format::Shortest/" + suffix, [num]() {
+            char buf[format::kBufferSize];
+            DoNotOptimize(format::Shortest(buf, buf + sizeof(buf), num));
+        }});
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options{10, 2, 10.0, "", nullptr};
+    int opt;
+    while ((opt = getopt(argc, argv, "r:w:t:f:o:h")) != -1) {
+        switch (opt) {
+            case 'r': options.repetitions = std::max(1, std::atoi(optarg)); break;
+            case 'w': options.warmup = std::max(0, std::atoi(optarg)); break;
+            case 't': options.min_time_ms = std::max(0.001, std::atof(optarg)); break;
+            case 'f': options.filter = optarg; break;
+            case 'o': options.path = optarg; break;
+            default:
+                PrintUsage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    std::vector<Benchmark> benchmarks;
+    AddStackBenchmarks(benchmarks);
+    AddBackendBenchmarks(benchmarks);
+    AddEvalBenchmarks(benchmarks);
+    AddSessionBenchmarks(benchmarks);
+    AddFormatBenchmarks(benchmarks);
+
+    std::vector<Result> results;
+    for (const auto& bench: benchmarks) {
+        if (bench.name.find(options.filter) == std::string::npos)
+            continue;
+        results.push_back(Run(bench, options));
+        const auto& r = results.back();
+        // progress for humans; the JSON is for tools
+        std::fprintf(stderr, "%-60s %10.2f ns/op +- %.2f\n", r.name.c_str(),
+                     r.mean_ns, r.stddev_ns);
+    }
+
+    std::vector<Footprint> footprints;
+    for (const auto& footprint: MeasureFootprints()) {
+        if (footprint.name.find(options.filter) == std::string::npos)
+            continue;
+        footprints.push_back(footprint);
+        std::fprintf(stderr, "%-60s %10.1f bytes, %.0f per GB\n", footprint.name.c_str(),
+                     footprint.bytes, (1 << 30) / footprint.bytes);
+    }
+
+    std::FILE* out = stdout;
+    if (options.path != nullptr && (out = std::fopen(options.path, "w")) == nullptr) {
+        std::perror(options.path);
+        return 1;
+    }
+    WriteJson(out, results, footprints);
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
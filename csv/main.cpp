@@ -0,0 +1,433 @@
+/**
+ * Applies an RPN expression to every row of a CSV file and streams
+ * one result per row to stdout. Columns can be bound to the general
+ * registers A-J or pushed onto the stack before the expression runs.
+ * Example - for each row compute (col1 + col2) * col3:
+ *     hip35csv -s 1 -s 2 -r A=3 -e "+ ENTER RCL A *" data.csv
+ * Run `hip35csv -h` for all options.
+ *
+ * Files are memory-mapped and split into chunks at line boundaries.
+ * Chunks are evaluated in parallel, one backend per thread, and their
+ * output is written in the input's order. At most one chunk per
+ * thread is in flight, so the memory used doesn't depend on the size
+ * of the input. Stdin is read in chunks the same way.
+ */
+#include "backend.hpp"
+#include "program.hpp"
+#include "keypad.hpp"
+#include "format.hpp"
+#include <algorithm>    // min, max
+#include <charconv>     // from_chars
+#include <cstdio>       // fwrite, fread, fprintf
+#include <cstdlib>      // atoi, atol
+#include <cstring>      // memchr
+#include <exception>    // exception
+#include <functional>   // cref, ref
+#include <memory>       // unique_ptr
+#include <stdexcept>    // runtime_error
+#include <string>       // string
+#include <string_view>  // string_view
+#include <system_error> // errc
+#include <thread>       // thread, hardware_concurrency
+#include <vector>       // vector
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap, madvise
+#include <sys/stat.h>   // fstat
+#include <unistd.h>     // close, getopt, sysconf
+
+namespace {
+
+/** @brief Column bound to a general register or pushed onto the stack */
+typedef struct {
+    // 0-based column index
+    std::size_t column;
+    // name of the general register or empty to push onto the stack
+    std::string reg;
+} Binding;
+
+typedef struct {
+    std::string expression;
+    std::vector<Binding> bindings;
+    char delimiter;
+    bool has_header;
+    // write the input row before its result
+    bool append;
+    unsigned threads;
+    std::size_t chunk_size;
+    const char* path;
+} Options;
+
+/** @brief Output of a chunk and how many of its rows failed */
+typedef struct {
+    std::string text;
+    std::size_t errors;
+} ChunkOutput;
+
+void PrintUsage(const char* name) {
+    std::fprintf(stderr,
+        "Usage: %s -e EXPRESSION [options] [FILE]\n"
+        "Evaluates EXPRESSION for each row of FILE (or stdin).\n"
+        "  -e EXPR    RPN expression, e.g. \"ENTER * SQRT\"\n"
+        "  -r R=N     store column N (1-based) to general register R (A-J)\n"
+        "  -s N       push column N onto the stack; repeatable, in order\n"
+        "  -d C       column delimiter (default ,)\n"
+        "  -H         the first row is a header\n"
+        "  -a         write each row followed by its result\n"
+        "  -j N       number of threads (default: all cores)\n"
+        "  -c BYTES   chunk size (default 4 MiB)\n",
+        name);
+}
+
+bool ParseColumn(std::string_view text, std::size_t& column) {
+    const auto res = std::from_chars(text.data(), text.data() + text.size(), column);
+    if (res.ec != std::errc() || res.ptr != text.data() + text.size() || column == 0)
+        return false;
+    column -= 1;
+    return true;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    options.delimiter = ',';
+    options.has_header = false;
+    options.append = false;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+    options.chunk_size = 4 << 20;
+    options.path = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:r:s:d:Haj:c:h")) != -1) {
+        switch (opt) {
+            case 'e':
+                options.expression = optarg;
+                break;
+            case 'r': {
+                const std::string_view arg(optarg);
+                const auto eq = arg.find('=');
+                Binding binding;
+                if (eq == std::string_view::npos ||
+                    key::GenRegIndex(std::string(arg.substr(0, eq))) < 0 ||
+                    !ParseColumn(arg.substr(eq + 1), binding.column))
+                    return false;
+                binding.reg = std::string(arg.substr(0, eq));
+                options.bindings.push_back(binding);
+                break;
+            }
+            case 's': {
+                Binding binding;
+                if (!ParseColumn(optarg, binding.column))
+                    return false;
+                options.bindings.push_back(binding);
+                break;
+            }
+            case 'd':
+                options.delimiter = optarg[0];
+                break;
+            case 'H':
+                options.has_header = true;
+                break;
+            case 'a':
+                options.append = true;
+                break;
+            case 'j':
+                options.threads = std::max(1, std::atoi(optarg));
+                break;
+            case 'c':
+                options.chunk_size = std::max(1L, std::atol(optarg));
+                break;
+            default:
+                return false;
+        }
+    }
+    if (optind < argc)
+        options.path = argv[optind];
+    return !options.expression.empty();
+}
+
+/** @brief Parses a field, ignoring the spaces around it */
+bool ParseField(std::string_view field, double& value) {
+    while (!field.empty() && field.front() == ' ')
+        field.remove_prefix(1);
+    while (!field.empty() && field.back() == ' ')
+        field.remove_suffix(1);
+    const auto res = std::from_chars(field.data(), field.data() + field.size(), value);
+    return res.ec == std::errc() && res.ptr == field.data() + field.size();
+}
+
+/**
+ * @brief Evaluates the program on a single row.
+ *
+ * @return False if a column is missing or not a number or if the
+ *         evaluation threw
+ */
+bool EvalRow(std::string_view row, const Options& options,
+             const backend::Program& program, backend::Backend& backend,
+             std::vector<std::string_view>& fields, double& result) {
+    fields.clear();
+    std::size_t begin = 0;
+    while (true) {
+        const auto end = row.find(options.delimiter, begin);
+        fields.push_back(row.substr(begin, end - begin));
+        if (end == std::string_view::npos)
+            break;
+        begin = end + 1;
+    }
+    backend.Reset();
+    bool has_regs = false;
+    // registers first so that the stack can be cleared afterwards
+    for (const auto& binding: options.bindings) {
+        if (binding.reg.empty())
+            continue;
+        if (binding.column >= fields.size())
+            return false;
+        double value;
+        if (!ParseField(fields[binding.column], value))
+            return false;
+        backend.Insert(value);
+        backend.Sto(binding.reg);
+        has_regs = true;
+    }
+    if (has_regs)
+        backend.Clr();
+    for (const auto& binding: options.bindings) {
+        if (!binding.reg.empty())
+            continue;
+        if (binding.column >= fields.size())
+            return false;
+        double value;
+        if (!ParseField(fields[binding.column], value))
+            return false;
+        backend.Insert(value);
+    }
+    try {
+        result = program.Run(backend);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+/** @brief Evaluates all rows of a chunk that ends at a line boundary */
+void FilterChunk(std::string_view chunk, const Options& options,
+                 const backend::Program& program, ChunkOutput& out) {
+    backend::Backend backend(key::keypad);
+    std::vector<std::string_view> fields;
+    out.text.clear();
+    out.errors = 0;
+    // roughly as much output as input
+    out.text.reserve(chunk.size() + chunk.size() / 2);
+    char number[format::kBufferSize];
+    while (!chunk.empty()) {
+        auto eol = chunk.find('\n');
+        if (eol == std::string_view::npos)
+            eol = chunk.size();
+        auto row = chunk.substr(0, eol);
+        chunk.remove_prefix(std::min(eol + 1, chunk.size()));
+        if (!row.empty() && row.back() == '\r')
+            row.remove_suffix(1);
+        if (row.empty())
+            continue;
+        double result;
+        if (options.append) {
+            out.text.append(row);
+            out.text.push_back(options.delimiter);
+        }
+        if (EvalRow(row, options, program, backend, fields, result)) {
+            char* end = format::Shortest(number, number + sizeof(number), result);
+            out.text.append(number, end);
+        } else {
+            out.text.append("nan");
+            out.errors++;
+        }
+        out.text.push_back('\n');
+    }
+}
+
+/**
+ * @brief Provides the input in chunks that end at line boundaries.
+ *        A chunk stays valid until `Next` is called again for the
+ *        same slot.
+ */
+class ChunkReader {
+public:
+    virtual ~ChunkReader() {}
+    /** @brief The first line without the line ending */
+    virtual std::string Header() = 0;
+    /**
+     * @param slot Index of the chunk within the current wave
+     * @param out  The chunk; empty at the end of the input
+     */
+    virtual void Next(std::size_t slot, std::string_view& out) = 0;
+    /** @brief All chunks returned so far have been consumed */
+    virtual void Release() {}
+};
+
+/** @brief Reads a file through a read-only memory map */
+class MappedReader: public ChunkReader {
+public:
+    MappedReader(int fd, std::size_t size, std::size_t chunk_size):
+        data_(nullptr), size_(size), pos_(0), released_(0),
+        chunk_size_(chunk_size) {
+        if (size_ == 0)
+            return;
+        void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("mmap failed");
+        data_ = static_cast<const char*>(addr);
+        madvise(addr, size_, MADV_SEQUENTIAL);
+    }
+    ~MappedReader() {
+        if (data_)
+            munmap(const_cast<char*>(data_), size_);
+    }
+    std::string Header() override {
+        if (pos_ == size_)
+            return "";
+        const char* eol = static_cast<const char*>(
+            std::memchr(data_ + pos_, '\n', size_ - pos_));
+        const std::size_t end = (eol) ? eol - data_ : size_;
+        std::string header(data_ + pos_, end - pos_);
+        pos_ = std::min(end + 1, size_);
+        return header;
+    }
+    void Next(std::size_t, std::string_view& out) override {
+        if (pos_ == size_) {
+            out = std::string_view();
+            return;
+        }
+        std::size_t end = std::min(pos_ + chunk_size_, size_);
+        const char* eol = static_cast<const char*>(
+            std::memchr(data_ + end, '\n', size_ - end));
+        end = (eol) ? eol - data_ + 1 : size_;
+        out = std::string_view(data_ + pos_, end - pos_);
+        pos_ = end;
+    }
+    void Release() override {
+        // drop the pages that have been evaluated to bound the memory
+        const std::size_t page = sysconf(_SC_PAGESIZE);
+        const std::size_t until = pos_ / page * page;
+        if (until > released_) {
+            madvise(const_cast<char*>(data_) + released_, until - released_,
+                    MADV_DONTNEED);
+            released_ = until;
+        }
+    }
+
+private:
+    const char* data_;
+    std::size_t size_;
+    std::size_t pos_;
+    std::size_t released_;
+    std::size_t chunk_size_;
+};
+
+/** @brief Reads a stream (e.g. a pipe) into one buffer per slot */
+class StreamReader: public ChunkReader {
+public:
+    StreamReader(std::FILE* file, std::size_t chunk_size, std::size_t slots):
+        file_(file), chunk_size_(chunk_size), buffers_(slots) {}
+    std::string Header() override {
+        std::string header;
+        int c;
+        while ((c = std::fgetc(file_)) != EOF && c != '\n')
+            header.push_back(static_cast<char>(c));
+        return header;
+    }
+    void Next(std::size_t slot, std::string_view& out) override {
+        auto& buffer = buffers_[slot];
+        // start with the partial line left over by the previous chunk
+        buffer.swap(carry_);
+        carry_.clear();
+        // read until the chunk size is reached and a line has ended
+        while (true) {
+            const std::size_t old_size = buffer.size();
+            buffer.resize(old_size + chunk_size_);
+            const std::size_t n = std::fread(&buffer[old_size], 1, chunk_size_, file_);
+            buffer.resize(old_size + n);
+            if (n < chunk_size_)
+                break; // end of input
+            // keep everything after the last line ending for later
+            const auto eol = buffer.rfind('\n');
+            if (eol != std::string::npos) {
+                carry_.assign(buffer, eol + 1, std::string::npos);
+                buffer.resize(eol + 1);
+                break;
+            }
+        }
+        out = std::string_view(buffer);
+    }
+
+private:
+    std::FILE* file_;
+    std::size_t chunk_size_;
+    std::vector<std::string> buffers_;
+    std::string carry_;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const backend::Program program(options.expression, key::keypad);
+
+    std::unique_ptr<ChunkReader> reader;
+    int fd = -1;
+    if (options.path) {
+        fd = open(options.path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            std::fprintf(stderr, "Cannot open %s\n", options.path);
+            return 1;
+        }
+        reader = std::make_unique<MappedReader>(fd, st.st_size, options.chunk_size);
+    } else {
+        reader = std::make_unique<StreamReader>(stdin, options.chunk_size,
+                                                options.threads);
+    }
+
+    if (options.has_header) {
+        auto header = reader->Header();
+        if (!header.empty() && header.back() == '\r')
+            header.pop_back();
+        header = (options.append) ? header + options.delimiter + "result\n" :
+                                    std::string("result\n");
+        std::fwrite(header.data(), 1, header.size(), stdout);
+    }
+
+    // evaluate one chunk per thread, then write them in order
+    std::vector<std::string_view> chunks(options.threads);
+    std::vector<ChunkOutput> outputs(options.threads);
+    std::size_t errors = 0;
+    bool done = false;
+    while (!done) {
+        std::size_t nchunks = 0;
+        for (; nchunks < options.threads; ++nchunks) {
+            reader->Next(nchunks, chunks[nchunks]);
+            if (chunks[nchunks].empty()) {
+                done = true;
+                break;
+            }
+        }
+        std::vector<std::thread> workers;
+        for (std::size_t i = 1; i < nchunks; ++i)
+            workers.emplace_back(FilterChunk, chunks[i], std::cref(options),
+                                 std::cref(program), std::ref(outputs[i]));
+        if (nchunks > 0)
+            FilterChunk(chunks[0], options, program, outputs[0]);
+        for (auto& worker: workers)
+            worker.join();
+        for (std::size_t i = 0; i < nchunks; ++i) {
+            std::fwrite(outputs[i].text.data(), 1, outputs[i].text.size(), stdout);
+            errors += outputs[i].errors;
+        }
+        reader->Release();
+    }
+    std::fflush(stdout);
+    if (fd >= 0)
+        close(fd);
+    if (errors > 0)
+        std::fprintf(stderr, "%zu row(s) could not be evaluated\n", errors);
+    return (errors > 0) ? 2 : 0;
+}
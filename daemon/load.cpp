@@ -0,0 +1,334 @@
+/**
+ * Load generator for hip35d: opens many connections, keeps a number
+ * of requests in flight on each and reports the throughput and the
+ * latency percentiles of the responses. Example - 1000 connections,
+ * 16 requests in flight on each, 1 million requests in total:
+ *     hip35load -c 1000 -p 16 -n 1000000 -e "2 ENTER 3 + SQRT"
+ * Run `hip35load -h` for all options.
+ *
+ * The latency of a request is the time from writing it until its
+ * response has been read. Each thread drives its share of the
+ * connections with its own epoll loop.
+ */
+#include "protocol.hpp"
+#include <algorithm>     // max, min, sort
+#include <chrono>        // steady_clock, duration
+#include <cerrno>        // errno, EAGAIN, EINTR
+#include <cmath>         // ceil
+#include <csignal>       // signal, SIGPIPE
+#include <cstdint>       // uint32_t, uint64_t
+#include <cstdio>        // printf, fprintf
+#include <cstdlib>       // atoi, atol
+#include <cstring>       // memmove, strncpy, strerror
+#include <functional>    // ref, cref
+#include <string>        // string
+#include <string_view>   // string_view
+#include <thread>        // thread
+#include <utility>       // move
+#include <vector>        // vector
+#include <fcntl.h>       // fcntl, O_NONBLOCK
+#include <sys/epoll.h>   // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/socket.h>  // socket, connect, send
+#include <sys/un.h>      // sockaddr_un
+#include <unistd.h>      // read, close, getopt
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct {
+    const char* path;
+    std::string expression;
+    std::size_t connections;
+    std::size_t requests;
+    std::size_t pipeline;
+    unsigned threads;
+} Options;
+
+/** @brief What a thread measured */
+typedef struct {
+    // nanoseconds per response
+    std::vector<std::uint64_t> latencies;
+    std::size_t errors;
+    // connections closed before all their responses arrived
+    std::size_t failed;
+} Results;
+
+/** @brief A connection and its requests in flight */
+typedef struct {
+    int fd;
+    std::size_t quota;
+    std::size_t sent;
+    std::size_t received;
+    // send times of the requests in flight, by request index modulo
+    // the pipeline depth
+    std::vector<Clock::time_point> sent_at;
+    std::vector<char> in;
+    std::size_t in_size;
+    std::string out;
+    std::size_t out_pos;
+    bool writable_wait;
+} Client;
+
+void PrintUsage(const char* name) {
+    std::fprintf(stderr,
+        "Usage: %s [options]\n"
+        "Sends expressions to hip35d and reports latency and throughput.\n"
+        "  -s PATH    socket (default %s)\n"
+        "  -e EXPR    expression of every request (default \"2 ENTER 3 + 4 *\")\n"
+        "  -c N       connections (default 64)\n"
+        "  -n N       requests in total (default 100000)\n"
+        "  -p N       requests in flight per connection (default 16)\n"
+        "  -j N       threads (default 1)\n",
+        name, protocol::kDefaultSocket);
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    options.path = protocol::kDefaultSocket;
+    options.expression = "2 ENTER 3 + 4 *";
+    options.connections = 64;
+    options.requests = 100000;
+    options.pipeline = 16;
+    options.threads = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:e:c:n:p:j:h")) != -1) {
+        switch (opt) {
+            case 's':
+                options.path = optarg;
+                break;
+            case 'e':
+                options.expression = optarg;
+                break;
+            case 'c':
+                options.connections = std::max(1, std::atoi(optarg));
+                break;
+            case 'n':
+                options.requests = std::max(1L, std::atol(optarg));
+                break;
+            case 'p':
+                options.pipeline = std::max(1, std::atoi(optarg));
+                break;
+            case 'j':
+                options.threads = std::max(1, std::atoi(optarg));
+                break;
+            default:
+                return false;
+        }
+    }
+    options.threads = std::min<std::size_t>(options.threads, options.connections);
+    return optind == argc && options.expression.size() <= protocol::kMaxFrameBytes;
+}
+
+int Connect(const char* path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+/** @brief Queues requests up to the pipeline depth and the quota */
+void Send(Client& client, const std::string& request, std::size_t pipeline) {
+    const auto now = Clock::now();
+    while (client.sent < client.quota && client.sent - client.received < pipeline) {
+        client.sent_at[client.sent % pipeline] = now;
+        client.out.append(request);
+        ++client.sent;
+    }
+}
+
+/** @brief Writes what the socket takes; false on error */
+bool Flush(Client& client) {
+    while (client.out_pos < client.out.size()) {
+        const ssize_t nwritten = send(client.fd, client.out.data() + client.out_pos,
+                                      client.out.size() - client.out_pos, MSG_NOSIGNAL);
+        if (nwritten < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN;
+        }
+        client.out_pos += nwritten;
+    }
+    client.out.clear();
+    client.out_pos = 0;
+    return true;
+}
+
+/** @brief Drives the connections until all their responses arrived */
+void Run(std::vector<Client>& clients, const Options& options, Results& results) {
+    std::string request;
+    protocol::AppendRequest(options.expression, request);
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    std::size_t active = 0;
+    for (auto& client: clients) {
+        // with more connections than requests some have none to send
+        // and would never get an event
+        if (client.quota == 0) {
+            close(client.fd);
+            client.fd = -1;
+            continue;
+        }
+        Send(client, request, options.pipeline);
+        Flush(client);
+        client.writable_wait = !client.out.empty();
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        if (client.writable_wait)
+            event.events |= EPOLLOUT;
+        event.data.ptr = &client;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd, &event);
+        ++active;
+    }
+    const auto Finish = [&](Client& client) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd, nullptr);
+        close(client.fd);
+        client.fd = -1;
+        --active;
+    };
+    std::vector<epoll_event> events(256);
+    while (active > 0) {
+        const int ready = epoll_wait(epoll_fd, events.data(), events.size(), -1);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            auto& client = *static_cast<Client*>(events[i].data.ptr);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                if (client.in.size() - client.in_size < 4096)
+                    client.in.resize(client.in.size() * 2);
+                const ssize_t nread = read(client.fd, client.in.data() + client.in_size,
+                                           client.in.size() - client.in_size);
+                if (nread <= 0 && !(nread < 0 && (errno == EAGAIN || errno == EINTR))) {
+                    results.failed++;
+                    Finish(client);
+                    continue;
+                }
+                if (nread > 0) {
+                    client.in_size += nread;
+                    const auto now = Clock::now();
+                    const std::size_t consumed = protocol::ForEachFrame(
+                        client.in.data(), client.in_size, [&](std::string_view response) {
+                            const auto& sent_at = client.sent_at[client.received % options.pipeline];
+                            results.latencies.push_back(
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    now - sent_at).count());
+                            if (response.empty() || response[0] != protocol::kStatusOk)
+                                results.errors++;
+                            ++client.received;
+                        });
+                    if (consumed > client.in_size) {
+                        std::fprintf(stderr, "Response longer than %zu bytes\n",
+                                     protocol::kMaxFrameBytes);
+                        results.failed++;
+                        Finish(client);
+                        continue;
+                    }
+                    std::memmove(client.in.data(), client.in.data() + consumed,
+                                 client.in_size - consumed);
+                    client.in_size -= consumed;
+                }
+            }
+            if (client.received == client.quota) {
+                Finish(client);
+                continue;
+            }
+            Send(client, request, options.pipeline);
+            if (!Flush(client)) {
+                results.failed++;
+                Finish(client);
+                continue;
+            }
+            // wait until the socket takes the rest of the requests
+            const bool wait = !client.out.empty();
+            if (wait != client.writable_wait) {
+                client.writable_wait = wait;
+                epoll_event event = {};
+                event.events = EPOLLIN;
+                if (wait)
+                    event.events |= EPOLLOUT;
+                event.data.ptr = &client;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &event);
+            }
+        }
+    }
+    close(epoll_fd);
+}
+
+/** @brief The latency below which `percent` of the responses arrived, in us */
+double Percentile(const std::vector<std::uint64_t>& sorted, double percent) {
+    if (sorted.empty())
+        return 0.0;
+    const auto rank = static_cast<std::size_t>(std::ceil(percent / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, std::max<std::size_t>(rank, 1) - 1)] / 1e3;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // the requests are shared out evenly among the connections
+    std::vector<std::vector<Client>> clients(options.threads);
+    for (std::size_t i = 0; i < options.connections; ++i) {
+        Client client = {};
+        client.fd = Connect(options.path);
+        if (client.fd < 0) {
+            std::fprintf(stderr, "Cannot connect to %s: %s\n", options.path,
+                         std::strerror(errno));
+            return 1;
+        }
+        client.quota = options.requests / options.connections +
+                       (i < options.requests % options.connections ? 1 : 0);
+        client.sent_at.resize(options.pipeline);
+        client.in.resize(16 << 10);
+        clients[i % options.threads].push_back(std::move(client));
+    }
+    std::vector<Results> results(options.threads);
+    for (std::size_t t = 0; t < options.threads; ++t)
+        results[t].latencies.reserve(options.requests / options.threads + 1);
+
+    const auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < options.threads; ++t)
+        threads.emplace_back(Run, std::ref(clients[t]), std::cref(options),
+                             std::ref(results[t]));
+    for (auto& thread: threads)
+        thread.join();
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    std::vector<std::uint64_t> latencies;
+    std::size_t errors = 0;
+    std::size_t failed = 0;
+    for (const auto& result: results) {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+        failed += result.failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%zu responses on %zu connections, %zu in flight each, %u thread(s)\n",
+                latencies.size(), options.connections, options.pipeline, options.threads);
+    std::printf("  throughput    %.0f requests/s\n",
+                latencies.size() / std::max(elapsed.count(), 1e-9));
+    std::printf("  latency (us)  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+                Percentile(latencies, 50), Percentile(latencies, 90),
+                Percentile(latencies, 99), Percentile(latencies, 99.9),
+                Percentile(latencies, 100));
+    std::printf("  errors        %zu\n", errors);
+    if (failed > 0)
+        std::printf("  closed early  %zu connections\n", failed);
+    return (errors == 0 && failed == 0) ? 0 : 1;
+}
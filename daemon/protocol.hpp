@@ -0,0 +1,93 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <cstddef>     // size_t
+#include <cstdint>     // uint32_t, uint8_t
+#include <cstring>     // memcpy
+#include <string>      // string
+#include <string_view> // string_view
+
+/**
+ * @brief Framing of the daemon's messages. Every message is a frame:
+ *        a 4-byte little endian length followed by that many bytes.
+ *        A request's bytes are an RPN expression, e.g.
+ *        "2 ENTER 3 +". A response's first byte is a `Status`; an
+ *        evaluated expression is followed by register X as 8 raw
+ *        bytes (host byte order; the socket is local) and a failed
+ *        one by the error message. A client may send many requests
+ *        before reading the responses, which come in the same order.
+ */
+namespace protocol {
+
+/** @brief Where the daemon listens unless told otherwise */
+constexpr const char* kDefaultSocket = "/tmp/hip35.sock";
+/** @brief Bytes of the length that precedes a frame */
+constexpr std::size_t kHeaderBytes = 4;
+/** @brief Longest frame; a connection that sends a longer one is closed */
+constexpr std::size_t kMaxFrameBytes = 64 << 10;
+
+typedef enum {
+    kStatusOk = 0,
+    kStatusError
+} Status;
+
+inline void PutLength(std::uint32_t length, std::string& out) {
+    const char bytes[kHeaderBytes] = {
+        static_cast<char>(length), static_cast<char>(length >> 8),
+        static_cast<char>(length >> 16), static_cast<char>(length >> 24)};
+    out.append(bytes, kHeaderBytes);
+}
+
+/** @brief Length of the frame that starts at `header` */
+inline std::uint32_t GetLength(const char* header) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(header);
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+           static_cast<std::uint32_t>(bytes[3]) << 24;
+}
+
+inline void AppendRequest(std::string_view expression, std::string& out) {
+    PutLength(static_cast<std::uint32_t>(expression.size()), out);
+    out.append(expression);
+}
+
+inline void AppendResult(double x, std::string& out) {
+    PutLength(1 + sizeof(double), out);
+    out.push_back(static_cast<char>(kStatusOk));
+    char bytes[sizeof(double)];
+    std::memcpy(bytes, &x, sizeof(double));
+    out.append(bytes, sizeof(double));
+}
+
+inline void AppendError(std::string_view message, std::string& out) {
+    PutLength(static_cast<std::uint32_t>(1 + message.size()), out);
+    out.push_back(static_cast<char>(kStatusError));
+    out.append(message);
+}
+
+/**
+ * @brief Splits the complete frames at the start of a buffer.
+ *
+ * @param data   Received bytes
+ * @param size   Number of received bytes
+ * @param handle Called with each frame's bytes (without the length)
+ *
+ * @return Bytes consumed, or `size + 1` if a frame is too long
+ */
+template <typename F>
+std::size_t ForEachFrame(const char* data, std::size_t size, F&& handle) {
+    std::size_t pos = 0;
+    while (size - pos >= kHeaderBytes) {
+        const std::size_t length = GetLength(data + pos);
+        if (length > kMaxFrameBytes)
+            return size + 1;
+        if (size - pos - kHeaderBytes < length)
+            break;
+        handle(std::string_view(data + pos + kHeaderBytes, length));
+        pos += kHeaderBytes + length;
+    }
+    return pos;
+}
+
+} // namespace protocol
+
+#endif /* PROTOCOL_HPP */
@@ -0,0 +1,305 @@
+/**
+ * Evaluates RPN expressions for local clients over a Unix domain
+ * socket, so that a service can keep a calculator around instead of
+ * starting one per expression. Example:
+ *     hip35d -s /tmp/hip35.sock &
+ *     hip35load -s /tmp/hip35.sock -c 1000
+ * Run `hip35d -h` for all options; see protocol.hpp for the framing.
+ *
+ * Every connection is a session with its own calculator, so STO/RCL,
+ * LASTX and the stack persist between a client's expressions, like
+ * on the real calculator. One thread multiplexes all connections
+ * with epoll. Requests are evaluated as soon as they've arrived and
+ * the responses of everything read at once are written together, so
+ * pipelined requests cost one read and one write. A connection's
+ * buffers keep their memory, so requests don't allocate.
+ */
+#include "engine.hpp"
+#include "keypad.hpp"
+#include "protocol.hpp"
+#include <algorithm>     // max
+#include <csignal>       // sigaction, SIGINT, SIGTERM, SIGPIPE
+#include <cerrno>        // errno, EAGAIN, EINTR
+#include <cstdint>       // uint32_t
+#include <cstdio>        // fprintf
+#include <cstdlib>       // atoi
+#include <cstring>       // memmove, strncpy, strerror
+#include <exception>     // exception
+#include <memory>        // unique_ptr, make_unique
+#include <string>        // string
+#include <string_view>   // string_view
+#include <unordered_map> // unordered_map
+#include <vector>        // vector
+#include <sys/epoll.h>   // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/socket.h>  // socket, bind, listen, accept4, send
+#include <sys/un.h>      // sockaddr_un
+#include <unistd.h>      // read, close, unlink, getopt
+
+namespace {
+
+typedef struct {
+    const char* path;
+    std::size_t depth;
+    std::size_t max_connections;
+} Options;
+
+// set by SIGINT and SIGTERM
+volatile std::sig_atomic_t g_stop = 0;
+
+void Stop(int) { g_stop = 1; }
+
+void PrintUsage(const char* name) {
+    std::fprintf(stderr,
+        "Usage: %s [options]\n"
+        "Evaluates RPN expressions sent over a Unix domain socket.\n"
+        "  -s PATH    socket (default %s)\n"
+        "  -d DEPTH   levels of each session's stack (default 4)\n"
+        "  -c N       most connections at once (default 4096)\n",
+        name, protocol::kDefaultSocket);
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    options.path = protocol::kDefaultSocket;
+    options.depth = backend::kStackDepth;
+    options.max_connections = 4096;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:c:h")) != -1) {
+        switch (opt) {
+            case 's':
+                options.path = optarg;
+                break;
+            case 'd':
+                options.depth = std::max(2, std::atoi(optarg));
+                break;
+            case 'c':
+                options.max_connections = std::max(1, std::atoi(optarg));
+                break;
+            default:
+                return false;
+        }
+    }
+    return optind == argc;
+}
+
+/** @brief A client's connection and calculator */
+class Session {
+public:
+    Session(int fd, std::size_t depth):
+        fd_(fd),
+        engine_(key::keypad, depth),
+        in_(kReadBytes),
+        in_size_(0),
+        out_(),
+        out_pos_(0),
+        events_(EPOLLIN),
+        requests_(0) {}
+    ~Session() { close(fd_); }
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    /**
+     * @brief Reads what has arrived, evaluates every complete request
+     *        and writes the responses.
+     *
+     * @return False if the connection should be closed
+     */
+    bool OnReadable() {
+        if (in_.size() - in_size_ < kReadBytes / 2)
+            in_.resize(in_.size() * 2);
+        const ssize_t nread = read(fd_, in_.data() + in_size_, in_.size() - in_size_);
+        if (nread < 0)
+            return errno == EAGAIN || errno == EINTR;
+        if (nread == 0)
+            return false; // the client closed the connection
+        in_size_ += nread;
+        const std::size_t consumed = protocol::ForEachFrame(in_.data(), in_size_,
+            [this](std::string_view expression) { Evaluate(expression); });
+        if (consumed > in_size_)
+            return false;
+        // keep the partial request for the next read
+        std::memmove(in_.data(), in_.data() + consumed, in_size_ - consumed);
+        in_size_ -= consumed;
+        return true;
+    }
+    /**
+     * @brief Writes as much of the pending responses as the socket
+     *        takes.
+     *
+     * @return False if the connection should be closed
+     */
+    bool Flush() {
+        while (out_pos_ < out_.size()) {
+            const ssize_t nwritten = send(fd_, out_.data() + out_pos_,
+                                          out_.size() - out_pos_, MSG_NOSIGNAL);
+            if (nwritten < 0) {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN;
+            }
+            out_pos_ += nwritten;
+        }
+        if (out_pos_ == out_.size()) {
+            // keeps its memory for the next responses
+            out_.clear();
+            out_pos_ = 0;
+        }
+        return true;
+    }
+    /**
+     * @brief The epoll events the session waits for: writable while
+     *        responses are pending and readable unless too many are.
+     */
+    std::uint32_t WantedEvents() const {
+        const std::size_t pending = out_.size() - out_pos_;
+        std::uint32_t events = 0;
+        if (pending < kMaxPendingBytes)
+            events |= EPOLLIN;
+        if (pending > 0)
+            events |= EPOLLOUT;
+        return events;
+    }
+    int fd() const { return fd_; }
+    std::uint32_t& events() { return events_; }
+    std::size_t requests() const { return requests_; }
+
+private:
+    // bytes read at once
+    static constexpr std::size_t kReadBytes = 16 << 10;
+    // responses pending before the session stops reading requests
+    static constexpr std::size_t kMaxPendingBytes = 1 << 20;
+
+    void Evaluate(std::string_view expression) {
+        ++requests_;
+        try {
+            protocol::AppendResult(engine_.EvalString(expression), out_);
+        } catch (const std::exception& e) {
+            protocol::AppendError(e.what(), out_);
+        }
+    }
+
+    int fd_;
+    backend::Engine engine_;
+    // received bytes; the first `in_size_` are a partial request
+    std::vector<char> in_;
+    std::size_t in_size_;
+    // responses; the first `out_pos_` bytes have been written
+    std::string out_;
+    std::size_t out_pos_;
+    // epoll events the session is registered for
+    std::uint32_t events_;
+    std::size_t requests_;
+};
+
+int Listen(const char* path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    // a socket left behind by a previous run
+    unlink(path);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        std::fprintf(stderr, "Cannot listen on %s: %s\n", path, std::strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    struct sigaction action = {};
+    action.sa_handler = Stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const int listen_fd = Listen(options.path);
+    if (listen_fd < 0)
+        return 1;
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    // the listening socket is the only one without a session
+    epoll_event listen_event = {};
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = nullptr;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+    std::fprintf(stderr, "%s: listening on %s\n", argv[0], options.path);
+
+    std::unordered_map<int, std::unique_ptr<Session>> sessions;
+    std::size_t served = 0;
+    std::size_t accepted = 0;
+    const auto Close = [&](Session* session) {
+        served += session->requests();
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->fd(), nullptr);
+        sessions.erase(session->fd());
+    };
+    std::vector<epoll_event> events(256);
+    while (!g_stop) {
+        const int ready = epoll_wait(epoll_fd, events.data(), events.size(), -1);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            auto* session = static_cast<Session*>(events[i].data.ptr);
+            if (!session) {
+                // accept everyone waiting
+                int fd;
+                while ((fd = accept4(listen_fd, nullptr, nullptr,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    if (sessions.size() >= options.max_connections) {
+                        close(fd);
+                        continue;
+                    }
+                    auto& added = sessions[fd];
+                    added = std::make_unique<Session>(fd, options.depth);
+                    epoll_event event = {};
+                    event.events = added->events();
+                    event.data.ptr = added.get();
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+                    ++accepted;
+                }
+                continue;
+            }
+            const auto flags = events[i].events;
+            bool open = !(flags & EPOLLERR);
+            if (open && (flags & (EPOLLIN | EPOLLHUP)))
+                open = session->OnReadable();
+            if (open)
+                open = session->Flush();
+            if (!open) {
+                Close(session);
+                continue;
+            }
+            const auto wanted = session->WantedEvents();
+            if (wanted != session->events()) {
+                session->events() = wanted;
+                epoll_event event = {};
+                event.events = wanted;
+                event.data.ptr = session;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session->fd(), &event);
+            }
+        }
+    }
+
+    for (const auto& pair: sessions)
+        served += pair.second->requests();
+    sessions.clear();
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(options.path);
+    std::fprintf(stderr, "%s: served %zu requests on %zu connections\n",
+                 argv[0], served, accepted);
+}
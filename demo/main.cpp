@@ -1,7 +1,139 @@
+/**
+ * Runs the calculator's UI, or, when stdin isn't a terminal or with
+ * -b, evaluates one expression per line of stdin and writes one
+ * result per line to stdout:
+ *     printf '2 ENTER 3 +\n4 *\n' | demo   # 5, then 20
+ * Lines are evaluated as by `EvalString`, on the same calculator, so
+ * the stack and the registers carry over from line to line. A line
+ * that can't be evaluated gives `nan`.
+ *
+ * The batch mode makes no terminal calls. Input is read in large
+ * blocks; the results of a block are written together before the
+ * next block is read, so a program that writes a line and waits for
+ * its result gets it at once.
+ */
+#include "engine.hpp"
+#include "format.hpp"
 #include "hip35.hpp"
-#include "keypad.hpp" // Key::keypad
+#include "keypad.hpp"  // Key::keypad
+#include <algorithm>   // copy_n
+#include <cerrno>      // errno, EINTR
+#include <cstdio>      // fprintf, fwrite, setvbuf
+#include <cstring>     // memchr, memmove
+#include <exception>   // exception
+#include <memory>      // make_unique
+#include <string>      // string
+#include <string_view> // string_view
+#include <vector>      // vector
+#include <unistd.h>    // getopt, isatty, read
 
-int main() {
+namespace {
+
+// bytes of input read at once and of the output buffer
+constexpr std::size_t kBatchBufferBytes = 1 << 20;
+
+/**
+ * @brief Evaluates the lines of stdin.
+ *
+ * @return Number of lines that couldn't be evaluated
+ */
+std::size_t RunBatch() {
+    backend::Engine engine(key::keypad);
+    std::setvbuf(stdout, nullptr, _IOFBF, kBatchBufferBytes);
+    std::vector<char> input(kBatchBufferBytes);
+    std::size_t size = 0;
+    std::size_t errors = 0;
+    char number[format::kBufferSize];
+    const auto Evaluate = [&](std::string_view line) {
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        char* end;
+        try {
+            end = format::Shortest(number, number + sizeof(number) - 1,
+                                   engine.EvalString(line));
+        } catch (const std::exception&) {
+            end = std::copy_n("nan", 3, number);
+            ++errors;
+        }
+        *end++ = '\n';
+        std::fwrite(number, 1, end - number, stdout);
+    };
+    while (true) {
+        // a line longer than the buffer makes it grow
+        if (size == input.size())
+            input.resize(input.size() * 2);
+        const ssize_t nread = read(STDIN_FILENO, input.data() + size, input.size() - size);
+        if (nread < 0 && errno == EINTR)
+            continue;
+        if (nread <= 0)
+            break;
+        // evaluate the complete lines and keep the last partial one
+        const char* begin = input.data();
+        const char* const last = input.data() + size + nread;
+        const char* eol;
+        while ((eol = static_cast<const char*>(std::memchr(begin, '\n', last - begin)))) {
+            Evaluate(std::string_view(begin, eol - begin));
+            begin = eol + 1;
+        }
+        size = last - begin;
+        std::memmove(input.data(), begin, size);
+        // the results before waiting for more input
+        std::fflush(stdout);
+    }
+    // a last line without a line ending
+    if (size > 0)
+        Evaluate(std::string_view(input.data(), size));
+    std::fflush(stdout);
+    return errors;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // -r FILE records the UI's keystrokes to a tape for hip35replay;
+    // -b evaluates stdin line by line even if it's a terminal
+    const char* tape = nullptr;
+    bool batch = !isatty(STDIN_FILENO);
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b")) != -1) {
+        switch (opt) {
+            case 'r':
+                tape = optarg;
+                break;
+            case 'b':
+                batch = true;
+                break;
+            default:
+                std::fprintf(stderr, "Usage: %s [-b] [-r TAPE]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (batch && tape) {
+        // the batch mode has no keystrokes to record
+        std::fprintf(stderr, "%s: -r records the UI and can't be used with -b "
+                     "or when stdin isn't a terminal\n", argv[0]);
+        return 1;
+    }
+    if (batch) {
+        const std::size_t errors = RunBatch();
+        if (errors > 0)
+            std::fprintf(stderr, "%zu line(s) could not be evaluated\n", errors);
+        return (errors > 0) ? 2 : 0;
+    }
     auto hp = std::make_unique<Ui::Hip35>(key::keypad);
+    if (tape)
+        hp->Record(tape);
     hp->RunUI();
+    std::string error;
+    try {
+        hp->StopRecording();
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+    // after the UI has given the terminal back
+    hp.reset();
+    if (!error.empty()) {
+        std::fprintf(stderr, "%s", error.c_str());
+        return 1;
+    }
 }
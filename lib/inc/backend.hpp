@@ -2,15 +2,18 @@
 #define BACKEND_HPP
 
 #include "ibackend.hpp"
+#include "event_channel.hpp"
 #include "observer.hpp"
 #include "stack.hpp"
+#include "machine.hpp"
 #include "keypad.hpp"
 #include <string> // string
-#include <memory> // unique_ptr
 #include <cmath> // sin, cos, tan, log10, sqrt
 #include <vector> // vector
 #include <utility> // make_pair, pair
 #include <array> // array
+#include <type_traits> // is_trivially_copyable
+#include <cstddef> // offsetof
 
 /**
  * @brief Subject class to observe in the observer design pattern.
@@ -30,19 +33,39 @@ public:
     void Attach(Observer* observer) { observers_.push_back(observer); }
     // Remove the observer from the list
     void Detach(Observer* observer);
+    /**
+     * @brief Also send the notifications to a channel as `Event`s, to
+     *        be consumed asynchronously (e.g. by a `backend::EventPump`).
+     *        Observers attached with `Attach` are still notified
+     *        synchronously.
+     *
+     * @param channel The channel or nullptr to stop sending events
+     */
+    void AttachChannel(backend::EventChannel* channel) { channel_ = channel; }
 
 protected:
     // Meant to be integrated with derived class's methods when a value
     // is inserted
-    void NotifyValue(std::pair<double, double> registers);
+    void NotifyValue(std::pair<double, double> registers) {
+        // free when nothing observes the subject
+        if (!observers_.empty() || channel_ != nullptr)
+            DispatchValue(registers);
+    }
     // Meant to be integrated with derived class's methods when an
     // operation is executed
-    void NotifyOperation(const std::string& operation);
+    void NotifyOperation(const std::string& operation) {
+        if (!observers_.empty() || channel_ != nullptr)
+            DispatchOperation(operation);
+    }
 
 private:
+    void DispatchValue(std::pair<double, double> registers);
+    void DispatchOperation(const std::string& operation);
     // we need a list of observes in order to observe multiple instances
     // (if necessary)
     std::vector<Observer*> observers_;
+    // where to send events to; usually none
+    backend::EventChannel* channel_ = nullptr;
 };
 
 
@@ -58,26 +81,55 @@ typedef enum {
     kTypeStack,          // e.g. SWAP, RDN
     kTypeNumeric,        // e.g. +, SIN
     kTypeEnter,          // ENTER key
-    kTypeStorage         // storage, load in general registers
+    kTypeStorage,        // storage, load in general registers
+    kTypeEex,            // EEX key
+    kTypeRegister        // register name that follows STO/RCL
 } TokenType;
 
 /**
- * @brief Various flags set during the calculator's operation.
+ * @brief The state of a backend besides its stack, as plain data.
+ *        `Backend::SaveState` writes it followed by the levels of the
+ *        stack from X up, so a whole state is checkpointed and
+ *        restored with a couple of `memcpy`s.
+ */
+typedef struct {
+    double lastx;
+    std::array<double, 10> sto_regs;
+    Flags flags;
+} BackendState;
+
+static_assert(std::is_trivially_copyable<BackendState>::value,
+              "a backend's state must be copyable as bytes");
+
+/**
+ * @brief The whole state of a calculator at HP35's depth in one block
+ *        of 2 cache lines, for hosting many calculators (e.g. one per
+ *        client) that take turns on a few backends; see
+ *        `SessionPool`. The fields that every key touches come first
+ *        and share the first cache line; the general registers, which
+ *        only STO and RCL touch, follow. It's plain data, so moving
+ *        it is a `memcpy` of 128 bytes.
  */
-typedef struct Flags {
-    /** @brief Shift up the stack to make space for new entries */
-    bool shift_up;
-    /** @brief EEX key pressed*/
-    bool eex_pressed;
-    /** @brief RCL or STO key pressed*/
-    bool rcl_sto_pressed;
-} Flags;
+typedef struct alignas(64) Session {
+    /** @brief Levels of the stack from X up */
+    std::array<double, kStackDepth> stack;
+    double lastx;
+    Flags flags;
+    std::array<double, 10> sto_regs;
+} Session;
+
+static_assert(std::is_trivially_copyable<Session>::value,
+              "a session must be copyable as bytes");
+static_assert(offsetof(Session, flags) + sizeof(Flags) <= 64,
+              "the stack, LASTX and the flags must share a cache line");
+static_assert(sizeof(Session) == 128, "a session must fit in 2 cache lines");
 
 /**
 * @brief Implements a reverse Polish notation (RPN) calculator [1].
 *        The architecture more or less follows the basic architecture
 *        of the HP35 calculator. It contains a stack of 4 registers;
-*        X, Y, Z and T (T for top, X for bottom). Therefore when we store
+*        X, Y, Z and T (T for top, X for bottom), or a deeper one if
+*        it's constructed with a larger depth. Therefore when we store
 *        a number, it's written to the X register. It also contains
 *        a LASTX register which stores the last value of X before a
 *        function button is pressed.The calculator supports the
@@ -131,14 +183,14 @@ typedef struct Flags {
 */
 class Backend: public IBackend, public Subject {
 public:
-    Backend() = delete;
-    Backend(const key::Keypad& keypad);
+    /**
+     * @param keypad Keys of the calculator
+     * @param depth  Levels of the stack; 4 for HP35's X, Y, Z, T
+     */
+    Backend(const key::Keypad& keypad, std::size_t depth = kStackDepth);
     Backend(const Backend& other) :
         keypad_(other.keypad_),
-        stack_(std::make_unique<Stack>(*other.stack_)),
-        lastx_(other.lastx_),
-        sto_regs_(other.sto_regs_),
-        flags_(other.flags_) {}
+        machine_(other.machine_) {}
     ~Backend() {}
     /** @brief Swaps values of registers X and Y. */
     void SwapXY() override;
@@ -148,8 +200,8 @@ public:
      * @return Pair of values at registers X and Y
      */
     std::pair<double, double> Peek() const override {
-        return std::make_pair((*stack_)[IDX_REG_X],
-                              (*stack_)[IDX_REG_Y]);
+        return std::make_pair(machine_.stack[IDX_REG_X],
+                              machine_.stack[IDX_REG_Y]);
     }
     /**
      * @brief Insert a number in the stack by writing to register
@@ -234,15 +286,70 @@ public:
      * @return The calculation's result
      */
     double Calculate(std::string operation) override;
+    /**
+     * @brief Same as `Calculate` for an 1-operand key whose function
+     *        has already been looked up in the keypad; saves the
+     *        lookups when the same keys are executed repeatedly.
+     *
+     * @param function  The key's function of register X
+     * @param operation The key's keypress, reported to the observers
+     *
+     * @return The calculation's result
+     */
+    double CalculateSingleArg(const std::function<double(double)>& function,
+                              const std::string& operation);
+    /**
+     * @brief Same as `Calculate` for a 2-operand key whose function
+     *        has already been looked up in the keypad.
+     *
+     * @param function  The key's function of registers X and Y
+     * @param operation The key's keypress, reported to the observers
+     *
+     * @return The calculation's result
+     */
+    double CalculateDoubleArg(const std::function<double(double, double)>& function,
+                              const std::string& operation);
     /**
      * @brief Set register X to zero. The purpose of this is to
      *        fix typos and the last entered number.
      */
     void Clx() override;
-    /** @brief Set all registers (entire stack) to zero */
+    /** @brief Set all registers (entire stack, at any depth) to zero */
     void Clr() override;
     /** @brief Insert the value of PI to register X */
     void Pi() override;
+    /**
+     * @brief Inserts the result of keys that only computed with
+     *        numbers they inserted, e.g. `2 ENTER 3 +`, as folded by
+     *        `Optimize`. The stack, LASTX and the flags end up as
+     *        after the keys, given that no EEX was pending: the
+     *        stack is lifted if the first number would lift it, then
+     *        `lifts` times and dropped as many times, and X is
+     *        written.
+     *
+     * @param num   Result of the keys
+     * @param lastx LASTX after the keys
+     * @param lifts Most numbers the keys held in the stack at once,
+     *              minus 1
+     */
+    void InsertConstant(double num, double lastx, unsigned lifts);
+    /**
+     * @brief Same as `*` followed by `+` (or `-`), with the product
+     *        and the sum rounded once (`std::fma`): Z + X * Y (or
+     *        Z - X * Y) is written to X and the stack is dropped twice.
+     *        LASTX is the product, as `+` leaves it.
+     *
+     * @param subtract Whether the second key is `-`
+     *
+     * @return The result
+     */
+    double MultiplyAdd(bool subtract);
+    /**
+     * @brief Bring the calculator to its initial state; zero the
+     *        stack, LASTX and the general registers and reset the
+     *        flags. Observers are not notified.
+     */
+    void Reset();
 
 	/**
 	 * @brief If register X is zero, it sets it to 1.
@@ -270,30 +377,96 @@ public:
 	*             Invalid indexes are ignored.
     */
     void Rcl(std::string name) override;
+    /**
+     * @brief Value of a general register.
+     *
+     * @param idx Index of the register in `key::kNamesGenRegs`
+     */
+    double GenRegister(std::size_t idx) const { return machine_.regs[idx]; }
+    /** @brief Levels of the stack */
+    std::size_t depth() const { return machine_.stack.size(); }
+    /** @brief Bytes of the state `SaveState` writes */
+    std::size_t StateSize() const {
+        return sizeof(BackendState) + machine_.stack.size() * sizeof(double);
+    }
+    /**
+     * @brief Writes the state (stack, LASTX, general registers and
+     *        flags) to a buffer. Nothing is allocated.
+     *
+     * @param state `StateSize()` bytes; a `BackendState` followed by
+     *              the levels of the stack from X up
+     */
+    void SaveState(void* state) const;
+    /**
+     * @brief Restores a state written by `SaveState` of a backend
+     *        with the same depth. Observers are notified of the new
+     *        X and Y.
+     *
+     * @param state `StateSize()` bytes
+     */
+    void LoadState(const void* state);
+    /**
+     * @brief Writes the state to a session, as `SaveState` does. The
+     *        stack must have `kStackDepth` levels; throws
+     *        `std::invalid_argument` otherwise.
+     */
+    void SaveSession(Session& session) const;
+    /**
+     * @brief Restores the state of a session, as `LoadState` does.
+     *        The stack must have `kStackDepth` levels; throws
+     *        `std::invalid_argument` otherwise.
+     */
+    void LoadSession(const Session& session);
     /** Overrides the << operator for the class, e.g.std::cout << <Instance>; */
     friend std::ostream& operator<<(std::ostream& os, const Backend& backend);
 
+protected:
+    /**
+     * @brief A backend without a runtime keypad, for derived classes
+     *        that implement `Calculate` themselves.
+     */
+    explicit Backend(std::size_t depth = kStackDepth);
+    /**
+     * @brief Executes an 1-operand function on the stack; what
+     *        `CalculateSingleArg` does for any callable so that it can
+     *        be inlined.
+     */
+    template <typename F>
+    double ApplySingleArg(F&& function, const std::string& operation) {
+        machine_.CalculateSingleArg(function);
+        // Notify observers about the new operation and value
+        NotifyOperation(operation);
+        NotifyValue(Peek());
+        return machine_.stack[IDX_REG_X];
+    }
+    /** @brief Same as `ApplySingleArg` for 2-operand functions */
+    template <typename F>
+    double ApplyDoubleArg(F&& function, const std::string& operation) {
+        machine_.CalculateDoubleArg(function);
+        NotifyOperation(operation);
+        NotifyValue(Peek());
+        return machine_.stack[IDX_REG_X];
+    }
+    /**
+     * @brief What `Calculate` does for a key that isn't a numeric key;
+     *        raises the lift flag, saves LASTX and throws.
+     *
+     * @param operation The invalid key
+     */
+    [[noreturn]] void InvalidOperation(const std::string& operation);
+
 private:
-    /** reference to a keypad that describes the calculator's key configuration */
-    const key::Keypad& keypad_;
-    // owns the stack - unique_ptr manages its lifetime and deallocation
-    std::unique_ptr<Stack> stack_;
-    // LASTX register; stores the value of X before a function is invoked
-    double lastx_;
     /**
-     * @brief General purpose storage registers (indexed 0 to 9) to
-     *        store constants or intermediate results.
+     * pointer to a keypad that describes the calculator's key
+     * configuration; nullptr if a derived class provides the keys
      */
-    std::array<double, 10> sto_regs_;
+    const key::Keypad* keypad_;
     /**
-     * @brief Maps a register name as defined in Key namespace to
-     *        and index of the `sto_regs_` array. This way, the user
-     *        can store or load from a general register given its name,
-     *        e.g. "A" -> 0, "B" -> 1, etc.
+     * the stack, LASTX, the general registers and the flags, and the
+     * keys' semantics on them; the stack's levels are the only memory
+     * a backend allocates
      */
-    std::unordered_map<std::string, std::size_t> gen_regs_name2idx;
-    // internal flags that store info about the calc's state (e.g. shift up stack)
-    Flags flags_;
+    Machine<Stack> machine_;
 };
 
 
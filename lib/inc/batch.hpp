@@ -0,0 +1,94 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "backend.hpp"
+#include "program.hpp"
+#include "stack.hpp"
+#include <array>   // array
+#include <cstddef> // size_t
+#include <vector>  // vector
+
+namespace backend {
+
+/**
+ * @brief Evaluates a program over many independent rows at once. It
+ *        behaves like `rows` backends executing the same keystrokes
+ *        in lockstep, but its memory is laid out as structure of
+ *        arrays: each of the registers X, Y, Z, T and LASTX is a
+ *        column of `rows` doubles, e.g. for rows 0, 1, 2:
+ *        @verbatim
+ *                  row 0  row 1  row 2
+ *        X     -> [ x0  ,  x1  ,  x2  ]
+ *        Y     -> [ y0  ,  y1  ,  y2  ]
+ *        Z     -> [ z0  ,  z1  ,  z2  ]
+ *        T     -> [ t0  ,  t1  ,  t2  ]
+ *        LASTX -> [ l0  ,  l1  ,  l2  ]
+ *        @endverbatim
+ *        Keys run as kernels over whole columns; the arithmetic ones
+ *        (`+`, `-`, `*`, `/`, CHS, 1/x, SQRT) are vectorized with
+ *        SSE2 or AVX. Lifting, dropping and rotating the stack only
+ *        permute the column pointers. Rows are processed in blocks
+ *        that fit in the cache so the whole program runs on a block
+ *        before moving on to the next one.
+ *        The flags (see `Flags`) depend only on the keys pressed so
+ *        they're shared by all rows. The general registers are also
+ *        stored as columns, allocated the first time STO or RCL
+ *        runs.
+ */
+class Batch {
+public:
+    Batch() = delete;
+    /** @param rows Number of rows; all registers are initialized to 0 */
+    Batch(std::size_t rows);
+    ~Batch() {}
+    /**
+     * @brief Column of a stack register.
+     *
+     * @param reg One of `IDX_REG_X` ... `IDX_REG_T`
+     *
+     * @return Pointer to `rows()` contiguous values. It's invalidated
+     *         by `Run` as the columns are permuted.
+     */
+    double* operator[](std::size_t reg) { return Column(map_[reg]); }
+    const double* operator[](std::size_t reg) const { return Column(map_[reg]); }
+    /** @brief Column of the LASTX register. Invalidated by `Run`. */
+    double* lastx() { return Column(map_[kIdxLastX]); }
+    const double* lastx() const { return Column(map_[kIdxLastX]); }
+    /** @brief Number of rows */
+    std::size_t rows() const { return rows_; }
+    /**
+     * @brief Executes a program on every row. Its effect on each row
+     *        is identical to `Program::Run` on a backend holding the
+     *        row's registers. If a key throws (e.g. division by zero
+     *        in any row), the exception is propagated and the
+     *        contents of the batch are unspecified.
+     *
+     * @param program A program compiled against `key::keypad` or any
+     *                other keypad
+     *
+     * @return Column of register X after the last instruction
+     */
+    const double* Run(const Program& program);
+    /** @brief Zeroes all registers and resets the flags */
+    void Clear();
+
+private:
+    /** @brief Index of LASTX in `map_` after the stack registers */
+    static constexpr std::size_t kIdxLastX = 4;
+    double* Column(unsigned buffer) { return &columns_[buffer * rows_]; }
+    const double* Column(unsigned buffer) const { return &columns_[buffer * rows_]; }
+
+    std::size_t rows_;
+    // 5 columns (X, Y, Z, T, LASTX) of `rows_` doubles each
+    std::vector<double> columns_;
+    // register (X, Y, Z, T, LASTX) -> its column in `columns_`
+    std::array<unsigned, 5> map_;
+    // 10 columns for the general registers; empty until first used
+    std::vector<double> sto_regs_;
+    // shared by all rows since they depend only on the keys
+    Flags flags_;
+};
+
+} /* namespace backend */
+
+#endif /* BATCH_HPP */
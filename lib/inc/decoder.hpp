@@ -0,0 +1,126 @@
+#ifndef DECODER_HPP
+#define DECODER_HPP
+
+#include "backend.hpp"
+#include "keypad.hpp"
+#include "number_lexer.hpp"
+#include <functional> // function
+#include <string>     // string
+#include <string_view> // string_view
+#include <vector>     // vector
+
+namespace backend {
+
+/**
+ * @brief Operations a keypress resolves to. Each one corresponds to
+ *        a single `Backend` method.
+ */
+typedef enum {
+    kOpInsert = 0,       // Insert - write an operand to the stack
+    kOpEnter,            // Enter
+    kOpRdn,              // Rdn
+    kOpSwap,             // SwapXY
+    kOpLastX,            // LastX
+    kOpClx,              // Clx
+    kOpClr,              // Clr
+    kOpPi,               // Pi
+    kOpEex,              // Eex
+    kOpSto,              // Sto
+    kOpRcl,              // Rcl
+    kOpSingleArg,        // 1-operand numeric key, e.g. SIN
+    kOpDoubleArg,        // 2-operand numeric key, e.g. +
+    // produced by `Optimize`, not by decoding keys
+    kOpConstant,         // InsertConstant - keys folded to their result
+    kOpMultiplyAdd       // MultiplyAdd - `*` followed by `+` or `-`
+} Opcode;
+
+/**
+ * @brief A keypress resolved against the keypad, ready to be executed
+ *        by a `Backend` without looking anything up.
+ */
+struct Instruction {
+    Opcode opcode;
+    /** @brief Number to insert (kOpInsert) or EEX argument (kOpEex) */
+    double operand;
+    /** @brief Whether a number was typed before EEX (kOpEex) */
+    bool has_operand;
+    /** @brief The keypress or, for STO/RCL, the register name */
+    std::string key;
+    /** @brief Keypad function of 1-operand keys (kOpSingleArg) */
+    const std::function<double(double)>* single_arg;
+    /** @brief Keypad function of 2-operand keys (kOpDoubleArg) */
+    const std::function<double(double, double)>* double_arg;
+    /** @brief LASTX left by the folded keys (kOpConstant) */
+    double lastx = 0.0;
+    /** @brief How high the folded keys lifted the stack (kOpConstant) */
+    unsigned lifts = 0;
+};
+
+/**
+ * @brief Executes a decoded instruction on a backend by calling the
+ *        backend method the instruction corresponds to.
+ *
+ * @param backend     Backend to execute the instruction on
+ * @param instruction Instruction produced by a `Decoder`
+ */
+void Execute(Backend& backend, const Instruction& instruction);
+
+/**
+ * @brief Translates a sequence of keypresses to backend instructions.
+ *        It implements the keystroke logic of the calculator, i.e.
+ *        it accumulates the digits of an operand until an operation
+ *        is pressed, handles the unary minus (`~`), the postfix
+ *        EEX key and the prefix STO/RCL keys. The decoder depends
+ *        only on the keypresses and not on the stack's contents,
+ *        therefore a sequence of keypresses can be decoded once and
+ *        executed as many times as necessary.
+ */
+class Decoder {
+public:
+    Decoder() = delete;
+    Decoder(const key::Keypad& keypad);
+    ~Decoder() {}
+    /**
+     * @brief Feeds a keypress to the decoder.
+     *
+     * @param keypress A key of the keypad or (part of) an operand
+     * @param out      Where to append the instructions the keypress
+     *                 resolves to. These are 0 to 2 instructions;
+     *                 e.g. `+` after typing `12` results in inserting
+     *                 12 and then adding.
+     *
+     * @return The type of the keypress. It's `kTypeNone` if the key
+     *         was not recognized and had no effect.
+     */
+    TokenType Decode(std::string_view keypress, std::vector<Instruction>& out);
+    /** @brief The operand typed so far (empty if none) */
+    const std::string& operand() const { return operand_.text(); }
+    /** @brief Value of the operand typed so far; 0 if none */
+    double OperandValue() const;
+    /** @brief Discards the typed operand and any pending STO/RCL */
+    void Reset();
+    /**
+     * @brief Whether the next keypress decodes the same after `Reset`,
+     *        i.e. no operand is being typed and no STO/RCL waits for
+     *        its register
+     */
+    bool idle() const { return operand_.empty() && !is_prev_op_storage_; }
+    /** @brief The keypad keypresses are resolved against */
+    const key::Keypad& keypad() const { return keypad_; }
+
+private:
+    /** @brief If an operand is being typed, emit an instruction to insert it */
+    void FlushOperand(std::vector<Instruction>& out);
+
+    const key::Keypad& keypad_;
+    // the operand being typed
+    NumberLexer operand_;
+    // STO or RCL key that waits for its register name
+    std::string storage_op_;
+    // whether the previous keypress was STO or RCL
+    bool is_prev_op_storage_;
+};
+
+} /* namespace backend */
+
+#endif /* DECODER_HPP */
@@ -0,0 +1,98 @@
+#ifndef ENGINE_HPP
+#define ENGINE_HPP
+
+#include "backend.hpp"
+#include "decoder.hpp"
+#include "journal.hpp"
+#include "keypad.hpp"
+#include "observer.hpp"
+#include <cstddef>     // size_t
+#include <memory>      // unique_ptr
+#include <string>      // string
+#include <string_view> // string_view
+#include <vector>      // vector
+
+namespace backend {
+
+/**
+ * @brief Headless calculator; a backend together with the keystroke
+ *        logic of the UI but without any terminal dependencies. It
+ *        can be fed one keypress at a time (what the UI does) or a
+ *        whole expression. The state (stack, LASTX, general
+ *        registers) persists between calls, like on the real
+ *        calculator. Example:
+ *        @verbatim
+ *        backend::Engine engine(key::keypad);
+ *        engine.EvalString("430 ENTER 80 - 1.2 *"); // 420
+ *        engine.EvalString("2 /");                  // 210
+ *        @endverbatim
+ */
+class Engine {
+public:
+    Engine() = delete;
+    /**
+     * @param keypad Keys of the calculator
+     * @param depth  Levels of the stack; 4 for HP35's X, Y, Z, T
+     */
+    Engine(const key::Keypad& keypad, std::size_t depth = kStackDepth);
+    ~Engine() {}
+    // the backend refers to the engine's observer
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+    /**
+     * @brief Presses a key (or enters an operand) and executes what
+     *        it resolves to.
+     *
+     * @param keypress A key of the keypad or (part of) an operand
+     *
+     * @return The type of the keypress; see `Decoder::Decode`
+     */
+    TokenType Press(std::string_view keypress);
+    /**
+     * @brief Evaluates an expression of whitespace-separated operands and
+     *        long (e.g. `SQRT`) or short (e.g. `r`) keys. Any operand
+     *        typed but not entered before is discarded first.
+     *
+     * @param expression E.g. "2 ENTER 3 + SQRT"
+     *
+     * @return Register X after the evaluation
+     */
+    double EvalString(std::string_view expression);
+    /** @brief Discards the operand being typed and any pending STO/RCL */
+    void ClearEntry() { decoder_.Reset(); }
+    /**
+     * @brief Keeps the state before each key in a `Journal` so that
+     *        keys can be undone, and rolls back keys that throw (e.g.
+     *        division by zero) before rethrowing.
+     *
+     * @param max_bytes Memory cap of the history; 0 stops keeping it
+     */
+    void EnableUndo(std::size_t max_bytes);
+    /**
+     * @brief Undoes the last key that changed the state. The operand
+     *        being typed is discarded.
+     *
+     * @return False if there's nothing to undo or undo isn't enabled
+     */
+    bool Undo();
+    /** @brief Redoes the last undone key; false if there's none */
+    bool Redo();
+    /** @brief Value of the operand being typed; 0 if none */
+    double OperandValue() const { return decoder_.OperandValue(); }
+    /** @brief The observer that follows the backend's operations */
+    const Observer& observer() const { return observer_; }
+    Backend& backend() { return backend_; }
+
+private:
+    Observer observer_;
+    Backend backend_;
+    Decoder decoder_;
+    // instructions of the last keypress; kept to reuse its memory
+    std::vector<Instruction> instructions_;
+    // states before the keys; none unless undo is enabled
+    std::unique_ptr<Journal> journal_;
+};
+
+} /* namespace backend */
+
+#endif /* ENGINE_HPP */
@@ -0,0 +1,217 @@
+#ifndef EVENT_CHANNEL_HPP
+#define EVENT_CHANNEL_HPP
+
+#include "observer.hpp"
+#include <atomic>  // atomic, atomic_flag
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <limits>  // numeric_limits
+#include <memory>  // unique_ptr
+#include <thread>  // thread
+
+namespace backend {
+
+/** @brief What an `Event` carries; a bit mask */
+typedef enum {
+    kEventOperation = 1, // a key was executed; see `Event::operation`
+    kEventRegisters = 2  // X and Y changed; see `Event::x`, `Event::y`
+} EventKind;
+
+/**
+ * @brief What a `Subject` notifies its observers about, as plain data
+ *        so that it can be copied into a ring buffer. Coalesced
+ *        events carry both an operation and the registers.
+ */
+typedef struct {
+    /** @brief `EventKind` bits */
+    std::uint8_t kinds;
+    /** @brief The key of the operation, e.g. `+` */
+    char operation;
+    /** @brief Registers X and Y */
+    double x, y;
+} Event;
+
+/** @brief What `EventChannel::Push` does when the channel is full */
+typedef enum {
+    kOverflowDrop = 0, // discard the new event
+    kOverflowBlock,    // wait until the consumer makes space
+    kOverflowCoalesce  // merge it into a single pending event
+} OverflowPolicy;
+
+/**
+ * @brief Bounded lock-free queue of `Event`s between the threads that
+ *        do the calculations (producers) and one thread that consumes
+ *        the events, e.g. via an `EventPump`. A `Subject` pushes to it
+ *        instead of calling its observers, so a slow observer doesn't
+ *        slow down the calculations.
+ *
+ *        Slots carry sequence numbers (D. Vyukov's bounded queue) so
+ *        pushing and consuming never lock. With one producer, pushing
+ *        is a load and a store; several producers contend with a
+ *        compare-and-swap.
+ *
+ *        When the channel is full, the `OverflowPolicy` decides. With
+ *        coalescing, events that don't fit are merged into a single
+ *        pending event that holds the last operation and the last
+ *        registers. It's delivered once the queue is empty, and the
+ *        producers keep merging into it until then, so one producer's
+ *        events stay in order. Only this slow path takes a spin lock.
+ */
+class EventChannel {
+public:
+    EventChannel() = delete;
+    /**
+     * @param capacity       Number of events that fit; rounded up to
+     *                       a power of 2
+     * @param policy         What to do when the channel is full
+     * @param multi_producer Whether several threads push concurrently
+     */
+    EventChannel(std::size_t capacity,
+                 OverflowPolicy policy = kOverflowDrop,
+                 bool multi_producer = false);
+    ~EventChannel() {}
+    EventChannel(const EventChannel&) = delete;
+    EventChannel& operator=(const EventChannel&) = delete;
+    /**
+     * @brief Queues an event.
+     *
+     * @return False if the event was dropped
+     */
+    bool Push(const Event& event) {
+        if (policy_ == kOverflowCoalesce &&
+            has_pending_.load(std::memory_order_acquire)) {
+            // keep order; the queue must drain before the pending event
+            Coalesce(event);
+            return true;
+        }
+        if (TryPush(event))
+            return true;
+        return PushFull(event);
+    }
+    /**
+     * @brief Hands queued events to `consumer` in the order they were
+     *        pushed. Only one thread may consume at a time.
+     *
+     * @param consumer Callable with a `const Event&` argument
+     * @param max      Maximum number of events to consume
+     *
+     * @return Number of events consumed
+     */
+    template <typename F>
+    std::size_t Consume(F&& consumer,
+                        std::size_t max = std::numeric_limits<std::size_t>::max()) {
+        std::size_t count = 0;
+        Event event;
+        while (count < max && TryPop(event)) {
+            consumer(event);
+            ++count;
+        }
+        if (count < max && policy_ == kOverflowCoalesce &&
+            has_pending_.load(std::memory_order_acquire) && TakePending(event)) {
+            consumer(event);
+            ++count;
+        }
+        return count;
+    }
+    /** @brief Number of events that fit */
+    std::size_t capacity() const { return mask_ + 1; }
+    /** @brief Events discarded (drop) or merged into another (coalesce) */
+    std::size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    typedef struct {
+        std::atomic<std::size_t> sequence;
+        Event event;
+    } Slot;
+
+    bool TryPush(const Event& event) {
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[pos & mask_];
+            const std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (!multi_producer_) {
+                    head_.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+                if (head_.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // the consumer hasn't freed this slot yet
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->event = event;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool TryPop(Event& event) {
+        Slot& slot = slots_[tail_ & mask_];
+        const std::size_t seq = slot.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::ptrdiff_t>(seq - (tail_ + 1)) < 0)
+            return false;
+        event = slot.event;
+        slot.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+        ++tail_;
+        return true;
+    }
+    /** @brief Applies the overflow policy to an event that didn't fit */
+    bool PushFull(const Event& event);
+    /** @brief Merges an event into the pending one */
+    void Coalesce(const Event& event);
+    /** @brief Moves the pending event to `event` */
+    bool TakePending(Event& event);
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_;
+    OverflowPolicy policy_;
+    bool multi_producer_;
+    // next position to push to; shared by the producers
+    alignas(64) std::atomic<std::size_t> head_;
+    // next position to consume; owned by the consumer
+    alignas(64) std::size_t tail_;
+    alignas(64) std::atomic<std::size_t> dropped_;
+    // coalesced event, guarded by `pending_lock_`
+    std::atomic<bool> has_pending_;
+    std::atomic_flag pending_lock_ = ATOMIC_FLAG_INIT;
+    Event pending_;
+};
+
+/**
+ * @brief Consumes an `EventChannel` on its own thread and forwards the
+ *        events to an observer, e.g.
+ *        @verbatim
+ *        backend::EventChannel channel(1024, backend::kOverflowBlock);
+ *        Observer logger;
+ *        backend::EventPump pump(channel, logger);
+ *        backend.AttachChannel(&channel);
+ *        @endverbatim
+ *        The observer is only called from the pump's thread.
+ */
+class EventPump {
+public:
+    EventPump() = delete;
+    EventPump(EventChannel& channel, IObserver& observer);
+    /** @brief Forwards the events still queued, then joins the thread */
+    ~EventPump();
+    EventPump(const EventPump&) = delete;
+    EventPump& operator=(const EventPump&) = delete;
+
+private:
+    void Run();
+    void Forward(const Event& event);
+
+    EventChannel& channel_;
+    IObserver& observer_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+} /* namespace backend */
+
+#endif /* EVENT_CHANNEL_HPP */
@@ -0,0 +1,76 @@
+#ifndef FORMAT_HPP
+#define FORMAT_HPP
+
+#include <cstddef> // size_t
+
+/**
+ * @brief Number formatting for the display and for text output. The
+ *        functions follow the convention of `std::to_chars`, which
+ *        they're built on: they write to the caller's buffer
+ *        [first, last) without allocating or terminating it and
+ *        return a pointer past the last character written, or
+ *        nullptr if the buffer was too small.
+ */
+namespace format {
+
+/**
+ * @brief Enough for any number formatted by `Display`, `GenRegister`,
+ *        `Engineering` and `Shortest` (but not `Fixed` of huge numbers)
+ */
+constexpr std::size_t kBufferSize = 64;
+
+/**
+ * @brief Formats a number in fixed decimal precision format, e.g.
+ *        with precision = 2:
+ *         3.14159 ->  3.14
+ *        -3.1     -> -3.10
+ *        NOTE: trailing zeros are preserved.
+ */
+char* Fixed(char* first, char* last, double num, int precision);
+
+/**
+ * @brief Formats a number as m * 10^E, where 1 <= |m| < 10 has the
+ *        given number of decimals with trailing zeros removed. The
+ *        exponent is that of the correctly rounded mantissa, e.g.
+ *        @verbatim
+ *        -.000123456, 3 -> -1.235 E-4
+ *        123.12345,   2 -> 1.23 E2
+ *        99999,       2 -> 1. E5
+ *        @endverbatim
+ *        Infinities and NaN are written as `inf` and `nan`.
+ */
+char* Engineering(char* first, char* last, double num, int precision);
+
+/** @brief Shortest representation that reads back to the same double */
+char* Shortest(char* first, char* last, double num);
+
+/**
+ * @brief Pads the beginning of [first, end) with spaces, shifting it
+ *        right, so that it's `width` characters long.
+ *
+ * @param end Past the last character of the text to pad
+ *
+ * @return Past the last character of the padded text
+ */
+char* PadLeft(char* first, char* end, char* last, std::size_t width);
+
+/**
+ * @brief Formats a register for the calculator's screen. The format
+ *        (fixed precision/engineering) and number of decimals depend
+ *        on the magnitude and the result is padded to the screen so
+ *        that it overwrites the previous number.
+ *
+ * @param screen_width Calculator's screen width
+ */
+char* Display(char* first, char* last, double num, unsigned screen_width);
+
+/**
+ * @brief Same as `Display` for the narrower general register area.
+ *
+ * @param width Characters available to the register
+ */
+char* GenRegister(char* first, char* last, double num, unsigned width);
+
+} // namespace format
+
+#endif /* FORMAT_HPP */
@@ -5,6 +5,7 @@
 #include <unordered_map> // unordered_map
 #include <string>        // string
 #include <vector>        // vector
+#include <array>         // array
 #include <utility>       // pair
 #include <ncurses.h>     // WINDOW 
 #include <termios.h>     // termios 
@@ -37,8 +38,12 @@ public:
      */
     bool DrawKey(const std::string& key, bool highlight = false);
     /**
-     * @brief Draw a key, then highlight it for the given number of
-     *        milliseconds, then un-highlight it.
+     * @brief Draw a key highlighted and schedule it to be
+     *        un-highlighted after the given number of milliseconds.
+     *        It returns immediately; the highlight is removed by
+     *        `ExpireHighlights`. Several keys can be highlighted at
+     *        the same time and highlighting a key again extends its
+     *        highlight.
      *
      * @param key Same as in DrawKey
      * @param ms  Duration in ms to keep the key highlighted
@@ -47,6 +52,33 @@ public:
      */
     bool HighlightKey(const std::string& key,
                       std::chrono::milliseconds ms = std::chrono::milliseconds(100));
+    /** @brief Un-highlights the keys whose highlight has expired */
+    void ExpireHighlights();
+    /**
+     * @brief How long until the next highlight expires, e.g. to use as
+     *        a timeout when waiting for input.
+     *
+     * @return Milliseconds (rounded up) or -1 if no key is highlighted
+     */
+    int MsToNextExpiry() const;
+    /**
+     * @brief Sends what was drawn since the last frame to the terminal
+     *        with a single update. Drawing only modifies the window in
+     *        memory; nothing is written to the terminal until a frame
+     *        is rendered. Frames are rendered at most once every
+     *        `frame_interval_` so bursts of keypresses are coalesced.
+     *
+     * @param force Render even if the last frame was too recent
+     */
+    void Render(bool force = false);
+    /**
+     * @brief How long to wait for input before something has to be
+     *        updated on screen, i.e. a highlight expires or a pending
+     *        frame is due.
+     *
+     * @return Milliseconds or -1 if there's nothing to update
+     */
+    int MsToNextUpdate() const;
     bool PrintRegisters(double regx, double regy);
     void PrintGenRegister(const std::string& name, double val);
     /**
@@ -89,6 +121,13 @@ private:
     void InitTerminal();
     bool DrawKeypad();
     bool DrawDisplay();
+    /**
+     * @brief Prints a register on a row of the screen unless it's
+     *        already shown there.
+     *
+     * @param shown What's currently shown on that row
+     */
+    void PrintRegister(int row, double val, std::string& shown);
     void DrawBox(const std::string& text, const Point& coords,
                  bool highlight = false);
     /**
@@ -132,6 +171,28 @@ private:
     //------------------------------------------------------
     // ncurses window (on the terminal) where to draw the keypad
     WINDOW* win_;
+    //------------------------------------------------------
+    // highlighted keys
+    //------------------------------------------------------
+    typedef struct {
+        std::string key;
+        std::chrono::steady_clock::time_point expiry;
+    } Highlight;
+    // keys currently highlighted and when to un-highlight them
+    std::vector<Highlight> highlights_;
+    //------------------------------------------------------
+    // frames
+    //------------------------------------------------------
+    // whether the window changed since the last frame
+    bool dirty_;
+    // minimum time between two frames
+    std::chrono::milliseconds frame_interval_;
+    std::chrono::steady_clock::time_point last_frame_;
+    // text on the screen's registers and the general registers; what
+    // doesn't change isn't drawn again
+    std::string shown_regx_;
+    std::string shown_regy_;
+    std::array<std::string, key::kNamesGenRegs.size()> shown_gen_regs_;
     // terminal property settings
     struct termios old_tio_;
     struct termios new_tio_;
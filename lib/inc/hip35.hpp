@@ -1,36 +1,76 @@
 #ifndef HIP35_HPP
 #define HIP35_HPP 
 
-#include "backend.hpp"
+#include "engine.hpp"
 #include "frontend.hpp"
-#include "observer.hpp"
 #include "keypad.hpp"
+#include "tape.hpp"
 #include <memory>        // unique_ptr
 #include <chrono>        // chrono::milliseconds
+#include <cstddef>       // size_t
 #include <string>        // string
-#include <vector>        // vector
-#include <unordered_map> // unordered_map 
 
 namespace Ui {
 
+/**
+ * @brief The calculator with its terminal UI. The UI is only set up
+ *        when `RunUI` is called so evaluating strings doesn't touch
+ *        the terminal; for that alone prefer `backend::Engine`, which
+ *        doesn't depend on ncurses. In the UI, `u` undoes the last key
+ *        and `U` redoes it. The keys the UI receives can be recorded to
+ *        a tape and replayed with `backend::ReplayTape`.
+ */
 class Hip35
 {
 public:
     Hip35() = delete;
     Hip35(const key::Keypad& keypad);
-    ~Hip35() { delete observer_; }
-    double RunUI(bool run_headless = false);
+    ~Hip35() {}
+    /**
+     * @brief Runs the interactive UI until `q` is pressed.
+     *
+     * @return Register X when the UI was closed
+     */
+    double RunUI();
     double EvalString(std::string expression);
     void SetDelay(unsigned ms) { delay_ms_ = std::chrono::milliseconds(ms); }
+    /**
+     * @brief Records the keys `RunUI` receives from now on, with the X
+     *        and Y each leaves, to a tape. The tape starts with the
+     *        current state and the undo history starts over, so that a
+     *        replay presses the keys on the same calculator.
+     *
+     * @param path Path of the tape; throws `std::runtime_error` if it
+     *             can't be created
+     */
+    void Record(const std::string& path);
+    /**
+     * @brief Writes the rest of the tape and closes it. Throws
+     *        `std::runtime_error` if the tape couldn't be written.
+     */
+    void StopRecording();
 
 private:
+    /**
+     * @brief Feeds a keypress to the engine and displays its result.
+     *
+     * @return False if the keypress quits the UI
+     */
+    bool HandleKeypress(unsigned char c);
+    /** @brief `HandleKeypress` that also records the key to the tape */
+    bool RecordKeypress(unsigned char c);
+
+    // memory for the undo history; a few hundred keys
+    static constexpr std::size_t kUndoBytes = 64 << 10;
+
     std::unique_ptr<gui::Frontend> frontend_;
-    std::unique_ptr<backend::Backend> backend_;
-    Observer* observer_;
+    // the calculator the UI drives
+    backend::Engine engine_;
     // how many milliseconds to keep a button highlighted for after being pressed
     std::chrono::milliseconds delay_ms_;
-    std::vector<std::string> tokens_no_ui_;
     const key::Keypad& keypad_;
+    // keys being recorded; none unless `Record` was called
+    std::unique_ptr<backend::TapeWriter> tape_;
 };
 
 } // namespace Ui
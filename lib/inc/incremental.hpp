@@ -0,0 +1,106 @@
+#ifndef INCREMENTAL_HPP
+#define INCREMENTAL_HPP
+
+#include "backend.hpp"
+#include "decoder.hpp"
+#include "keypad.hpp"
+#include <cstddef>     // size_t
+#include <string>      // string
+#include <string_view> // string_view
+#include <vector>      // vector
+
+namespace backend {
+
+/**
+ * @brief Evaluates a long expression that's edited and evaluated
+ *        again, e.g. a program of thousands of keys whose operand
+ *        near the end is tweaked. Each evaluation gives what
+ *        `Engine::EvalString` on a new engine gives, but the state
+ *        (stack, LASTX, general registers and flags) is saved every
+ *        few keys. After an edit, the keys before it aren't pressed
+ *        again; evaluation resumes from the last saved state before
+ *        the first changed key. Example:
+ *        @verbatim
+ *        backend::IncrementalEvaluator evaluator(key::keypad);
+ *        evaluator.Eval(program);             // presses every key
+ *        evaluator.Edit(evaluator.size() - 2, "42");
+ *        evaluator.Eval();                    // presses the last few
+ *        @endverbatim
+ */
+class IncrementalEvaluator {
+public:
+    /** @brief Keys between saved states unless given otherwise */
+    static constexpr std::size_t kCheckpointInterval = 64;
+
+    IncrementalEvaluator() = delete;
+    /**
+     * @param keypad   Keys of the calculator
+     * @param depth    Levels of the stack
+     * @param interval Fewest keys between saved states; evaluation
+     *                 after an edit presses at most this many keys
+     *                 before the edit. The state is only saved where
+     *                 no operand is being typed.
+     */
+    IncrementalEvaluator(const key::Keypad& keypad, std::size_t depth = kStackDepth,
+                         std::size_t interval = kCheckpointInterval);
+    ~IncrementalEvaluator() {}
+    /**
+     * @brief Replaces the expression and evaluates it. It's compared
+     *        key by key with the previous one, so only the keys from
+     *        the first difference on are pressed. Exceptions of the
+     *        keys are propagated as by `Engine::EvalString`.
+     *
+     * @param expression Operands and long or short keys separated by
+     *                   whitespace
+     *
+     * @return Register X after the expression
+     */
+    double Eval(std::string_view expression);
+    /** @brief Evaluates the expression after `Edit`s */
+    double Eval();
+    /**
+     * @brief Replaces a key of the expression without going through
+     *        the rest of it; evaluated by the next `Eval()`.
+     *
+     * @param index Position of the key among the keys
+     * @param key   An operand or a long or short key
+     */
+    void Edit(std::size_t index, std::string_view key);
+    /** @brief Number of keys of the expression */
+    std::size_t size() const { return keys_.size(); }
+    /** @brief Keys the last evaluation pressed */
+    std::size_t pressed() const { return pressed_; }
+
+private:
+    /** @brief The key of an evaluation changed first; keeps the states before it */
+    void Invalidate(std::size_t index);
+    /** @brief Presses a key as `Engine::Press` does */
+    void Press(std::string_view key);
+
+    const key::Keypad& keypad_;
+    Backend backend_;
+    Decoder decoder_;
+    std::size_t interval_;
+    // bytes of a saved state
+    std::size_t state_bytes_;
+    // the expression as short keys
+    std::vector<std::string> keys_;
+    // positions of the keys before which the state was saved,
+    // ascending; the first is the initial state before key 0
+    std::vector<std::size_t> offsets_;
+    // saved states, `state_bytes_` each, in the order of `offsets_`
+    std::vector<unsigned char> states_;
+    // first key changed since the last evaluation finished; `size()`
+    // if none
+    std::size_t changed_;
+    // whether `result_` is the result of the keys
+    bool evaluated_;
+    double result_;
+    std::size_t pressed_;
+    // instructions of a key; kept to reuse its memory
+    std::vector<Instruction> instructions_;
+};
+
+} /* namespace backend */
+
+#endif /* INCREMENTAL_HPP */
@@ -0,0 +1,98 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include "backend.hpp"
+#include <cstddef> // size_t
+#include <vector>  // vector
+
+namespace backend {
+
+/**
+ * @brief Undo/redo history of a backend's states. A checkpoint saves
+ *        the state before a change, e.g. a key, with
+ *        `Backend::SaveState`; undoing restores it and redoing goes
+ *        forward again. The states are kept in a ring buffer that's
+ *        allocated once, so the oldest states are dropped when it's
+ *        full and no operation allocates. Example:
+ *        @verbatim
+ *        backend::Backend backend(key::keypad);
+ *        backend::Journal journal(backend, 64 << 10); // 64 KiB
+ *        journal.Checkpoint();
+ *        try {
+ *            backend.Calculate("/");
+ *        } catch (const std::invalid_argument&) {
+ *            journal.Rollback(); // as if `/` wasn't pressed
+ *        }
+ *        @endverbatim
+ */
+class Journal {
+public:
+    Journal() = delete;
+    /**
+     * @param backend   Backend whose states are saved; it must outlive
+     *                  the journal
+     * @param max_bytes Memory cap of the saved states; at least 2
+     *                  states are kept
+     */
+    Journal(Backend& backend, std::size_t max_bytes);
+    ~Journal() {}
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    /**
+     * @brief Saves the backend's state before it's changed. The states
+     *        that could be redone are discarded.
+     */
+    void Checkpoint();
+    /**
+     * @brief Restores the state of the last checkpoint and forgets it,
+     *        e.g. after a key threw; unlike `Undo` it can't be redone.
+     *
+     * @return False if there's no checkpoint
+     */
+    bool Rollback();
+    /**
+     * @brief Restores the state of the last checkpoint that wasn't
+     *        undone.
+     *
+     * @return False if there's nothing to undo
+     */
+    bool Undo();
+    /**
+     * @brief Restores the state the last `Undo` left.
+     *
+     * @return False if there's nothing to redo
+     */
+    bool Redo();
+    /** @brief Number of states `Undo` can go back to */
+    std::size_t undo_size() const { return cursor_; }
+    /** @brief Number of states `Redo` can go forward to */
+    std::size_t redo_size() const { return (cursor_ < size_) ? size_ - cursor_ - 1 : 0; }
+    /** @brief Forgets all states */
+    void Clear() { first_ = size_ = cursor_ = 0; }
+
+private:
+    /** @brief Bytes of the `i`-th oldest state */
+    unsigned char* State(std::size_t i) {
+        const std::size_t slot = first_ + i;
+        return &states_[((slot < capacity_) ? slot : slot - capacity_) * state_bytes_];
+    }
+    /** @brief Saves the backend's state as the newest, dropping the oldest if full */
+    void Push();
+
+    Backend& backend_;
+    // bytes of a state; the backend's depth doesn't change
+    std::size_t state_bytes_;
+    // states the ring buffer holds
+    std::size_t capacity_;
+    std::vector<unsigned char> states_;
+    // slot of the oldest state
+    std::size_t first_;
+    // states saved
+    std::size_t size_;
+    // the saved state the backend is in, or `size_` if it's not saved
+    std::size_t cursor_;
+};
+
+} /* namespace backend */
+
+#endif /* JOURNAL_HPP */
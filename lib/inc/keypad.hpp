@@ -6,10 +6,12 @@
 #include <memory>        // unique_ptr
 #include <unordered_map> // unordered_map
 #include <string>        // string
+#include <string_view>   // string_view
 #include <functional>    // function
 #include <stdexcept>     // invalid_argument
 #include <cmath>         // invalid_argument
 #include <array>         // array 
+#include <cstddef>       // size_t
 #include <optional>      // optional 
 
 // Forward-declaration of class `Backend` to resolve the
@@ -76,6 +78,16 @@ const std::string kKeyEex   = "E";
  */
 const std::array<std::string, 10> kNamesGenRegs = {"A", "B", "C", "D", "E",
                                                    "F", "G", "H", "I", "J"};
+/**
+ * @brief Index of a general register in `kNamesGenRegs` given its
+ *        name (case insensitive).
+ *
+ * @param name Register name, e.g. "A" or "a"
+ *
+ * @return The index or -1 if there's no such register
+ */
+int GenRegIndex(const std::string& name);
+
 /** @brief Point in the keypad grid with top left as origin (0, 0) */
 typedef struct {
     unsigned x, y;
@@ -150,14 +162,105 @@ struct KeyInfoEex {
 using EexKey = std::unordered_map<std::string, KeyInfoEex>;
 
 
+/** @brief Which of the keypad's maps a key belongs to */
+typedef enum {
+    kCategoryNone = 0,  // not a key of the keypad
+    kCategoryStack,     // stack_keys
+    kCategorySingleArg, // single_arg_keys
+    kCategoryDoubleArg, // double_arg_keys
+    kCategoryStorage,   // storage_keys
+    kCategoryEex        // eex_key
+} KeyCategory;
+
+/**
+ * @brief Everything about a key the backend and frontend need per
+ *        keypress. Only the pointer of the key's category is set and
+ *        it points to the key's entry in the keypad's maps.
+ */
 typedef struct {
+    KeyCategory category;
+    /** @brief Registers a numeric key operates on (1 or 2); 0 if not numeric */
+    unsigned arity;
+    Point point;
+    const std::string* annotation;
+    const StackKeyInfo* stack;
+    const SingleKeyInfo* single_arg;
+    const DoubleKeyInfo* double_arg;
+    const StorageKeyInfo* storage;
+    const KeyInfoEex* eex;
+} KeyEntry;
+
+/**
+ * @brief Flat dispatch table indexed by the (single character) key
+ *        so that a keypress is resolved without hashing strings.
+ *        Entries of bytes that aren't keys have `kCategoryNone`.
+ */
+using KeyTable = std::array<KeyEntry, 256>;
+
+struct Keypad {
+    /**
+     * @brief Copies the maps and compiles the dispatch table of the
+     *        copies. The table points into the keypad's own maps so a
+     *        keypad can't be copied.
+     */
+    Keypad(const StackKeys& stack_keys,
+           const SingleArgKeys& single_arg_keys,
+           const DoubleArgKeys& double_arg_keys,
+           const StorageKeys& storage_keys,
+           const EexKey& eex_key,
+           const std::unordered_map<std::string, std::string>& reverse_keys);
+    Keypad(const Keypad&) = delete;
+    Keypad& operator=(const Keypad&) = delete;
+
     StackKeys stack_keys;
     SingleArgKeys single_arg_keys;
     DoubleArgKeys double_arg_keys;
     StorageKeys storage_keys;
     EexKey eex_key;
     std::unordered_map<std::string, std::string> reverse_keys;
-} Keypad;
+    /** @brief Length of the longest key of `reverse_keys` */
+    std::size_t longest_long_key;
+    /** @brief The keys of the maps above; see `CompileKeyTable` */
+    KeyTable table;
+};
+
+/**
+ * @brief Compiles the maps of a keypad into a dispatch table. The
+ *        entries point to the keypad's maps so the table must not
+ *        outlive them. Keys longer than one character are skipped.
+ *
+ * @param keypad Keypad whose maps to compile; its `table` is ignored
+ *
+ * @return The table of the keypad's maps
+ */
+KeyTable CompileKeyTable(const Keypad& keypad);
+
+/**
+ * @brief Looks a keypress up in the keypad's dispatch table.
+ *
+ * @param keypad   Keypad with a compiled table
+ * @param keypress Any string
+ *
+ * @return The key's entry; its category is `kCategoryNone` if the
+ *         keypress isn't a key of the keypad
+ */
+inline const KeyEntry& LookupKey(const Keypad& keypad, std::string_view keypress) {
+    static const KeyEntry none{kCategoryNone, 0, Point{0, 0},
+                               nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+    if (keypress.size() != 1)
+        return none;
+    return keypad.table[static_cast<unsigned char>(keypress[0])];
+}
+
+/**
+ * @brief Resolves a long key (e.g. `SQRT`) to its short key (`r`).
+ *
+ * @param keypad Keypad whose `reverse_keys` to search
+ * @param token  A long key, a short key or an operand
+ *
+ * @return The short key if `token` is a long key, else `token`
+ */
+std::string_view ShortKey(const Keypad& keypad, std::string_view token);
 
 /**
  * @brief Compiles a description of the input key as long as
@@ -165,17 +268,14 @@ typedef struct {
  *        is `s` and the long key description is SIN, it could
  *        return `SIN (s)` or however we decide to annotate them.
  *
- * @param keypad   A keypad description object. Unordered map
- *                 which describes a number of keys.
+ * @param annot    Annotation of the key in the keypad, e.g. `sin`
  * @param keypress Single-length string.
  *
  * @return         The annotation of `key` given its entry in
  *                 `keypad`. Empty string if not found.
  */
-template <typename T>
-static std::string AnnotateKey(T& it, const std::string keypress) {
+inline std::string AnnotateKey(const std::string& annot, const std::string& keypress) {
     std::string ret = "";
-    const std::string& annot = it->second.annotation;
     if (keypress == annot)
         ret = keypress;
     else
@@ -183,6 +283,12 @@ static std::string AnnotateKey(T& it, const std::string keypress) {
     return ret;
 }
 
+/** @copydoc AnnotateKey */
+template <typename T>
+static std::string AnnotateKey(T& it, const std::string keypress) {
+    return AnnotateKey(it->second.annotation, keypress);
+}
+
 //----------------------------------------------------------------
 // keypad mapping types to be used by frontend and backend 
 //----------------------------------------------------------------
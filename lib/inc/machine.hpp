@@ -0,0 +1,232 @@
+#ifndef MACHINE_HPP
+#define MACHINE_HPP
+
+#include "stack.hpp"
+#include <array>   // array
+#include <cfloat>  // DBL_MIN
+#include <cmath>   // pow, fma, M_PI
+#include <cstddef> // size_t
+#include <utility> // forward
+
+namespace backend {
+
+/**
+ * @brief Various flags set during the calculator's operation.
+ */
+typedef struct Flags {
+    /** @brief Shift up the stack to make space for new entries */
+    bool shift_up;
+    /** @brief EEX key pressed*/
+    bool eex_pressed;
+    /** @brief RCL or STO key pressed*/
+    bool rcl_sto_pressed;
+} Flags;
+
+/** @brief Whether EEX treats a number as zero */
+constexpr bool IsNearZero(double x) {
+    return x < DBL_MIN*100 && x > -DBL_MIN*100;
+}
+
+/**
+ * @brief The values a `Machine` computes with by default: the numbers
+ *        in the registers. A domain tells the machine how to make a
+ *        value from a typed number, apply a key's function to values
+ *        and scale a value by a power of 10 (EEX), so that the same
+ *        keys can also be run on other values, e.g. the registers a
+ *        result depends on.
+ */
+struct Numbers {
+    using Type = double;
+    static constexpr double Constant(double c) { return c; }
+    template <typename F>
+    static constexpr double Single(F&& function, double x) { return function(x); }
+    template <typename F>
+    static constexpr double Double(F&& function, double x, double y) {
+        return function(x, y);
+    }
+    static double Scale(double x, double exponent) { return x * std::pow(10, exponent); }
+    static constexpr bool IsNearZero(double x) { return backend::IsNearZero(x); }
+};
+
+/**
+ * @brief The semantics of the HP35's keys on a stack, LASTX, the
+ *        general registers and the flags; the one place they're
+ *        written down. `Backend` runs its keys on one (and adds the
+ *        observers and the metrics), `Program::Run(Stack&)` runs a
+ *        program on one over the caller's stack and `StaticProgram`
+ *        runs one in constant expressions. See `Backend`'s methods of
+ *        the same names for what each key does.
+ *
+ * @tparam S A stack with the interface of `Stack` (`ShiftUp`,
+ *           `ShiftDown`, `RollDown`, `Clear`, `writeX` and indexing
+ *           from X), or a reference to one to run on a stack owned
+ *           elsewhere
+ * @tparam D The domain of the values; see `Numbers`
+ */
+template <typename S, typename D = Numbers>
+class Machine {
+public:
+    using T = typename D::Type;
+
+    /**
+     * @brief A machine as the calculator is switched on, except for
+     *        the stack, which is kept as it's given.
+     */
+    constexpr explicit Machine(S stack_levels):
+        stack(std::forward<S>(stack_levels)),
+        lastx(D::Constant(0.0)),
+        regs(),
+        flags{true, false, false} {
+        for (auto& reg: regs)
+            reg = D::Constant(0.0);
+    }
+
+    /**
+     * @brief Zeroes the stack and brings the rest to the state the
+     *        constructor gives it.
+     */
+    void Reset() {
+        stack.Clear();
+        lastx = D::Constant(0.0);
+        for (auto& reg: regs)
+            reg = D::Constant(0.0);
+        flags = {true, false, false};
+    }
+    constexpr void Insert(double num) {
+        if (flags.eex_pressed) {
+            // the number is the exponent of X
+            stack[IDX_REG_X] = D::Scale(stack[IDX_REG_X], num);
+        } else if (flags.shift_up) { // number was entered
+            stack.ShiftUp();
+            stack.writeX(D::Constant(num));
+        } else { // Enter was pressed so write in current reg. X
+            stack.writeX(D::Constant(num));
+        }
+        flags.shift_up = true;
+        flags.eex_pressed = false;
+    }
+    constexpr void Enter() {
+        stack.ShiftUp();
+        stack[IDX_REG_X] = stack[IDX_REG_Y];
+        flags.eex_pressed = false;
+        flags.shift_up = false;
+    }
+    constexpr void Rdn() {
+        stack.RollDown();
+        flags.eex_pressed = false;
+    }
+    constexpr void SwapXY() {
+        const T x = stack[IDX_REG_X];
+        stack[IDX_REG_X] = stack[IDX_REG_Y];
+        stack[IDX_REG_Y] = x;
+        flags.eex_pressed = false;
+    }
+    constexpr void LastX() {
+        // Make space to insert register LASTX
+        stack.ShiftUp();
+        stack[IDX_REG_X] = lastx;
+        flags.eex_pressed = false;
+    }
+    constexpr void Clx() {
+        stack.writeX(D::Constant(0.0));
+        flags.shift_up = false;
+    }
+    constexpr void Clr() {
+        // what zeroing X and pressing ENTER 3 times does on a 4-level stack
+        stack.Clear();
+        flags.eex_pressed = false;
+        flags.shift_up = false;
+    }
+    constexpr void Pi() {
+        flags.eex_pressed = false;
+        Insert(M_PI);
+    }
+    /** @param exponent The number typed before EEX, 0 if none */
+    constexpr void Eex(double exponent) {
+        if (IsNearZero(exponent) && D::IsNearZero(stack[IDX_REG_X])) // prepare register X
+            stack.writeX(D::Constant(1.0));
+        else if (flags.eex_pressed) // multiply consecutively
+            stack[IDX_REG_X] = D::Scale(stack[IDX_REG_X], exponent);
+        else if (IsNearZero(exponent))
+            ; // X stays
+        else
+            stack.writeX(D::Constant(exponent));
+        flags.shift_up = false;
+        flags.eex_pressed = true;
+    }
+    /** @param reg Index of the general register in `key::kNamesGenRegs` */
+    constexpr void Sto(std::size_t reg) {
+        regs[reg] = stack[IDX_REG_X];
+        flags.shift_up = true;
+        flags.eex_pressed = false;
+    }
+    /** @param reg Index of the general register in `key::kNamesGenRegs` */
+    constexpr void Rcl(std::size_t reg) {
+        // RCL operation stores X in LASTX:
+        // http://h10032.www1.hp.com/ctg/Manual/c01579350 p306
+        lastx = stack[IDX_REG_X];
+        stack[IDX_REG_X] = regs[reg];
+        flags.shift_up = true;
+        flags.eex_pressed = false;
+    }
+    template <typename F>
+    constexpr void CalculateSingleArg(F&& function) {
+        flags.shift_up = true;
+        auto& registerX = stack[IDX_REG_X];
+        // We did an operation so calculator needs to store register X
+        // before the operation in register LASTX
+        lastx = registerX;
+        registerX = D::Single(function, registerX);
+    }
+    template <typename F>
+    constexpr void CalculateDoubleArg(F&& function) {
+        flags.shift_up = true;
+        auto& registerX = stack[IDX_REG_X];
+        auto& registerY = stack[IDX_REG_Y];
+        lastx = registerX;
+        registerY = D::Double(function, registerX, registerY);
+        // drop old register X
+        stack.ShiftDown();
+    }
+    /** @brief See `Backend::InsertConstant` */
+    void InsertConstant(double num, double lastx_after, unsigned lifts) {
+        // the stack moves as it did for the folded keys
+        if (flags.shift_up)
+            stack.ShiftUp();
+        for (unsigned i = 0; i < lifts; ++i)
+            stack.ShiftUp();
+        for (unsigned i = 0; i < lifts; ++i)
+            stack.ShiftDown();
+        stack.writeX(D::Constant(num));
+        lastx = D::Constant(lastx_after);
+        flags.shift_up = true;
+        flags.eex_pressed = false;
+    }
+    /** @brief See `Backend::MultiplyAdd` */
+    void MultiplyAdd(bool subtract) {
+        flags.shift_up = true;
+        const double x = stack[IDX_REG_X];
+        const double y = stack[IDX_REG_Y];
+        double& z = stack[IDX_REG_Z];
+        // X of `*`, which `+` saves
+        lastx = x * y;
+        z = std::fma(subtract ? -x : x, y, z);
+        stack.ShiftDown();
+        stack.ShiftDown();
+    }
+
+    S stack;
+    // LASTX register; stores the value of X before a function is invoked
+    T lastx;
+    /**
+     * @brief General purpose storage registers (indexed 0 to 9) to
+     *        store constants or intermediate results.
+     */
+    std::array<T, 10> regs;
+    // internal flags that store info about the calc's state (e.g. shift up stack)
+    Flags flags;
+};
+
+} /* namespace backend */
+
+#endif /* MACHINE_HPP */
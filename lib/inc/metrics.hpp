@@ -0,0 +1,155 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "keypad.hpp"
+#include <array>     // array
+#include <chrono>    // steady_clock
+#include <cstddef>   // size_t
+#include <cstdint>   // uint64_t
+#include <exception> // uncaught_exceptions
+#include <string>    // string
+
+/**
+ * @brief Opt-in instrumentation of the calculator. Each operation of
+ *        `backend::Backend` and `backend::Engine::EvalString` counts
+ *        its calls, the calls that threw and their latencies in a
+ *        histogram with power-of-2 buckets. Every thread records to
+ *        its own counters, padded to cache lines so that threads
+ *        don't share any, and a `Snapshot` merges them on read.
+ *
+ *        It's compiled in with the `HIP35_METRICS` CMake option
+ *        (`-DHIP35_METRICS=ON`); otherwise `Scope` is empty and the
+ *        compiler removes it, and snapshots are all zeros. Example:
+ *        @verbatim
+ *        engine.EvalString("2 ENTER 3 +");
+ *        std::cout << metrics::TakeSnapshot().ToText(key::keypad);
+ *        @endverbatim
+ */
+namespace metrics {
+
+#ifdef HIP35_METRICS
+constexpr bool kEnabled = true;
+#else
+constexpr bool kEnabled = false;
+#endif
+
+/**
+ * @brief Operations are counted in slots. A key's slot is its byte,
+ *        e.g. `+`, which is also the slot of the `Backend` method
+ *        that implements it, e.g. `Enter` for ` `. Operations that
+ *        aren't keys have their own slots.
+ */
+constexpr std::size_t kSlotUnknown = 0;     // e.g. Calculate("foo")
+constexpr std::size_t kSlotInsert = 256;    // Backend::Insert
+constexpr std::size_t kSlotEvalString = 257; // Engine::EvalString
+constexpr std::size_t kSlots = 258;
+
+/** @return The slot of a key, e.g. `+`, or `kSlotUnknown` */
+inline std::size_t KeySlot(const std::string& key) {
+    return key.size() == 1 ? static_cast<unsigned char>(key[0]) : kSlotUnknown;
+}
+
+/**
+ * @brief Bucket `i` of a histogram counts latencies of less than 2^i
+ *        ns (and at least 2^(i-1)); the last one counts all longer
+ *        ones (over 9 minutes).
+ */
+constexpr std::size_t kBuckets = 40;
+
+typedef struct {
+    std::uint64_t calls;
+    // calls that exited with an exception
+    std::uint64_t exceptions;
+    std::array<std::uint64_t, kBuckets> latency;
+} OperationStats;
+
+/** @brief Counters of all threads, merged */
+class Snapshot {
+public:
+    Snapshot(): ops{} {}
+    ~Snapshot() {}
+    /**
+     * @brief Estimates a percentile of an operation's latency from its
+     *        histogram.
+     *
+     * @param slot Slot of the operation
+     * @param p    Percentile, e.g. 99
+     *
+     * @return The upper bound in ns of the bucket that holds the
+     *         percentile or 0 if the operation wasn't called
+     */
+    double Percentile(std::size_t slot, double p) const;
+    /**
+     * @brief One line per called operation with its calls, exceptions
+     *        and p50/p90/p99 latencies.
+     *
+     * @param keypad Keypad to name the keys' slots, e.g. `+` -> `+`,
+     *               `s` -> `SIN`
+     */
+    std::string ToText(const key::Keypad& keypad) const;
+    /**
+     * @brief Same as `ToText` as a JSON object, including the
+     *        histograms up to the last non-empty bucket.
+     */
+    std::string ToJson(const key::Keypad& keypad) const;
+
+    std::array<OperationStats, kSlots> ops;
+};
+
+/** @brief Merges the counters of all threads, including finished ones */
+Snapshot TakeSnapshot();
+/**
+ * @brief Zeroes the counters of all threads. Calls in progress while
+ *        resetting may be counted or not.
+ */
+void Reset();
+/** @brief Adds a call to the calling thread's counters */
+void Record(std::size_t slot, std::uint64_t ns, bool threw);
+
+#ifdef HIP35_METRICS
+/**
+ * @brief Records the operation of a slot when it goes out of scope,
+ *        and whether it's leaving because of an exception. Backend
+ *        operations that call others, e.g. `Calculate` calls
+ *        `CalculateSingleArg`, are only recorded as themselves;
+ *        `EvalString` is recorded in addition to the operations it
+ *        calls.
+ */
+class Scope {
+public:
+    explicit Scope(std::size_t slot):
+        slot_(slot),
+        // backend operations called by a backend operation are part of it
+        nested_(slot != kSlotEvalString && depth_++ > 0),
+        exceptions_(std::uncaught_exceptions()),
+        start_(std::chrono::steady_clock::now()) {}
+    ~Scope() {
+        if (slot_ != kSlotEvalString)
+            --depth_;
+        if (nested_)
+            return;
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        Record(slot_, static_cast<std::uint64_t>(ns),
+               std::uncaught_exceptions() > exceptions_);
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    static inline thread_local unsigned depth_ = 0;
+    std::size_t slot_;
+    bool nested_;
+    int exceptions_;
+    std::chrono::steady_clock::time_point start_;
+};
+#else
+class Scope {
+public:
+    explicit Scope(std::size_t) {}
+};
+#endif
+
+} // namespace metrics
+
+#endif /* METRICS_HPP */
@@ -0,0 +1,109 @@
+#ifndef NUMBER_LEXER_HPP
+#define NUMBER_LEXER_HPP
+
+#include <string>      // string
+#include <string_view> // string_view
+
+namespace backend {
+
+/**
+ * @brief Accumulates the characters of an operand as they're typed
+ *        and keeps track of where in the number they are, so that
+ *        checking whether a keypress continues the operand doesn't
+ *        need to parse it. It accepts decimal numbers in the form
+ *        @verbatim
+ *        [+|-] digits [. [digits]] [(e|E) [+|-] digits]
+ *        [+|-] . digits [(e|E) [+|-] digits]
+ *        @endverbatim
+ *        and only ever holds a complete number (or nothing). E.g.
+ *        after `1`, `e` is rejected since `1e` is incomplete,
+ *        whereas `e5` is accepted. The number is converted to a
+ *        double once, when it's needed, without exceptions.
+ */
+class NumberLexer {
+public:
+    NumberLexer(): text_(""), state_(kStateStart) {}
+    ~NumberLexer() {}
+    /**
+     * @brief Appends characters to the operand if the result is a
+     *        complete number; else the operand is left unchanged.
+     *
+     * @param chars One keypress, e.g. `7`, or a whole token, e.g. `1.5e3`
+     *
+     * @return Whether the characters were appended
+     */
+    bool Append(std::string_view chars);
+    /** @brief Discards the operand */
+    void Clear() { text_.clear(); state_ = kStateStart; }
+    /** @brief Whether nothing has been typed */
+    bool empty() const { return text_.empty(); }
+    /** @brief The characters typed so far */
+    const std::string& text() const { return text_; }
+    /**
+     * @brief Converts the operand to a double.
+     *
+     * @return The operand's value; 0 if empty, +/-inf or +/-0 if out
+     *         of the range of doubles
+     */
+    double Value() const;
+
+    /** @brief Position in the number after the last character */
+    typedef enum {
+        kStateStart = 0,   // nothing yet
+        kStateSign,        // sign of the number
+        kStateInt,         // digits before the decimal point (complete)
+        kStatePoint,       // decimal point without preceding digits
+        kStateFrac,        // decimal point or digits after it (complete)
+        kStateExp,         // e or E
+        kStateExpSign,     // sign of the exponent
+        kStateExpDigits    // digits of the exponent (complete)
+    } State;
+
+    /** @return The state after `c` or `kStateStart` if `c` can't follow */
+    static constexpr State Next(State state, char c) {
+        const bool digit = (c >= '0' && c <= '9');
+        const bool sign = (c == '+' || c == '-');
+        const bool exp = (c == 'e' || c == 'E');
+        switch (state) {
+            case kStateStart:
+                if (sign) return kStateSign;
+                [[fallthrough]];
+            case kStateSign:
+                if (digit) return kStateInt;
+                if (c == '.') return kStatePoint;
+                break;
+            case kStateInt:
+                if (digit) return kStateInt;
+                if (c == '.') return kStateFrac;
+                if (exp) return kStateExp;
+                break;
+            case kStatePoint:
+                if (digit) return kStateFrac;
+                break;
+            case kStateFrac:
+                if (digit) return kStateFrac;
+                if (exp) return kStateExp;
+                break;
+            case kStateExp:
+                if (sign) return kStateExpSign;
+                [[fallthrough]];
+            case kStateExpSign:
+            case kStateExpDigits:
+                if (digit) return kStateExpDigits;
+                break;
+        }
+        return kStateStart;
+    }
+    /** @return Whether the characters so far are a number */
+    static constexpr bool IsComplete(State state) {
+        return state == kStateInt || state == kStateFrac || state == kStateExpDigits;
+    }
+
+private:
+    std::string text_;
+    State state_;
+};
+
+} /* namespace backend */
+
+#endif /* NUMBER_LEXER_HPP */
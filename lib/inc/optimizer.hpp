@@ -0,0 +1,68 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "program.hpp"
+#include "stack.hpp"
+#include <cstddef> // size_t
+
+namespace backend {
+
+/** @brief Passes `Optimize` runs */
+typedef struct {
+    /**
+     * @brief Replace keys that only compute with numbers they insert,
+     *        e.g. `2 ENTER 3 + SQRT`, by their result (`kOpConstant`)
+     */
+    bool fold_constants;
+    /**
+     * @brief Remove keys whose effect is undone or overwritten, e.g.
+     *        `SWAP SWAP`, `CHS CHS`, a SWAP after ENTER or stack keys
+     *        before CLR
+     */
+    bool remove_noops;
+    /**
+     * @brief Replace `*` followed by `+` or `-` by `kOpMultiplyAdd`,
+     *        which rounds once, so results may differ in the last
+     *        bit from the unoptimized program
+     */
+    bool fuse_multiply_add;
+} OptimizeOptions;
+
+/** @brief The passes that keep the results bit for bit */
+constexpr OptimizeOptions kOptimizeExact = {true, true, false};
+/** @brief All passes */
+constexpr OptimizeOptions kOptimizeAll = {true, true, true};
+
+/**
+ * @brief Rewrites a program into a shorter one that leaves the same
+ *        X, Y, Z, T, LASTX, general registers and flags, on a
+ *        `Backend`, a `Stack` or a `Batch`. Keys whose outcome
+ *        depends on the flags are only rewritten when the flags are
+ *        known at that point; the program is assumed to start with
+ *        no EEX pending, i.e. not with the exponent of a number typed
+ *        before it. Keys that
+ *        would throw (e.g. `1 ENTER 0 /`) are kept so they still
+ *        throw when the program runs. Observers are notified of the
+ *        remaining keys only. Example:
+ *        @verbatim
+ *        backend::Program program("2 ENTER 3 + * 1 CHS CHS +", key::keypad);
+ *        // 5 *, then 1 +: 4 instructions instead of 9
+ *        auto optimized = backend::Optimize(program);
+ *        @endverbatim
+ *
+ * @param program Program compiled against any keypad; `*`, `+`, `-`
+ *                and CHS are recognized if they are `key::keypad`'s
+ * @param options Passes to run
+ * @param depth   Fewest levels of the stacks it will run on; folds
+ *                that would fill such a stack with constants are
+ *                skipped since they'd replicate a constant into T
+ *
+ * @return The optimized program
+ */
+Program Optimize(const Program& program,
+                 const OptimizeOptions& options = kOptimizeExact,
+                 std::size_t depth = kStackDepth);
+
+} /* namespace backend */
+
+#endif /* OPTIMIZER_HPP */
@@ -0,0 +1,66 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include "backend.hpp"
+#include "keypad.hpp"
+#include "result_cache.hpp"
+#include "thread_pool.hpp"
+#include <memory> // unique_ptr
+#include <string> // string
+#include <vector> // vector
+
+namespace backend {
+
+/** @brief Outcome of evaluating one expression */
+typedef struct {
+    /** @brief Register X after the expression; NaN if it failed */
+    double value;
+    /** @brief Whether the expression was evaluated without errors */
+    bool ok;
+    /** @brief What went wrong, e.g. division by zero; empty if ok */
+    std::string error;
+} EvalResult;
+
+/**
+ * @brief Evaluates many unrelated expressions in parallel. Each
+ *        worker of a work-stealing `ThreadPool` owns a `Backend` and
+ *        every expression starts from a reset backend, so results
+ *        don't depend on the order or the thread they're evaluated
+ *        in. Errors (e.g. the keypad's division by zero) are
+ *        reported per expression and don't affect the rest.
+ *
+ *        With a `ResultCache`, results are stored and returned for
+ *        the same expression later; evaluators with the same keypad
+ *        can share a cache.
+ */
+class ParallelEvaluator {
+public:
+    ParallelEvaluator() = delete;
+    /**
+     * @param keypad  Keypad to compile the expressions against
+     * @param threads Number of workers; 0 means one per hardware
+     *                thread
+     * @param cache   Cache of results to use, or nullptr for none;
+     *                it must outlive the evaluator
+     */
+    ParallelEvaluator(const key::Keypad& keypad, unsigned threads = 0,
+                      ResultCache* cache = nullptr);
+    ~ParallelEvaluator() {}
+    /**
+     * @brief Evaluates the expressions (`EvalString` syntax).
+     *
+     * @return One result per expression, in the same order
+     */
+    std::vector<EvalResult> Eval(const std::vector<std::string>& expressions);
+
+private:
+    const key::Keypad& keypad_;
+    ResultCache* cache_;
+    ThreadPool pool_;
+    // one backend per worker of the pool
+    std::vector<std::unique_ptr<Backend>> backends_;
+};
+
+} /* namespace backend */
+
+#endif /* PARALLEL_HPP */
@@ -0,0 +1,75 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include "backend.hpp"
+#include "decoder.hpp"
+#include "keypad.hpp"
+#include "stack.hpp"
+#include <string>  // string
+#include <utility> // move
+#include <vector>  // vector
+
+namespace backend {
+
+/**
+ * @brief An RPN expression compiled to backend instructions. The
+ *        expression uses the same syntax as `Hip35::EvalString`,
+ *        i.e. space-separated operands and long (e.g. `SQRT`) or
+ *        short (e.g. `r`) keys. It's split and decoded once when
+ *        the program is constructed; operations are resolved to
+ *        the keypad's functions and operands are parsed to doubles
+ *        so running it does no lookups or parsing. Example:
+ *        @verbatim
+ *        backend::Program program("ENTER * 2 /", key::keypad);
+ *        backend::Backend backend(key::keypad);
+ *        for (double x: inputs) {
+ *            backend.Insert(x);
+ *            results.push_back(program.Run(backend));
+ *        }
+ *        @endverbatim
+ */
+class Program {
+public:
+    Program() = delete;
+    /**
+     * @param expression Space-separated keys and operands
+     * @param keypad     Keypad to resolve the keys against; it must
+     *                   outlive the program.
+     */
+    Program(const std::string& expression, const key::Keypad& keypad);
+    /** @brief A program of already decoded instructions, e.g. by `Optimize` */
+    explicit Program(std::vector<Instruction> instructions):
+        instructions_(std::move(instructions)) {}
+    ~Program() {}
+    /**
+     * @brief Executes the program on a backend. Its observers are
+     *        notified as if the keys were pressed. Exceptions thrown
+     *        by the keypad's functions (e.g. division by zero) are
+     *        propagated.
+     *
+     * @param backend Backend whose state the program starts from
+     *
+     * @return Register X after the last instruction
+     */
+    double Run(Backend& backend) const;
+    /**
+     * @brief Executes the program on a bare stack. It behaves like
+     *        `Run(Backend&)` on a backend whose stack is `stack` and
+     *        whose LASTX, general registers and flags are freshly
+     *        initialized.
+     *
+     * @param stack Stack the program reads and writes
+     *
+     * @return Register X after the last instruction
+     */
+    double Run(Stack& stack) const;
+    /** @brief The compiled instructions in execution order */
+    const std::vector<Instruction>& instructions() const { return instructions_; }
+
+private:
+    std::vector<Instruction> instructions_;
+};
+
+} /* namespace backend */
+
+#endif /* PROGRAM_HPP */
@@ -0,0 +1,127 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include "keypad.hpp"
+#include <cstddef>       // size_t
+#include <cstdint>       // uint64_t
+#include <list>          // list
+#include <memory>        // unique_ptr
+#include <mutex>         // mutex
+#include <string>        // string
+#include <string_view>   // string_view
+#include <unordered_map> // unordered_map
+#include <vector>        // vector
+
+namespace backend {
+
+/** @brief Counters of a `ResultCache`, summed over its shards */
+typedef struct {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t insertions;
+    /** @brief Entries dropped to stay under the memory cap */
+    std::uint64_t evictions;
+    std::size_t entries;
+    /** @brief Estimated memory of the entries */
+    std::size_t bytes;
+} CacheStats;
+
+/**
+ * @brief Results of expressions keyed by their normalized keys (see
+ *        `Key`), so that an expression that's evaluated again returns
+ *        its result without executing it. The results must be those
+ *        of evaluations from a reset backend, as `ParallelEvaluator`
+ *        does; then a result is valid for any backend of the same
+ *        keypad and stack depth.
+ *
+ *        The entries are split in shards by the hash of their key.
+ *        Each shard is guarded by its own mutex and evicts its least
+ *        recently used entries when it exceeds its share of the
+ *        memory cap, so threads evaluating different expressions
+ *        rarely wait for each other. Example:
+ *        @verbatim
+ *        backend::ResultCache cache(1 << 20); // 1 MiB
+ *        backend::ParallelEvaluator evaluator(key::keypad, 4, &cache);
+ *        evaluator.Eval(expressions); // evaluates them
+ *        evaluator.Eval(expressions); // looks them up
+ *        @endverbatim
+ */
+class ResultCache {
+public:
+    /** @brief Estimated memory of an entry besides its key's characters */
+    static constexpr std::size_t kEntryOverhead = 128;
+
+    ResultCache() = delete;
+    /**
+     * @param max_bytes Memory cap of the entries, estimated as their
+     *                  keys' length plus `kEntryOverhead` each
+     * @param shards    Number of independently locked parts
+     */
+    explicit ResultCache(std::size_t max_bytes, unsigned shards = 16);
+    ~ResultCache() {}
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+    /**
+     * @brief The normalized form of an expression: its tokens
+     *        separated by single spaces, with long keys replaced by
+     *        short ones, e.g. `30  SIN` -> `30 s`.
+     *
+     * @param keypad     Keypad to resolve long keys against
+     * @param expression Expression in `EvalString` syntax
+     * @param key        Written with the normalized expression
+     */
+    static void Key(const key::Keypad& keypad, std::string_view expression,
+                    std::string& key);
+    /**
+     * @brief Looks up a result and marks it as recently used.
+     *
+     * @param key   Normalized expression (see `Key`)
+     * @param value Written with the result if it's found
+     *
+     * @return Whether the result was found
+     */
+    bool Lookup(std::string_view key, double& value);
+    /**
+     * @brief Stores a result, evicting the least recently used results
+     *        of the shard if needed. Results larger than a shard's
+     *        share of the cap aren't stored.
+     */
+    void Insert(std::string_view key, double value);
+    /** @brief Counters and occupancy of all shards */
+    CacheStats Stats() const;
+    /** @brief Drops all entries; counters are kept */
+    void Clear();
+
+private:
+    typedef struct {
+        std::string key;
+        double value;
+    } Entry;
+
+    /**
+     * @brief Part of the cache with its own lock. The most recently
+     *        used entry is at the front of the list; the index's keys
+     *        view the entries' keys, which list nodes don't move.
+     */
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        std::size_t bytes = 0;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t insertions = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    Shard& ShardOf(std::string_view key);
+    static std::size_t Bytes(std::string_view key) { return key.size() + kEntryOverhead; }
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // memory cap of each shard
+    std::size_t shard_bytes_;
+};
+
+} /* namespace backend */
+
+#endif /* RESULT_CACHE_HPP */
@@ -0,0 +1,74 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include "backend.hpp"
+#include "engine.hpp"
+#include <cstddef>     // size_t
+#include <memory>      // unique_ptr
+#include <string_view> // string_view
+#include <vector>      // vector
+
+namespace backend {
+
+/** @brief The state of a new calculator, as after `Backend::Reset` */
+constexpr Session kNewSession = {{}, 0.0, {true, false, false}, {}};
+
+/**
+ * @brief Evaluates an expression on a session: the session is loaded
+ *        into the engine's backend, the expression is evaluated as by
+ *        `Engine::EvalString` and the state is saved back, also if the
+ *        expression throws. One engine can thus serve any number of
+ *        sessions, each continuing where it left off. The engine's
+ *        undo history (if enabled) would mix the sessions.
+ *
+ * @return Register X after the evaluation
+ */
+double EvalSession(Engine& engine, Session& session, std::string_view expression);
+
+/**
+ * @brief Allocates sessions from slabs of 64 KiB, so that hosting
+ *        many calculators costs 128 bytes each and no allocation once
+ *        the pool has grown. Released sessions are reused before a new
+ *        slab is allocated; slabs are freed with the pool. Not thread
+ *        safe; e.g. one pool per event loop. Example:
+ *        @verbatim
+ *        backend::SessionPool pool;
+ *        backend::Engine engine(key::keypad);
+ *        backend::Session* session = pool.Acquire();
+ *        backend::EvalSession(engine, *session, "3 STO A");
+ *        backend::EvalSession(engine, *session, "RCL A ENTER *"); // 9
+ *        pool.Release(session);
+ *        @endverbatim
+ */
+class SessionPool {
+public:
+    /** @brief Bytes of a slab */
+    static constexpr std::size_t kSlabBytes = 64 << 10;
+
+    SessionPool();
+    ~SessionPool() {}
+    SessionPool(const SessionPool&) = delete;
+    SessionPool& operator=(const SessionPool&) = delete;
+    /** @brief A session in the state of a new calculator */
+    Session* Acquire();
+    /** @brief Returns a session acquired from this pool */
+    void Release(Session* session);
+    /** @brief Number of sessions acquired and not released */
+    std::size_t size() const { return size_; }
+    /** @brief Bytes allocated by the pool */
+    std::size_t bytes() const {
+        return slabs_.size() * kSlabBytes + free_.capacity() * sizeof(Session*);
+    }
+
+private:
+    static constexpr std::size_t kSlabSessions = kSlabBytes / sizeof(Session);
+
+    std::vector<std::unique_ptr<Session[]>> slabs_;
+    // released or never acquired sessions; the next one is at the back
+    std::vector<Session*> free_;
+    std::size_t size_;
+};
+
+} /* namespace backend */
+
+#endif /* SESSION_HPP */
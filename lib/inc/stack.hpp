@@ -1,7 +1,9 @@
 #ifndef STACK_HPP
 #define STACK_HPP 
 
-#include <array>
+#include <cstddef> // size_t
+#include <cstring> // memcpy
+#include <vector>  // vector
 
 namespace backend {
 
@@ -15,6 +17,9 @@ enum {
     IDX_REG_T,
 };
 
+/** @brief Depth of HP35's stack: X, Y, Z, T */
+constexpr std::size_t kStackDepth = 4;
+
 /**
  * Forward declaration; it will be a friend i.e. able to access
  * private/protected members of the stack.
@@ -34,9 +39,17 @@ class Backend;
  *        following intrinsic operations:
  *        -- ShiftUp
  *        -- ShiftDown
+ *        -- RollDown
  *        -- Clear
  *        -- WriteX
  *
+ *        The depth defaults to HP35's 4 levels. A deeper stack, e.g.
+ *        for generated programs that keep many operands, behaves the
+ *        same way with more levels above T; register `i` is the
+ *        `i`-th level from X. The levels are kept in a ring buffer
+ *        that starts at X so shifting and rolling move its start and
+ *        cost O(1) at any depth.
+ *
  *        References:
  *        -----------
  *        [1] "Enter: Reverse Polish Notation Made Easy" by J. Dodin
@@ -44,7 +57,12 @@ class Backend;
  */
 class Stack {
     public:
-        Stack() { Clear(); }
+        /**
+         * @param depth Number of levels; at least 2 (X and Y)
+         */
+        explicit Stack(std::size_t depth = kStackDepth):
+            stack_(depth < 2 ? 2 : depth),
+            bottom_(0) {}
         ~Stack() {}
 
         /**
@@ -58,7 +76,11 @@ class Stack {
          *        Y->   2          1    |    y -----+  +----> Y
          *        X->   1               |    x --------+      X = 0
          */
-        void ShiftUp();
+        void ShiftUp() {
+            // the old top becomes the new X
+            bottom_ = (bottom_ == 0) ? stack_.size() - 1 : bottom_ - 1;
+            stack_[bottom_] = 0.0;
+        }
         /**
          * @brief  Shifts down ("drops" stack) all elements of the
          *         stack by one, discarding the value of X. The new
@@ -77,17 +99,54 @@ class Stack {
          *              p.53,
          *              http://h10032.www1.hp.com/ctg/Manual/c01579350
          */
-        void ShiftDown();
-        void Clear() { stack_ = { 0., 0., 0., 0. }; }
-        double writeX(double x) { stack_[IDX_REG_X] = x; return stack_[IDX_REG_X]; }
-        /* index getter operator */
-        double operator[] (double i) const { return stack_[i]; }
-        /* index setter operator */
-        double& operator[] (double i) { return stack_[i]; }
+        void ShiftDown() {
+            // replicate old top - see reference above
+            const double old_top = stack_[Index(stack_.size() - 1)];
+            RollDown();
+            stack_[Index(stack_.size() - 1)] = old_top;
+        }
+        /**
+         * @brief  Rotates the stack down by one; X goes to the top.
+         *             before:     after:
+         *          T->   4          1
+         *          Z->   3          4
+         *          Y->   2          3
+         *          X->   1          2
+         */
+        void RollDown() { bottom_ = Index(1); }
+        void Clear();
+        /**
+         * @brief Copies the levels from X up to `size()` doubles,
+         *        which needn't be aligned
+         */
+        void Save(void* levels) const {
+            const std::size_t above = (stack_.size() - bottom_) * sizeof(double);
+            std::memcpy(levels, &stack_[bottom_], above);
+            std::memcpy(static_cast<char*>(levels) + above, stack_.data(),
+                        bottom_ * sizeof(double));
+        }
+        /** @brief Sets the levels from X up from `size()` doubles */
+        void Load(const void* levels) {
+            std::memcpy(stack_.data(), levels, stack_.size() * sizeof(double));
+            bottom_ = 0;
+        }
+        double writeX(double x) { stack_[bottom_] = x; return x; }
+        /* index getter operator; 0 is X, no bounds checking */
+        double operator[] (std::size_t i) const { return stack_[Index(i)]; }
+        /* index setter operator; 0 is X, no bounds checking */
+        double& operator[] (std::size_t i) { return stack_[Index(i)]; }
         unsigned size() const { return stack_.size(); }
 
     protected:
-        std::array<double, 4> stack_;
+        /** @brief Position of register `i` (0 is X) in the ring buffer */
+        std::size_t Index(std::size_t i) const {
+            const std::size_t index = bottom_ + i;
+            return (index >= stack_.size()) ? index - stack_.size() : index;
+        }
+        // ring buffer of the levels
+        std::vector<double> stack_;
+        // position of register X in the ring buffer
+        std::size_t bottom_;
     private:
         // Backend can access its protected and private members
         friend class Backend;
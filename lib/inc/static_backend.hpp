@@ -0,0 +1,102 @@
+#ifndef STATIC_BACKEND_HPP
+#define STATIC_BACKEND_HPP
+
+#include "backend.hpp"
+#include "metrics.hpp"
+#include "static_keypad.hpp"
+#include <cstddef> // size_t
+#include <string>  // string
+#include <utility> // index_sequence, make_index_sequence
+
+namespace backend {
+
+/**
+ * @brief A `Backend` whose keys are known at compile time. It
+ *        calculates with the functions of a `key::StaticKeypad`
+ *        instead of the `std::function`s of a runtime keypad. The
+ *        key functions are therefore called directly and the
+ *        compiler can inline them into `Calculate`. Everything
+ *        else (stack, LASTX, general registers, observers) is the
+ *        same as in `Backend`. Example:
+ *        @verbatim
+ *        backend::StaticBackend<key::static_keypad> backend;
+ *        backend.Insert(30);
+ *        backend.Calculate<'s'>();   // sin(30) = 0.5
+ *        backend.Calculate("s");     // same, dispatched at runtime
+ *        @endverbatim
+ *
+ * @tparam Keypad A `key::StaticKeypad` constant, e.g. `key::static_keypad`
+ */
+template <const auto& Keypad>
+class StaticBackend: public Backend {
+public:
+    StaticBackend(): Backend() {}
+    ~StaticBackend() {}
+    /**
+     * @brief Same as `Backend::Calculate`. The key is dispatched by
+     *        comparing it with each numeric key of the keypad.
+     *
+     * @param operation A 1-operand or 2-operand key, e.g. `+`
+     *
+     * @return The calculation's result
+     */
+    double Calculate(std::string operation) override {
+        const metrics::Scope scope(metrics::KeySlot(operation));
+        double result = 0.0;
+        if (operation.size() == 1 &&
+            Dispatch(operation, result, std::make_index_sequence<Keypad.size()>{}))
+            return result;
+        InvalidOperation(operation);
+    }
+    /**
+     * @brief Same as `Calculate` for a key known at compile time, so
+     *        no dispatch happens at all.
+     *
+     * @tparam Key A 1-operand or 2-operand key, e.g. `'+'`
+     *
+     * @return The calculation's result
+     */
+    template <char Key>
+    double Calculate() {
+        constexpr std::size_t idx = Keypad.Find(Key);
+        static_assert(idx < Keypad.size() && key::Arity(Keypad.keys[idx]) > 0,
+                      "Key must be a numeric key of the keypad");
+        const metrics::Scope scope(static_cast<unsigned char>(Key));
+        return Apply<idx>(std::string(1, Key));
+    }
+
+private:
+    /**
+     * @brief Calculates with the `I`-th key of the keypad; does
+     *        nothing if it's not a numeric key.
+     */
+    template <std::size_t I>
+    double Apply(const std::string& operation) {
+        if constexpr (key::Arity(Keypad.keys[I]) == 1)
+            return ApplySingleArg([](double x) {
+                return Keypad.keys[I].single_arg(x); }, operation);
+        else if constexpr (key::Arity(Keypad.keys[I]) == 2)
+            return ApplyDoubleArg([](double x, double y) {
+                return Keypad.keys[I].double_arg(x, y); }, operation);
+        else
+            return 0.0;
+    }
+    /**
+     * @brief Finds the numeric key `operation` refers to and
+     *        calculates with it.
+     *
+     * @return Whether `operation` is a numeric key of the keypad
+     */
+    template <std::size_t... I>
+    bool Dispatch(const std::string& operation, double& result,
+                  std::index_sequence<I...>) {
+        const char key = operation[0];
+        // non-numeric keys are filtered out at compile time
+        return ((key::Arity(Keypad.keys[I]) > 0 && key == Keypad.keys[I].key &&
+                 (result = Apply<I>(operation), true)) || ...);
+    }
+};
+
+} /* namespace backend */
+
+#endif /* STATIC_BACKEND_HPP */
@@ -0,0 +1,157 @@
+#ifndef STATIC_KEYPAD_HPP
+#define STATIC_KEYPAD_HPP
+
+#include "keypad.hpp"
+#include <array>       // array
+#include <cmath>       // sin, cos, tan, log10, sqrt, M_PI
+#include <cstddef>     // size_t
+#include <stdexcept>   // invalid_argument
+#include <string_view> // string_view
+
+namespace key {
+
+/**
+ * @brief Implementations of the numeric keys. Both `keypad` and
+ *        `static_keypad` refer to these so their results agree. They're
+ *        inline so that code that knows at compile time which key it
+ *        executes (see `backend::StaticBackend`) can inline them. The
+ *        arithmetic ones are constexpr so that `_rpn` literals (see
+ *        `backend::StaticProgram`) can be computed at compile time.
+ *        Angles are in degrees. For 2-operand keys, `x` is register X
+ *        and `y` register Y.
+ */
+namespace fn {
+
+constexpr double Deg2Rad(double deg) { return deg * M_PI / 180.0; }
+constexpr double Rad2Deg(double rad) { return rad * 180.0 / M_PI; }
+
+constexpr double Chs(double x)   { return -x; }
+constexpr double Inv(double x)   { return 1/x; }
+inline double Sin(double x)   { return sin(Deg2Rad(x)); }
+inline double Cos(double x)   { return cos(Deg2Rad(x)); }
+inline double Tan(double x)   { return tan(Deg2Rad(x)); }
+inline double Asin(double x)  { return Rad2Deg(asin(x)); }
+inline double Acos(double x)  { return Rad2Deg(acos(x)); }
+inline double Atan(double x)  { return Rad2Deg(atan(x)); }
+inline double Exp(double x)   { return exp(x); }
+inline double Ln(double x)    { return log(x); }
+inline double Log10(double x) { return log10(x); }
+inline double Sqrt(double x)  { return sqrt(x); }
+
+constexpr double Plus(double x, double y)  { return x + y; }
+constexpr double Minus(double x, double y) { return y - x; }
+constexpr double Mul(double x, double y)   { return x * y; }
+constexpr double Div(double x, double y) {
+    // |x| < 1e-10 without fabs, which isn't constexpr
+    if (x < 1e-10 && x > -1e-10)
+        throw std::invalid_argument("[FATAL]: Backend: Division by zero.\n");
+    return y/x;
+}
+inline double Power(double x, double y) { return pow(x, y); }
+
+} // namespace fn
+
+/**
+ * @brief Compile-time description of a key; the counterpart of the
+ *        `*KeyInfo` structs of `Keypad` with plain function pointers
+ *        and C strings instead of `std::function` and `std::string`.
+ */
+typedef struct {
+    char key;
+    KeyCategory category;
+    Point point;
+    const char* annotation;
+    const char* long_key;
+    /** @brief Function of 1-operand keys; nullptr otherwise */
+    double (*single_arg)(double);
+    /** @brief Function of 2-operand keys; nullptr otherwise */
+    double (*double_arg)(double, double);
+} StaticKeyInfo;
+
+/**
+ * @brief A keypad that is a constant expression. Keys are stored in a
+ *        `std::array` and looked up linearly, which is done at compile
+ *        time when the key is known. Unlike `Keypad`, it needs no
+ *        dynamic initialization.
+ *
+ * @tparam N Number of keys
+ */
+template <std::size_t N>
+struct StaticKeypad {
+    std::array<StaticKeyInfo, N> keys;
+
+    static constexpr std::size_t size() { return N; }
+    /** @return Index of `key` in `keys` or N if there's no such key */
+    constexpr std::size_t Find(char key) const {
+        for (std::size_t i = 0; i < N; ++i)
+            if (keys[i].key == key)
+                return i;
+        return N;
+    }
+    /** @return Index of the key with that long key (e.g. "SIN") or N */
+    constexpr std::size_t FindLong(std::string_view long_key) const {
+        for (std::size_t i = 0; i < N; ++i)
+            if (long_key == keys[i].long_key)
+                return i;
+        return N;
+    }
+};
+
+/**
+ * @brief Number of operands of a key; 0 for non-numeric keys. Taken
+ *        from the category as comparing the function pointers isn't a
+ *        constant expression under -fsanitize=undefined.
+ */
+constexpr unsigned Arity(const StaticKeyInfo& info) {
+    return (info.category == kCategorySingleArg) ? 1 :
+           (info.category == kCategoryDoubleArg) ? 2 : 0;
+}
+
+//----------------------------------------------------------------
+// The keys of `keypad` as a constant expression. Only the functions
+// are shared; the categories, positions and names are repeated here,
+// and the tests check that they match the ones of `keypad`
+//----------------------------------------------------------------
+inline constexpr StaticKeypad<27> static_keypad{{{
+    // stack
+    {'v', kCategoryStack,     Point{2, 3}, "RDN",   "RDN",   nullptr,   nullptr},
+    {'x', kCategoryStack,     Point{3, 3}, "LASTX", "LASTX", nullptr,   nullptr},
+    {'<', kCategoryStack,     Point{1, 3}, "x<->y", "SWAP",  nullptr,   nullptr},
+    {' ', kCategoryStack,     Point{0, 4}, "ENTER", "ENTER", nullptr,   nullptr},
+    {'p', kCategoryStack,     Point{4, 4}, "pi",    "PI",    nullptr,   nullptr},
+    {'@', kCategoryStack,     Point{3, 4}, "CLX",   "CLX",   nullptr,   nullptr},
+    {'$', kCategoryStack,     Point{4, 0}, "CLR",   "CLR",   nullptr,   nullptr},
+    // 1 argument
+    {'!', kCategorySingleArg, Point{1, 4}, "chs",   "CHS",   fn::Chs,   nullptr},
+    {'i', kCategorySingleArg, Point{0, 3}, "1/x",   "INV",   fn::Inv,   nullptr},
+    {'s', kCategorySingleArg, Point{1, 1}, "sin",   "SIN",   fn::Sin,   nullptr},
+    {'c', kCategorySingleArg, Point{2, 1}, "cos",   "COS",   fn::Cos,   nullptr},
+    {'t', kCategorySingleArg, Point{3, 1}, "tan",   "TAN",   fn::Tan,   nullptr},
+    {'S', kCategorySingleArg, Point{1, 2}, "asin",  "ASIN",  fn::Asin,  nullptr},
+    {'C', kCategorySingleArg, Point{2, 2}, "acos",  "ACOS",  fn::Acos,  nullptr},
+    {'T', kCategorySingleArg, Point{3, 2}, "atan",  "ATAN",  fn::Atan,  nullptr},
+    {'e', kCategorySingleArg, Point{3, 0}, "e^x",   "EXP",   fn::Exp,   nullptr},
+    {'l', kCategorySingleArg, Point{2, 0}, "ln",    "LN",    fn::Ln,    nullptr},
+    {'L', kCategorySingleArg, Point{1, 0}, "log10", "LOG10", fn::Log10, nullptr},
+    {'r', kCategorySingleArg, Point{0, 1}, "sqrt",  "SQRT",  fn::Sqrt,  nullptr},
+    // 2 arguments
+    {'+', kCategoryDoubleArg, Point{0, 5}, "+",     "+",     nullptr,   fn::Plus},
+    {'-', kCategoryDoubleArg, Point{1, 5}, "y-x",   "-",     nullptr,   fn::Minus},
+    {'*', kCategoryDoubleArg, Point{2, 5}, "*",     "*",     nullptr,   fn::Mul},
+    {'/', kCategoryDoubleArg, Point{3, 5}, "y/x",   "/",     nullptr,   fn::Div},
+    {'^', kCategoryDoubleArg, Point{4, 5}, "x^y",   "^",     nullptr,   fn::Power},
+    // prefix
+    {'#', kCategoryStorage,   Point{4, 2}, "STO",   "STO",   nullptr,   nullptr},
+    {'?', kCategoryStorage,   Point{4, 3}, "RCL",   "RCL",   nullptr,   nullptr},
+    {'E', kCategoryEex,       Point{2, 4}, "EEX",   "EEX",   nullptr,   nullptr},
+}}};
+
+static_assert(static_keypad.Find('s') < static_keypad.size() &&
+              static_keypad.keys[static_keypad.Find('s')].category == kCategorySingleArg,
+              "SIN must be a 1-operand key");
+static_assert(static_keypad.FindLong("LOG10") == static_keypad.Find('L'),
+              "long keys must map to their short keys");
+
+} // namespace key
+
+#endif /* STATIC_KEYPAD_HPP */
@@ -0,0 +1,483 @@
+#ifndef STATIC_PROGRAM_HPP
+#define STATIC_PROGRAM_HPP
+
+#include "decoder.hpp"
+#include "machine.hpp"
+#include "number_lexer.hpp"
+#include "static_keypad.hpp"
+#include "tokenizer.hpp"
+#include <array>       // array
+#include <cmath>       // pow, M_PI
+#include <cstddef>     // size_t
+#include <cstdint>     // uint64_t
+#include <stdexcept>   // invalid_argument
+#include <string_view> // string_view
+#include <utility>     // index_sequence, make_index_sequence
+
+namespace backend {
+
+/**
+ * @brief An instruction of a `StaticProgram`; the counterpart of
+ *        `Instruction` with a register index and function pointers
+ *        instead of strings and `std::function`s.
+ */
+typedef struct {
+    Opcode opcode;
+    /** @brief Number to insert (kOpInsert) or EEX argument (kOpEex) */
+    double operand;
+    /** @brief Whether a number was typed before EEX (kOpEex) */
+    bool has_operand;
+    /** @brief Index of the general register (kOpSto, kOpRcl) */
+    std::size_t reg;
+    /** @brief Function of 1-operand keys (kOpSingleArg) */
+    double (*single_arg)(double);
+    /** @brief Function of 2-operand keys (kOpDoubleArg) */
+    double (*double_arg)(double, double);
+} StaticInstruction;
+
+/**
+ * @brief An RPN expression compiled in a constant expression, usually
+ *        written as an `_rpn` literal. It's decoded like a `Program`
+ *        against `key::static_keypad` and runs like
+ *        `Program::Run(Stack&)`: over a 4-level stack (X, Y, Z, T)
+ *        with LASTX, general registers and flags that are freshly
+ *        initialized, so the lift flag starts raised and
+ *        `ShiftDown` replicates T. Running it doesn't parse, look up
+ *        or allocate anything. Example:
+ *        @verbatim
+ *        using namespace backend::literals;
+ *        constexpr auto area = "ENTER * PI *"_rpn;   // pi * r^2
+ *        double a = area(2.0);                       // X = 2
+ *        static_assert("2 ENTER 3 + 4 *"_rpn() == 20);
+ *        @endverbatim
+ *        Expressions that aren't valid, e.g. with an unknown key, a
+ *        trailing operand or STO without a register, throw
+ *        `std::invalid_argument`, which fails to compile when the
+ *        program is constexpr; declare it constexpr to have it
+ *        checked at compile time. The result is a constant
+ *        expression if the keys used are, i.e. the stack keys and
+ *        the arithmetic keys (+, -, *, /, CHS, 1/x).
+ */
+class StaticProgram {
+public:
+    /** @brief Longest program, in instructions */
+    static constexpr std::size_t kMaxInstructions = 64;
+    /** @brief Longest operand, in characters */
+    static constexpr std::size_t kMaxOperand = 32;
+    /** @brief Depth of the stack */
+    static constexpr std::size_t kStackSize = 4;
+
+    constexpr explicit StaticProgram(std::string_view expression):
+        instructions_{},
+        size_(0) {
+        // a half-typed number as the decoder keeps it
+        char operand[kMaxOperand] = {};
+        std::size_t operand_len = 0;
+        auto operand_state = NumberLexer::kStateStart;
+        // STO or RCL waiting for its register
+        bool storage_pending = false;
+        Opcode storage_op = kOpSto;
+
+        Tokenizer tokenizer(expression);
+        std::string_view token;
+        while (tokenizer.Next(token)) {
+            const auto keypress = ShortKey(token);
+            // numbers and `~` continue the operand
+            bool is_operand = Append(operand, operand_len, operand_state, keypress);
+            if (!is_operand && operand_len == 0 && keypress == "~")
+                is_operand = Append(operand, operand_len, operand_state, "-0");
+
+            const std::size_t idx = (keypress.size() == 1) ?
+                key::static_keypad.Find(keypress[0]) : key::static_keypad.size();
+            const bool is_key = (idx < key::static_keypad.size());
+            if (is_key && key::static_keypad.keys[idx].category == key::kCategoryEex) {
+                Push({kOpEex, ToDouble(operand, operand_len), operand_len > 0,
+                      0, nullptr, nullptr});
+                operand_len = 0;
+                operand_state = NumberLexer::kStateStart;
+                storage_pending = false;
+                continue;
+            }
+            if (storage_pending) {
+                // this keypress is the register's name
+                Push({storage_op, 0.0, false, RegisterIndex(keypress), nullptr, nullptr});
+                operand_len = 0;
+                operand_state = NumberLexer::kStateStart;
+                storage_pending = false;
+                continue;
+            }
+            if (is_operand)
+                continue;
+
+            if (!is_key)
+                throw std::invalid_argument("StaticProgram: not a key");
+            const auto& info = key::static_keypad.keys[idx];
+            // write the typed number in the stack first
+            if (operand_len > 0)
+                Push({kOpInsert, ToDouble(operand, operand_len), true, 0, nullptr, nullptr});
+            operand_len = 0;
+            operand_state = NumberLexer::kStateStart;
+            if (info.category == key::kCategoryStorage) {
+                // prefix keys; the next keypress is the register
+                storage_op = (std::string_view(info.long_key) == "STO") ? kOpSto : kOpRcl;
+                storage_pending = true;
+            } else if (key::Arity(info) == 1) {
+                Push({kOpSingleArg, 0.0, false, 0, info.single_arg, nullptr});
+            } else if (key::Arity(info) == 2) {
+                Push({kOpDoubleArg, 0.0, false, 0, nullptr, info.double_arg});
+            } else {
+                Push({StackOpcode(info.key), 0.0, false, 0, nullptr, nullptr});
+            }
+        }
+        // a program doesn't insert a number it ends with
+        if (operand_len > 0)
+            throw std::invalid_argument("StaticProgram: ends with an operand");
+        if (storage_pending)
+            throw std::invalid_argument("StaticProgram: STO/RCL without a register");
+    }
+
+    /**
+     * @brief Runs the program on a stack that holds the arguments;
+     *        with no arguments the stack is all zeros, so the result
+     *        is a constant.
+     *
+     * @return Register X after the last instruction
+     */
+    constexpr double operator()(double x = 0.0, double y = 0.0,
+                                double z = 0.0, double t = 0.0) const {
+        std::array<double, kStackSize> stack = {x, y, z, t};
+        return Run(stack);
+    }
+    /**
+     * @brief Runs the program on a stack, which it reads and writes.
+     *
+     * @param stack Registers X, Y, Z, T
+     *
+     * @return Register X after the last instruction
+     */
+    constexpr double Run(std::array<double, kStackSize>& stack) const {
+        return Execute<Values>(stack);
+    }
+    /**
+     * @brief How many registers of the initial stack the result may
+     *        depend on, counting from X; e.g. 1 for `ENTER *` (X
+     *        only), 2 for `SWAP` (Y) and 0 for a constant.
+     */
+    constexpr unsigned Inputs() const {
+        std::array<unsigned, kStackSize> stack = {1, 2, 4, 8};
+        unsigned mask = Execute<Dependencies>(stack);
+        unsigned inputs = 0;
+        while (mask != 0) {
+            mask >>= 1;
+            ++inputs;
+        }
+        return inputs;
+    }
+    /**
+     * @brief Same as `operator()` with the instructions unrolled at
+     *        compile time, so that the compiler sees straight-line
+     *        code and can inline the keys' functions and fold the
+     *        flags. The program must be a constexpr variable, e.g.
+     *        @verbatim
+     *        static constexpr auto area = "ENTER * PI *"_rpn;
+     *        double a = backend::StaticProgram::Inline<area>(2.0);
+     *        @endverbatim
+     */
+    template <const StaticProgram& Program>
+    static constexpr double Inline(double x = 0.0, double y = 0.0,
+                                   double z = 0.0, double t = 0.0) {
+        std::array<double, kStackSize> stack = {x, y, z, t};
+        return Expand<Program>(stack, std::make_index_sequence<Program.size()>{});
+    }
+    constexpr std::size_t size() const { return size_; }
+    constexpr const StaticInstruction& operator[](std::size_t i) const {
+        return instructions_[i];
+    }
+
+private:
+    /**
+     * @brief Computes values; `Numbers` with EEX scaling in constant
+     *        expressions
+     */
+    struct Values: Numbers {
+        static constexpr double Scale(double x, double exponent) {
+            return x * Pow10(exponent);
+        }
+    };
+    /**
+     * @brief Computes for each value the bit mask of the registers of
+     *        the initial stack it depends on. Values are never near
+     *        zero, so EEX assumes it keeps X when it may overwrite it.
+     */
+    struct Dependencies {
+        using Type = unsigned;
+        static constexpr unsigned Constant(double) { return 0; }
+        static constexpr unsigned Single(double (*)(double), unsigned x) { return x; }
+        static constexpr unsigned Double(double (*)(double, double), unsigned x, unsigned y) {
+            return x | y;
+        }
+        static constexpr unsigned Scale(unsigned x, double) { return x; }
+        static constexpr bool IsNearZero(unsigned) { return false; }
+    };
+
+    /**
+     * @brief The stack of a run for a `Machine`: 4 levels in an array,
+     *        with the operations of `Stack` it uses, in constant
+     *        expressions.
+     */
+    template <typename T>
+    struct FixedStack {
+        /** @brief `Stack::ShiftUp`; X becomes 0 */
+        constexpr void ShiftUp() {
+            for (std::size_t i = kStackSize - 1; i > 0; --i)
+                levels[i] = levels[i - 1];
+            levels[0] = T();
+        }
+        /** @brief `Stack::ShiftDown`; T is replicated */
+        constexpr void ShiftDown() {
+            for (std::size_t i = 0; i < kStackSize - 1; ++i)
+                levels[i] = levels[i + 1];
+        }
+        constexpr void RollDown() {
+            const T old_x = levels[0];
+            ShiftDown();
+            levels[kStackSize - 1] = old_x;
+        }
+        constexpr void Clear() {
+            for (auto& level: levels)
+                level = T();
+        }
+        constexpr void writeX(T x) { levels[0] = x; }
+        constexpr T& operator[](std::size_t i) { return levels[i]; }
+        constexpr const T& operator[](std::size_t i) const { return levels[i]; }
+
+        std::array<T, kStackSize> levels;
+    };
+
+    /** @brief Executes an instruction known at run time */
+    template <typename M>
+    static constexpr void Step(M& machine, const StaticInstruction& instruction) {
+        switch (instruction.opcode) {
+            case kOpInsert:    machine.Insert(instruction.operand); break;
+            case kOpEnter:     machine.Enter(); break;
+            case kOpRdn:       machine.Rdn(); break;
+            case kOpSwap:      machine.SwapXY(); break;
+            case kOpLastX:     machine.LastX(); break;
+            case kOpClx:       machine.Clx(); break;
+            case kOpClr:       machine.Clr(); break;
+            case kOpPi:        machine.Pi(); break;
+            case kOpEex:       machine.Eex(EexExponent(instruction)); break;
+            case kOpSto:       machine.Sto(instruction.reg); break;
+            case kOpRcl:       machine.Rcl(instruction.reg); break;
+            case kOpSingleArg: machine.CalculateSingleArg(instruction.single_arg); break;
+            case kOpDoubleArg: machine.CalculateDoubleArg(instruction.double_arg); break;
+            // only produced by Optimize
+            case kOpConstant:
+            case kOpMultiplyAdd: break;
+        }
+    }
+    /** @brief Same as `Step` for an instruction known at compile time */
+    template <const StaticProgram& Program, std::size_t I, typename M>
+    static constexpr void Step(M& machine) {
+        constexpr StaticInstruction Instruction = Program.instructions_[I];
+        constexpr Opcode opcode = Instruction.opcode;
+        if constexpr (opcode == kOpInsert)         machine.Insert(Instruction.operand);
+        else if constexpr (opcode == kOpEnter)     machine.Enter();
+        else if constexpr (opcode == kOpRdn)       machine.Rdn();
+        else if constexpr (opcode == kOpSwap)      machine.SwapXY();
+        else if constexpr (opcode == kOpLastX)     machine.LastX();
+        else if constexpr (opcode == kOpClx)       machine.Clx();
+        else if constexpr (opcode == kOpClr)       machine.Clr();
+        else if constexpr (opcode == kOpPi)        machine.Pi();
+        else if constexpr (opcode == kOpEex)       machine.Eex(EexExponent(Instruction));
+        else if constexpr (opcode == kOpSto)       machine.Sto(Instruction.reg);
+        else if constexpr (opcode == kOpRcl)       machine.Rcl(Instruction.reg);
+        else if constexpr (opcode == kOpSingleArg) machine.CalculateSingleArg(Instruction.single_arg);
+        else                                       machine.CalculateDoubleArg(Instruction.double_arg);
+    }
+    /** @brief EEX without a typed number acts as if 0 was typed */
+    static constexpr double EexExponent(const StaticInstruction& instruction) {
+        return instruction.has_operand ? instruction.operand : 0.0;
+    }
+
+    template <typename D>
+    constexpr typename D::Type Execute(std::array<typename D::Type, kStackSize>& stack) const {
+        using T = typename D::Type;
+        Machine<FixedStack<T>, D> machine(FixedStack<T>{stack});
+        for (std::size_t i = 0; i < size_; ++i)
+            Step(machine, instructions_[i]);
+        stack = machine.stack.levels;
+        return stack[0];
+    }
+
+    template <const StaticProgram& Program, std::size_t... I>
+    static constexpr double Expand(std::array<double, kStackSize>& stack,
+                                   std::index_sequence<I...>) {
+        Machine<FixedStack<double>, Values> machine(FixedStack<double>{stack});
+        (Step<Program, I>(machine), ...);
+        stack = machine.stack.levels;
+        return stack[0];
+    }
+
+    constexpr void Push(const StaticInstruction& instruction) {
+        if (size_ == kMaxInstructions)
+            throw std::invalid_argument("StaticProgram: too many instructions");
+        instructions_[size_++] = instruction;
+    }
+
+    /** @brief Long keys, e.g. SQRT, to short keys, e.g. r, as `key::ShortKey` */
+    static constexpr std::string_view ShortKey(std::string_view token) {
+        const std::size_t idx = key::static_keypad.FindLong(token);
+        if (idx == key::static_keypad.size())
+            return token;
+        return std::string_view(&key::static_keypad.keys[idx].key, 1);
+    }
+
+    /** @brief `NumberLexer::Append` on a fixed buffer */
+    static constexpr bool Append(char* operand, std::size_t& len,
+                                 NumberLexer::State& state, std::string_view chars) {
+        NumberLexer::State next = state;
+        for (const char c: chars) {
+            next = NumberLexer::Next(next, c);
+            if (next == NumberLexer::kStateStart)
+                return false;
+        }
+        if (!NumberLexer::IsComplete(next))
+            return false;
+        if (len + chars.size() > kMaxOperand)
+            throw std::invalid_argument("StaticProgram: operand too long");
+        for (const char c: chars)
+            operand[len++] = c;
+        state = next;
+        return true;
+    }
+
+    /**
+     * @brief Converts a complete operand to the same double as
+     *        `NumberLexer::Value`. Only operands whose conversion is
+     *        exact with one multiplication or division by a power of
+     *        10 are accepted (at most 19 significant digits whose
+     *        value is below 2^53, and a small exponent), which covers
+     *        numbers as they're usually written.
+     */
+    static constexpr double ToDouble(const char* operand, std::size_t len) {
+        if (len == 0)
+            return 0.0;
+        std::size_t i = 0;
+        const bool negative = (operand[0] == '-');
+        if (operand[0] == '-' || operand[0] == '+')
+            ++i;
+        // significant digits and the power of 10 they're scaled by
+        std::uint64_t mantissa = 0;
+        unsigned digits = 0;
+        int exponent = 0;
+        bool point = false;
+        bool inexact = false;
+        for (; i < len && operand[i] != 'e' && operand[i] != 'E'; ++i) {
+            if (operand[i] == '.') {
+                point = true;
+                continue;
+            }
+            const unsigned digit = operand[i] - '0';
+            if (digits < 19 && (digits > 0 || digit != 0)) {
+                mantissa = mantissa * 10 + digit;
+                ++digits;
+                if (point)
+                    --exponent;
+            } else if (digits >= 19) {
+                // digits that don't fit must be zeros
+                inexact = inexact || (digit != 0);
+                if (!point)
+                    ++exponent;
+            } else if (point) {
+                // leading zeros after the point
+                --exponent;
+            }
+        }
+        if (i < len) {
+            ++i;
+            bool exp_negative = false;
+            if (operand[i] == '-' || operand[i] == '+')
+                exp_negative = (operand[i++] == '-');
+            int exp = 0;
+            for (; i < len; ++i)
+                exp = (exp < 10000) ? exp * 10 + (operand[i] - '0') : exp;
+            exponent += exp_negative ? -exp : exp;
+        }
+        if (mantissa == 0)
+            return negative ? -0.0 : 0.0;
+        // drop trailing zeros of the mantissa
+        while (mantissa % 10 == 0) {
+            mantissa /= 10;
+            ++exponent;
+        }
+        // move big exponents into the mantissa while it stays exact
+        while (exponent > 22 && mantissa <= (1ULL << 53) / 10) {
+            mantissa *= 10;
+            --exponent;
+        }
+        if (inexact || mantissa > (1ULL << 53) || exponent > 22 || exponent < -22)
+            throw std::invalid_argument("StaticProgram: operand can't be converted exactly");
+        // both are exact so the result is correctly rounded
+        const double value = (exponent >= 0) ?
+            static_cast<double>(mantissa) * Pow10(exponent) :
+            static_cast<double>(mantissa) / Pow10(-exponent);
+        return negative ? -value : value;
+    }
+
+    /**
+     * @brief 10^exponent, same as std::pow; computed in a constant
+     *        expression for integer exponents up to 22 in magnitude.
+     */
+    static constexpr double Pow10(double exponent) {
+        if (!(exponent >= -22 && exponent <= 22) || static_cast<int>(exponent) != exponent)
+            return std::pow(10, exponent);
+        const int n = static_cast<int>(exponent);
+        double power = 1.0;
+        for (int i = 0; i < (n < 0 ? -n : n); ++i)
+            power *= 10.0;
+        // 10^n is exact, so its reciprocal is correctly rounded
+        return (n < 0) ? 1.0 / power : power;
+    }
+
+    /** @return Index of a general register A-J (case insensitive) */
+    static constexpr std::size_t RegisterIndex(std::string_view name) {
+        if (name.size() == 1 && name[0] >= 'A' && name[0] <= 'J')
+            return name[0] - 'A';
+        if (name.size() == 1 && name[0] >= 'a' && name[0] <= 'j')
+            return name[0] - 'a';
+        throw std::invalid_argument("StaticProgram: not a general register");
+    }
+
+    static constexpr Opcode StackOpcode(char key) {
+        switch (key) {
+            case ' ': return kOpEnter;
+            case 'v': return kOpRdn;
+            case '<': return kOpSwap;
+            case 'x': return kOpLastX;
+            case '@': return kOpClx;
+            case '$': return kOpClr;
+            case 'p': return kOpPi;
+            default:  throw std::invalid_argument("StaticProgram: not a stack key");
+        }
+    }
+
+    std::array<StaticInstruction, kMaxInstructions> instructions_;
+    std::size_t size_;
+};
+
+namespace literals {
+
+/**
+ * @brief Compiles an RPN expression; see `StaticProgram`, e.g.
+ *        `constexpr auto f = "ENTER *"_rpn;`
+ */
+constexpr StaticProgram operator""_rpn(const char* expression, std::size_t len) {
+    return StaticProgram(std::string_view(expression, len));
+}
+
+} // namespace literals
+
+} /* namespace backend */
+
+#endif /* STATIC_PROGRAM_HPP */
@@ -0,0 +1,209 @@
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include "keypad.hpp"
+#include <array>              // array
+#include <chrono>             // steady_clock
+#include <condition_variable> // condition_variable
+#include <cstddef>            // size_t
+#include <cstdint>            // uint64_t, int16_t
+#include <cstdio>             // FILE
+#include <mutex>              // mutex
+#include <string>             // string
+#include <string_view>        // string_view
+#include <thread>             // thread
+
+namespace backend {
+
+/**
+ * @brief What a tape starts with: the calculator the keys were
+ *        pressed on, so that a replay starts from the same state.
+ */
+typedef struct {
+    /** @brief Microseconds since the epoch when the recording began */
+    std::uint64_t start_us;
+    /** @brief Levels of the stack */
+    std::size_t depth;
+    /** @brief Memory cap of the undo history; 0 if undo was disabled */
+    std::size_t undo_bytes;
+    /** @brief The backend's state as written by `Backend::SaveState` */
+    std::string state;
+} TapeHeader;
+
+/** @brief A keypress as recorded on a tape */
+typedef struct {
+    /** @brief The byte the UI received, e.g. `+` or `u` */
+    unsigned char key;
+    /** @brief Whether the key threw */
+    bool threw;
+    /** @brief Microseconds since the previous key (or the start) */
+    std::uint64_t delta_us;
+    /** @brief Registers X and Y the observer held after the key */
+    double x, y;
+} TapeRecord;
+
+/**
+ * @brief Writes the header of a tape. Layout, with integers as
+ *        unsigned LEB128 varints: the magic `HP35TAPE`, the version,
+ *        `start_us`, `depth`, `undo_bytes`, the size of the state and
+ *        the state's bytes.
+ */
+void EncodeTapeHeader(const TapeHeader& header, std::string& out);
+
+/**
+ * @brief Appends keypresses to a tape in a few bytes each. A record
+ *        is a varint opcode, the varint `delta_us` and then X and/or
+ *        Y as raw doubles (host byte order) only if they differ from
+ *        the previous record's. The opcode is `index << 3 | flags`,
+ *        where `index` numbers the distinct keys in the order they
+ *        first appear, so the dozen or so keys of a session fit in a
+ *        single byte; a new key is followed by its byte. Typing a
+ *        digit thus takes 2-4 bytes.
+ */
+class TapeEncoder {
+public:
+    TapeEncoder();
+    ~TapeEncoder() {}
+    void Encode(const TapeRecord& record, std::string& out);
+
+private:
+    // opcode index of each key byte; -1 if not seen yet
+    std::array<std::int16_t, 256> codes_;
+    std::size_t count_;
+    // X and Y of the previous record
+    double x_, y_;
+};
+
+/**
+ * @brief Reads a tape, e.g. a memory-mapped file, without copying it.
+ *        Throws `std::runtime_error` if the header is invalid or the
+ *        tape ends within a record.
+ */
+class TapeDecoder {
+public:
+    TapeDecoder() = delete;
+    explicit TapeDecoder(std::string_view tape);
+    ~TapeDecoder() {}
+    const TapeHeader& header() const { return header_; }
+    /**
+     * @brief Decodes the next keypress.
+     *
+     * @return False at the end of the tape
+     */
+    bool Next(TapeRecord& record);
+
+private:
+    std::uint64_t ReadVarint();
+
+    std::string_view tape_;
+    std::size_t pos_;
+    TapeHeader header_;
+    // key byte of each opcode index
+    std::array<unsigned char, 256> keys_;
+    std::size_t count_;
+    double x_, y_;
+};
+
+/**
+ * @brief Records keypresses to a tape file. Keys are encoded into a
+ *        memory buffer; full (or flushed) buffers are written to the
+ *        file by a background thread, so recording a key does no I/O.
+ *        Example:
+ *        @verbatim
+ *        backend::TapeWriter tape("session.tape", header);
+ *        engine.Press("+");
+ *        const auto regs = engine.observer().GetState().second;
+ *        tape.Record('+', false, regs.first, regs.second);
+ *        @endverbatim
+ */
+class TapeWriter {
+public:
+    /** @brief Bytes encoded before they're handed to the thread */
+    static constexpr std::size_t kBufferBytes = 64 << 10;
+
+    TapeWriter() = delete;
+    /**
+     * @brief Creates (or truncates) a tape and writes its header.
+     *        Throws `std::runtime_error` if the file can't be opened.
+     *
+     * @param path   Path of the tape
+     * @param header The calculator's state; `start_us` is set to now
+     */
+    TapeWriter(const std::string& path, TapeHeader header);
+    /**
+     * @brief Writes everything recorded; see `Close`. A write error
+     *        can't be thrown from here, so call `Close` to see it.
+     */
+    ~TapeWriter();
+    TapeWriter(const TapeWriter&) = delete;
+    TapeWriter& operator=(const TapeWriter&) = delete;
+    /**
+     * @brief Records a keypress, timestamped now.
+     *
+     * @param key   The byte the UI received
+     * @param threw Whether the key threw
+     * @param x     Register X the observer holds after the key
+     * @param y     Register Y the observer holds after the key
+     */
+    void Record(unsigned char key, bool threw, double x, double y);
+    /**
+     * @brief Hands what's been recorded to the writer thread without
+     *        waiting for it to be written. Throws `std::runtime_error`
+     *        if the thread failed to write what it was handed before.
+     */
+    void Flush();
+    /**
+     * @brief Writes everything recorded and closes the file. Throws
+     *        `std::runtime_error` if anything couldn't be written, e.g.
+     *        because the disk is full.
+     */
+    void Close();
+
+private:
+    /** @brief Writes the buffers handed to it until closed */
+    void Run();
+    /** @brief Hands `buffer_` to the thread, once it took the previous one */
+    void Handoff();
+
+    std::FILE* file_;
+    TapeEncoder encoder_;
+    std::chrono::steady_clock::time_point last_;
+    // keys being encoded; owned by the recording thread
+    std::string buffer_;
+    // keys waiting for the thread, guarded by `mutex_`
+    std::string pending_;
+    // keys the thread is writing
+    std::string writing_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    // a write of the thread failed; guarded by `mutex_`
+    bool failed_;
+    std::thread thread_;
+};
+
+/** @brief Outcome of `ReplayTape` */
+typedef struct {
+    /** @brief Keys replayed */
+    std::size_t keys;
+    /** @brief Keys whose X, Y or exception differ from the tape's */
+    std::size_t mismatches;
+    /** @brief Index of the first mismatching key; `keys` if none */
+    std::size_t first_mismatch;
+    /** @brief Microseconds between the start and the last key */
+    std::uint64_t recorded_us;
+} ReplayReport;
+
+/**
+ * @brief Presses the keys of a tape on a new `Engine` set up from the
+ *        tape's header, as the UI does (`u` and `U` undo and redo),
+ *        and compares X and Y bit for bit with the recorded ones.
+ *
+ * @param tape   The whole tape
+ * @param keypad Keys of the calculator the tape was recorded on
+ */
+ReplayReport ReplayTape(std::string_view tape, const key::Keypad& keypad);
+
+} /* namespace backend */
+
+#endif /* TAPE_HPP */
@@ -0,0 +1,82 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>             // atomic
+#include <condition_variable> // condition_variable
+#include <cstddef>            // size_t
+#include <deque>              // deque
+#include <functional>         // function
+#include <memory>             // unique_ptr
+#include <mutex>              // mutex
+#include <thread>             // thread
+#include <vector>             // vector
+
+namespace backend {
+
+/**
+ * @brief A fixed number of worker threads that execute submitted
+ *        tasks. Each worker owns a queue of tasks; it runs the most
+ *        recent task of its own queue and, when that's empty, steals
+ *        the oldest task from another worker's queue. This balances
+ *        the load when tasks take different amounts of time.
+ *        Tasks receive the index of the worker that runs them so
+ *        they can use per-worker resources (e.g. a `Backend`) without
+ *        locking.
+ */
+class ThreadPool {
+public:
+    /** @brief A task; its argument is the index of the worker running it */
+    using Task = std::function<void(unsigned)>;
+
+    /**
+     * @param threads Number of workers; 0 means one per hardware
+     *                thread
+     */
+    ThreadPool(unsigned threads = 0);
+    /** @brief Waits for the submitted tasks, then joins the workers */
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    /** @brief Number of workers */
+    unsigned size() const { return static_cast<unsigned>(threads_.size()); }
+    /**
+     * @brief Queues a task. Tasks must not throw; an exception that
+     *        escapes a task terminates the program.
+     */
+    void Submit(Task task);
+    /** @brief Blocks until all submitted tasks have finished */
+    void Wait();
+
+private:
+    /** @brief A worker's queue of tasks */
+    typedef struct {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    } Queue;
+
+    /** @brief Main loop of worker `index` */
+    void Work(unsigned index);
+    /** @brief Takes a task from the worker's own queue or steals one */
+    bool Take(unsigned index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    // guards sleeping and waking up; taken after a queue's mutex, never
+    // before
+    std::mutex mutex_;
+    // signalled when tasks are submitted or the pool stops
+    std::condition_variable work_cv_;
+    // signalled when the last pending task finishes
+    std::condition_variable done_cv_;
+    // tasks in the queues, not yet taken by a worker
+    std::atomic<std::size_t> queued_;
+    // tasks submitted but not finished
+    std::atomic<std::size_t> pending_;
+    // queue the next task is submitted to
+    std::atomic<unsigned> next_;
+    bool stop_;
+};
+
+} /* namespace backend */
+
+#endif /* THREAD_POOL_HPP */
@@ -0,0 +1,55 @@
+#ifndef TOKENIZER_HPP
+#define TOKENIZER_HPP
+
+#include <string_view> // string_view
+
+namespace backend {
+
+/**
+ * @brief Splits an expression into tokens separated by whitespace
+ *        (any run of spaces, tabs or newlines). The tokens are views
+ *        into the expression, which therefore must outlive them; the
+ *        expression is walked once and nothing is copied. Example:
+ *        @verbatim
+ *        backend::Tokenizer tokenizer("2 ENTER  3\t+");
+ *        std::string_view token;
+ *        while (tokenizer.Next(token))
+ *            ; // "2", "ENTER", "3", "+"
+ *        @endverbatim
+ */
+class Tokenizer {
+public:
+    Tokenizer() = delete;
+    constexpr Tokenizer(std::string_view expression): rest_(expression) {}
+    /**
+     * @brief Finds the next token.
+     *
+     * @param token Where to write the token
+     *
+     * @return False if there are no more tokens
+     */
+    constexpr bool Next(std::string_view& token) {
+        std::size_t begin = 0;
+        while (begin < rest_.size() && IsSpace(rest_[begin]))
+            ++begin;
+        std::size_t end = begin;
+        while (end < rest_.size() && !IsSpace(rest_[end]))
+            ++end;
+        token = rest_.substr(begin, end - begin);
+        rest_.remove_prefix(end);
+        return !token.empty();
+    }
+
+private:
+    static constexpr bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+               c == '\v' || c == '\f';
+    }
+
+    // the part of the expression not tokenized yet
+    std::string_view rest_;
+};
+
+} /* namespace backend */
+
+#endif /* TOKENIZER_HPP */
@@ -2,14 +2,14 @@
 #include "backend.hpp"
 #include "stack.hpp"
 #include "keypad.hpp"
+#include "metrics.hpp"
 #include <iostream> // ostream
 #include <iomanip> // setprecision, fixed
 #include <vector> // vector 
 #include <sstream> // istringstream
-#include <stdexcept> // runtime_error 
+#include <stdexcept> // runtime_error, invalid_argument
 #include <algorithm> // erase, remove
-#include <cmath> // M_PI
-#include <cfloat> // DBL_MIN 
+#include <cstring> // memcpy
 #include <optional> // optional 
 
 
@@ -20,74 +20,64 @@ void Subject::Detach(Observer* observer) {
     );
 } 
 
-void Subject::NotifyValue(std::pair<double, double> registers) {
+void Subject::DispatchValue(std::pair<double, double> registers) {
     for (const auto& observer : observers_)
         observer->UpdateRegisters(registers);
+    if (channel_ != nullptr)
+        channel_->Push(backend::Event{backend::kEventRegisters, '\0',
+                                      registers.first, registers.second});
 }
 
-void Subject::NotifyOperation(const std::string& operation) {
+void Subject::DispatchOperation(const std::string& operation) {
     for (const auto& observer : observers_)
         observer->UpdateOperation(operation);
+    if (channel_ != nullptr)
+        channel_->Push(backend::Event{backend::kEventOperation,
+                                      operation.empty() ? '\0' : operation[0],
+                                      0.0, 0.0});
 }
 
 namespace backend {
 
-Backend::Backend(const key::Keypad& keypad):
-    keypad_(keypad),
-    stack_(std::make_unique<Stack>()),
-    lastx_(0.0),
-    sto_regs_({0})
-{ 
-    // map a general register name to the index of the gr array
-    std::size_t i = 0;
-    for (const auto& n: key::kNamesGenRegs)
-        gen_regs_name2idx[n] = i++;
-    // initialize flags
-    flags_.shift_up = true;
-    flags_.eex_pressed = false;
-    flags_.rcl_sto_pressed = false;
+Backend::Backend(const key::Keypad& keypad, std::size_t depth):
+    Backend(depth) {
+    keypad_ = &keypad;
+}
+
+Backend::Backend(std::size_t depth):
+    keypad_(nullptr),
+    machine_(Stack(depth)) {}
+
+void Backend::Reset() {
+    machine_.Reset();
 }
 
 void Backend::Rdn() {
-    // we always use the stack pointer because Stack class implements a [] operator
-    auto old_first = (*stack_)[0];
-    for (std::size_t i = 0; i < (*stack_).size() - 1; ++i)
-        (*stack_)[i] = (*stack_)[i+1];
-    (*stack_)[(*stack_).size() - 1] = old_first;
-    flags_.eex_pressed = false;
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyRdn));
+    machine_.Rdn();
     // inform the observer
     NotifyValue(Peek());
     NotifyOperation(key::kKeyRdn);
 }
 
 void Backend::SwapXY() {
-    std::swap((*stack_)[IDX_REG_X], (*stack_)[IDX_REG_Y]);
-    flags_.eex_pressed = false;
+    const metrics::Scope scope(metrics::KeySlot(key::kKeySwap));
+    machine_.SwapXY();
     // inform the observer
     NotifyValue(Peek());
     NotifyOperation(key::kKeySwap);
 }
 
 void Backend::Insert(double num) {
-    if (flags_.eex_pressed) {    
-        (*stack_)[IDX_REG_X] *= std::pow(10, num);
-    } else if (flags_.shift_up) { // number was entered
-        stack_->ShiftUp();
-        stack_->writeX(num);
-    } else { // Enter was pressed so write in current reg. X
-        stack_->writeX(num);
-    }
-    flags_.shift_up = true;
-    flags_.eex_pressed = false;
+    const metrics::Scope scope(metrics::kSlotInsert);
+    machine_.Insert(num);
     // notify class observers about new value
     NotifyValue(Peek());
 }
 
 void Backend::Enter() {
-    stack_->ShiftUp();
-    (*stack_)[IDX_REG_X] = (*stack_)[IDX_REG_Y];
-    flags_.eex_pressed = false;
-    flags_.shift_up = false;
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyEnter));
+    machine_.Enter();
     // notify class observer since enter manipulates the stack
     NotifyValue(Peek());
     // don't forget to notify the observer so we can use the event later
@@ -95,159 +85,165 @@ void Backend::Enter() {
 }
 
 void Backend::LastX() {
-    // Make space to insert regisrer LASTX
-    stack_->ShiftUp();
-    (*stack_)[IDX_REG_X] = lastx_;
-    flags_.eex_pressed = false;
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyLastX));
+    machine_.LastX();
     // inform the observer
     NotifyValue(Peek());
     NotifyOperation(key::kKeyLastX);
 }
 
 double Backend::Calculate(std::string operation) {
-    flags_.shift_up = true;
-    auto& registerX = (*stack_)[IDX_REG_X];
-    auto& registerY = (*stack_)[IDX_REG_Y];
-    // We did an operation so calculator needs to store register X
-    // before the operation in register LASTX
-    lastx_ = registerX;
-    bool valid_operation = false;
-
-    auto it1 = keypad_.single_arg_keys.find(operation);
-    if (it1 != keypad_.single_arg_keys.end()) {
+    const metrics::Scope scope(metrics::KeySlot(operation));
+    if (keypad_ == nullptr)
+        InvalidOperation(operation);
+    const auto& entry = key::LookupKey(*keypad_, operation);
+    if (entry.category == key::kCategorySingleArg) {
         // query single operand op/s such as sin, log, etc.
-        //registerX  = function_key_1op_[operation](registerX);
-        registerX = (it1->second.function)(registerX);
-        valid_operation = true;
+        return CalculateSingleArg(entry.single_arg->function, operation);
     }
-    auto it2 = keypad_.double_arg_keys.find(operation);
-    if (it2 != keypad_.double_arg_keys.end()) {
+    if (entry.category == key::kCategoryDoubleArg) {
         // query 2-operant operations such as +, /, etc.
-        registerY = (it2->second.function)(registerX, registerY);
-        // drop old register X
-        stack_->ShiftDown();
-        valid_operation = true;
-    }
-    if (valid_operation)
-    {
-        // Notify observers about the new operation and value
-        NotifyOperation(operation); 
-        NotifyValue(Peek()); 
-        return registerX;
-    } else {
-        throw std::runtime_error(std::string("[FATAL]: Invalid operation ") +
-                                            operation + std::string("\n"));
+        return CalculateDoubleArg(entry.double_arg->function, operation);
     }
+    InvalidOperation(operation);
+}
+
+void Backend::InvalidOperation(const std::string& operation) {
+    // an invalid operation still raises the lift flag and saves LASTX
+    machine_.flags.shift_up = true;
+    machine_.lastx = machine_.stack[IDX_REG_X];
+    throw std::runtime_error(std::string("[FATAL]: Invalid operation ") +
+                                        operation + std::string("\n"));
+}
+
+double Backend::CalculateSingleArg(const std::function<double(double)>& function,
+                                   const std::string& operation) {
+    const metrics::Scope scope(metrics::KeySlot(operation));
+    return ApplySingleArg(function, operation);
+}
+
+double Backend::CalculateDoubleArg(const std::function<double(double, double)>& function,
+                                   const std::string& operation) {
+    const metrics::Scope scope(metrics::KeySlot(operation));
+    return ApplyDoubleArg(function, operation);
 }
 
 void Backend::Clx() {
-    stack_->writeX(0.0);
-    flags_.shift_up = false;
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyClx));
+    machine_.Clx();
     // inform the observer 
     NotifyOperation(key::kKeyClx); 
     NotifyValue(Peek()); 
 }
 
 void Backend::Clr() {
-    stack_->writeX(0.0);
-    Enter();
-    Enter();
-    Enter();
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyClr));
+    machine_.Clr();
     NotifyOperation(key::kKeyClr); 
     NotifyValue(Peek()); 
 }
 
 void Backend::Pi() {
-    flags_.eex_pressed = false;
-    Insert(M_PI);
-    // inform the observer 
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyPi));
+    machine_.Pi();
+    // observers see the inserted value, as after `Insert`, then the key
+    NotifyValue(Peek());
     NotifyOperation(key::kKeyPi); 
     NotifyValue(Peek()); 
 }
 
-static inline bool IsNearZero(double x) {
-    return std::fabs(x) < DBL_MIN*100;
+void Backend::InsertConstant(double num, double lastx, unsigned lifts) {
+    const metrics::Scope scope(metrics::kSlotInsert);
+    machine_.InsertConstant(num, lastx, lifts);
+    NotifyValue(Peek());
 }
 
-void Backend::Eex(std::optional<double> token) {
-    const double regx = Peek().first; 
-    if (IsNearZero(*token) && IsNearZero(regx)) // prepare register X
-        stack_->writeX(1);
-    else if (flags_.eex_pressed) // multiply consecutively
-        (*stack_)[IDX_REG_X] *= std::pow(10, *token);
-    else if (IsNearZero(*token) && !IsNearZero(regx))
-        ; // don't do anything
-    else
-        stack_->writeX(*token);
-    flags_.shift_up = false;
-    flags_.eex_pressed = true;
-    NotifyOperation(key::kKeyEex); 
-    NotifyValue(Peek()); 
+double Backend::MultiplyAdd(bool subtract) {
+    const auto& key = subtract ? key::kKeyMinus : key::kKeyPlus;
+    const metrics::Scope scope(metrics::KeySlot(key));
+    machine_.MultiplyAdd(subtract);
+    NotifyOperation(key);
+    NotifyValue(Peek());
+    return machine_.stack[IDX_REG_X];
+}
+
+void Backend::SaveState(void* state) const {
+    const BackendState registers = {machine_.lastx, machine_.regs, machine_.flags};
+    std::memcpy(state, &registers, sizeof(registers));
+    machine_.stack.Save(static_cast<char*>(state) + sizeof(registers));
 }
 
-static inline std::string ToUpper(std::string s) {
-    std::transform(s.begin(), s.end(), s.begin(), ::toupper);
-    return s;
+void Backend::LoadState(const void* state) {
+    BackendState registers;
+    std::memcpy(&registers, state, sizeof(registers));
+    machine_.lastx = registers.lastx;
+    machine_.regs = registers.sto_regs;
+    machine_.flags = registers.flags;
+    machine_.stack.Load(static_cast<const char*>(state) + sizeof(registers));
+    NotifyValue(Peek());
 }
 
-static inline std::string ToLower(std::string s) {
-    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-    return s;
+void Backend::SaveSession(Session& session) const {
+    if (machine_.stack.size() != kStackDepth)
+        throw std::invalid_argument("[FATAL]: Backend: a session needs a 4-level stack.\n");
+    machine_.stack.Save(session.stack.data());
+    session.lastx = machine_.lastx;
+    session.flags = machine_.flags;
+    session.sto_regs = machine_.regs;
+}
+
+void Backend::LoadSession(const Session& session) {
+    if (machine_.stack.size() != kStackDepth)
+        throw std::invalid_argument("[FATAL]: Backend: a session needs a 4-level stack.\n");
+    machine_.stack.Load(session.stack.data());
+    machine_.lastx = session.lastx;
+    machine_.flags = session.flags;
+    machine_.regs = session.sto_regs;
+    NotifyValue(Peek());
+}
+
+void Backend::Eex(std::optional<double> token) {
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyEex));
+    // EEX without a typed number acts as if 0 was typed
+    machine_.Eex(token.value_or(0.0));
+    NotifyOperation(key::kKeyEex); 
+    NotifyValue(Peek()); 
 }
 
 void Backend::Sto(std::string name) {
-    // general register index
-    std::size_t idx;
-    // name is case insensitive
-    if (gen_regs_name2idx.find(ToUpper(name)) != gen_regs_name2idx.end())
-        idx = gen_regs_name2idx[ToUpper(name)];
-    else if (gen_regs_name2idx.find(ToLower(name)) != gen_regs_name2idx.end())
-        idx = gen_regs_name2idx[ToLower(name)];
-    else // silently ignore index errors
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyStore));
+    // general register index; name is case insensitive
+    const int idx = key::GenRegIndex(name);
+    if (idx < 0) // silently ignore index errors
         return;
 
-    if (idx < sto_regs_.size())
-        sto_regs_[idx] = (*stack_)[IDX_REG_X];
-    flags_.shift_up = true;
-    flags_.eex_pressed = false;
-
+    machine_.Sto(idx);
     NotifyOperation(key::kKeyStore); 
     // doesn't change the stack so no values sent to observer
 }
 
 void Backend::Rcl(std::string name) {
-    // general register index
-    std::size_t idx;
-    // name is case insensitive - check validity
-    if (gen_regs_name2idx.find(ToUpper(name)) != gen_regs_name2idx.end())
-        idx = gen_regs_name2idx[ToUpper(name)];
-    else if (gen_regs_name2idx.find(ToLower(name)) != gen_regs_name2idx.end())
-        idx = gen_regs_name2idx[ToLower(name)];
-    else // silently ignore index errors
+    const metrics::Scope scope(metrics::KeySlot(key::kKeyRcl));
+    // general register index; name is case insensitive
+    const int idx = key::GenRegIndex(name);
+    if (idx < 0) // silently ignore index errors
         return;
 
-    // RCL operation stores X in LASTX:
-    // http://h10032.www1.hp.com/ctg/Manual/c01579350 p306
-    lastx_ = (*stack_)[IDX_REG_X];
-    // silently ignore index errors
-    if (idx < sto_regs_.size())
-        (*stack_)[IDX_REG_X] = sto_regs_[idx];
-    flags_.shift_up = true;
-    flags_.eex_pressed = false;
+    machine_.Rcl(idx);
     NotifyOperation(key::kKeyRcl); 
     NotifyValue(Peek()); 
 }
 
 
 std::ostream& operator<<(std::ostream& os, const Backend& backend) {
-    const auto& stack = *(backend.stack_);
+    const auto& stack = backend.machine_.stack;
     os << std::fixed << std::setprecision(2) <<
         "X\tY\tZ\tT\tLASTX" << std::endl <<
         stack[IDX_REG_X] << "\t" <<
         stack[IDX_REG_Y] << "\t" <<
         stack[IDX_REG_Z] << "\t" <<
         stack[IDX_REG_T] << "\t" <<
-        backend.lastx_ << std::endl;
+        backend.machine_.lastx << std::endl;
     return os;
 }
 
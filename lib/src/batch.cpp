@@ -0,0 +1,432 @@
+#include "batch.hpp"
+#include "program.hpp"
+#include "decoder.hpp"
+#include "keypad.hpp"
+#include "machine.hpp"
+#include <algorithm> // fill_n, copy_n, min
+#include <cmath>     // sqrt, sin, pow, fma, M_PI
+#include <stdexcept> // invalid_argument
+#include <string>    // string
+#include <utility>   // swap
+#include <vector>    // vector
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace backend {
+
+//-------------------------------------------------------------//
+// SIMD helpers                                                //
+//-------------------------------------------------------------//
+#if defined(__AVX__)
+using Vec = __m256d;
+static constexpr std::size_t kLanes = 4;
+static inline Vec Load(const double* p) { return _mm256_loadu_pd(p); }
+static inline void Store(double* p, Vec v) { _mm256_storeu_pd(p, v); }
+static inline Vec Broadcast(double x) { return _mm256_set1_pd(x); }
+static inline Vec Add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+static inline Vec Sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+static inline Vec Mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+static inline Vec Div(Vec a, Vec b) { return _mm256_div_pd(a, b); }
+static inline Vec Sqrt(Vec a) { return _mm256_sqrt_pd(a); }
+static inline Vec Neg(Vec a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+#elif defined(__SSE2__)
+using Vec = __m128d;
+static constexpr std::size_t kLanes = 2;
+static inline Vec Load(const double* p) { return _mm_loadu_pd(p); }
+static inline void Store(double* p, Vec v) { _mm_storeu_pd(p, v); }
+static inline Vec Broadcast(double x) { return _mm_set1_pd(x); }
+static inline Vec Add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+static inline Vec Sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+static inline Vec Mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+static inline Vec Div(Vec a, Vec b) { return _mm_div_pd(a, b); }
+static inline Vec Sqrt(Vec a) { return _mm_sqrt_pd(a); }
+static inline Vec Neg(Vec a) { return _mm_xor_pd(a, _mm_set1_pd(-0.0)); }
+#else
+// no SIMD - a vector of a single lane
+using Vec = double;
+static constexpr std::size_t kLanes = 1;
+static inline Vec Load(const double* p) { return *p; }
+static inline void Store(double* p, Vec v) { *p = v; }
+static inline Vec Broadcast(double x) { return x; }
+static inline Vec Add(Vec a, Vec b) { return a + b; }
+static inline Vec Sub(Vec a, Vec b) { return a - b; }
+static inline Vec Mul(Vec a, Vec b) { return a * b; }
+static inline Vec Div(Vec a, Vec b) { return a / b; }
+static inline Vec Sqrt(Vec a) { return std::sqrt(a); }
+static inline Vec Neg(Vec a) { return -a; }
+#endif
+
+/**
+ * @brief Applies `vec_op` on full SIMD vectors of `out` and `in`
+ *        and `scalar_op` on the remaining elements.
+ */
+template <typename VecOp, typename ScalarOp>
+static inline void Map(double* out, const double* in, std::size_t n,
+                       VecOp vec_op, ScalarOp scalar_op) {
+    std::size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes)
+        Store(out + i, vec_op(Load(in + i)));
+    for (; i < n; ++i)
+        out[i] = scalar_op(in[i]);
+}
+
+/** @brief Same as `Map` for y = f(x, y) */
+template <typename VecOp, typename ScalarOp>
+static inline void Map2(double* y, const double* x, std::size_t n,
+                        VecOp vec_op, ScalarOp scalar_op) {
+    std::size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes)
+        Store(y + i, vec_op(Load(x + i), Load(y + i)));
+    for (; i < n; ++i)
+        y[i] = scalar_op(x[i], y[i]);
+}
+
+//-------------------------------------------------------------//
+// Kernels of the numeric keys                                 //
+//-------------------------------------------------------------//
+// They must compute exactly what the functions in keypad.cpp do.
+using SingleArgKernel = void (*)(double* out, const double* x, std::size_t n);
+using DoubleArgKernel = void (*)(double* y, const double* x, std::size_t n);
+
+static inline double Deg2Rad(double deg) {
+    return deg * M_PI / 180.0;
+}
+
+static inline double Rad2Deg(double rad) {
+    return rad * 180.0 / M_PI;
+}
+
+static void KernelChs(double* out, const double* x, std::size_t n) {
+    Map(out, x, n, [](Vec v) { return Neg(v); },
+                   [](double v) { return -v; });
+}
+
+static void KernelInv(double* out, const double* x, std::size_t n) {
+    const Vec one = Broadcast(1.0);
+    Map(out, x, n, [one](Vec v) { return Div(one, v); },
+                   [](double v) { return 1/v; });
+}
+
+static void KernelSqrt(double* out, const double* x, std::size_t n) {
+    Map(out, x, n, [](Vec v) { return Sqrt(v); },
+                   [](double v) { return std::sqrt(v); });
+}
+
+// transcendental functions have no SIMD instructions; they're plain
+// loops the compiler can inline instead of calling std::function
+#define SCALAR_KERNEL(name, expr)                                   \
+    static void name(double* out, const double* in, std::size_t n) { \
+        for (std::size_t i = 0; i < n; ++i) {                        \
+            const double x = in[i];                                  \
+            out[i] = (expr);                                         \
+        }                                                            \
+    }
+SCALAR_KERNEL(KernelSin,   std::sin(Deg2Rad(x)))
+SCALAR_KERNEL(KernelCos,   std::cos(Deg2Rad(x)))
+SCALAR_KERNEL(KernelTan,   std::tan(Deg2Rad(x)))
+SCALAR_KERNEL(KernelAsin,  Rad2Deg(std::asin(x)))
+SCALAR_KERNEL(KernelAcos,  Rad2Deg(std::acos(x)))
+SCALAR_KERNEL(KernelAtan,  Rad2Deg(std::atan(x)))
+SCALAR_KERNEL(KernelExp,   std::exp(x))
+SCALAR_KERNEL(KernelLn,    std::log(x))
+SCALAR_KERNEL(KernelLog10, std::log10(x))
+#undef SCALAR_KERNEL
+
+static void KernelPlus(double* y, const double* x, std::size_t n) {
+    Map2(y, x, n, [](Vec a, Vec b) { return Add(a, b); },
+                  [](double a, double b) { return a + b; });
+}
+
+static void KernelMinus(double* y, const double* x, std::size_t n) {
+    Map2(y, x, n, [](Vec a, Vec b) { return Sub(b, a); },
+                  [](double a, double b) { return b - a; });
+}
+
+static void KernelMul(double* y, const double* x, std::size_t n) {
+    Map2(y, x, n, [](Vec a, Vec b) { return Mul(a, b); },
+                  [](double a, double b) { return a * b; });
+}
+
+static void KernelDiv(double* y, const double* x, std::size_t n) {
+    // same check as the keypad's division, for all rows at once
+    bool near_zero = false;
+    for (std::size_t i = 0; i < n; ++i)
+        near_zero |= std::fabs(x[i]) < 1e-10;
+    if (near_zero)
+        throw std::invalid_argument("[FATAL]: Backend: Division by zero.\n");
+    Map2(y, x, n, [](Vec a, Vec b) { return Div(b, a); },
+                  [](double a, double b) { return b / a; });
+}
+
+static void KernelPower(double* y, const double* x, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+        y[i] = std::pow(x[i], y[i]);
+}
+
+/**
+ * @brief Finds the kernel of a 1-operand instruction. The kernels
+ *        implement the functions of `key::keypad`, so instructions
+ *        decoded against any other keypad get no kernel.
+ */
+static SingleArgKernel FindKernel(const Instruction& instruction) {
+    static const std::vector<std::pair<std::string, SingleArgKernel>> kernels = {
+        {key::kKeyChs,   KernelChs},   {key::kKeyInv,   KernelInv},
+        {key::kKeySin,   KernelSin},   {key::kKeyCos,   KernelCos},
+        {key::kKeyTan,   KernelTan},   {key::kKeyAsin,  KernelAsin},
+        {key::kKeyAcos,  KernelAcos},  {key::kKeyAtan,  KernelAtan},
+        {key::kKeyExp,   KernelExp},   {key::kKeyLn,    KernelLn},
+        {key::kKeyLog10, KernelLog10}, {key::kKeySqrt,  KernelSqrt},
+    };
+    for (const auto& kernel: kernels) {
+        const auto& entry = key::LookupKey(key::keypad, kernel.first);
+        if (entry.single_arg != nullptr &&
+            &entry.single_arg->function == instruction.single_arg)
+            return kernel.second;
+    }
+    return nullptr;
+}
+
+/** @copydoc FindKernel */
+static DoubleArgKernel FindKernel2(const Instruction& instruction) {
+    static const std::vector<std::pair<std::string, DoubleArgKernel>> kernels = {
+        {key::kKeyPlus,  KernelPlus},  {key::kKeyMinus, KernelMinus},
+        {key::kKeyMul,   KernelMul},   {key::kKeyDiv,   KernelDiv},
+        {key::kKeyPower, KernelPower},
+    };
+    for (const auto& kernel: kernels) {
+        const auto& entry = key::LookupKey(key::keypad, kernel.first);
+        if (entry.double_arg != nullptr &&
+            &entry.double_arg->function == instruction.double_arg)
+            return kernel.second;
+    }
+    return nullptr;
+}
+
+//-------------------------------------------------------------//
+// Class methods                                               //
+//-------------------------------------------------------------//
+Batch::Batch(std::size_t rows):
+    rows_(rows),
+    columns_(5 * rows, 0.0),
+    map_({0, 1, 2, 3, 4}),
+    sto_regs_() {
+    flags_.shift_up = true;
+    flags_.eex_pressed = false;
+    flags_.rcl_sto_pressed = false;
+}
+
+void Batch::Clear() {
+    std::fill(columns_.begin(), columns_.end(), 0.0);
+    std::fill(sto_regs_.begin(), sto_regs_.end(), 0.0);
+    flags_.shift_up = true;
+    flags_.eex_pressed = false;
+    flags_.rcl_sto_pressed = false;
+}
+
+const double* Batch::Run(const Program& program) {
+    const auto& instructions = program.instructions();
+    // resolve the kernels once for all blocks
+    std::vector<SingleArgKernel> kernels(instructions.size(), nullptr);
+    std::vector<DoubleArgKernel> kernels2(instructions.size(), nullptr);
+    for (std::size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i].opcode == kOpSingleArg)
+            kernels[i] = FindKernel(instructions[i]);
+        else if (instructions[i].opcode == kOpDoubleArg)
+            kernels2[i] = FindKernel2(instructions[i]);
+        else if (instructions[i].opcode == kOpSto ||
+                 instructions[i].opcode == kOpRcl)
+            sto_regs_.resize(key::kNamesGenRegs.size() * rows_, 0.0);
+    }
+
+    // rows per block; 5 columns of 512 doubles fit in the L1 cache
+    constexpr std::size_t kBlockRows = 512;
+    // all blocks end up with the same flags and permutation
+    auto flags = flags_;
+    auto map = map_;
+    for (std::size_t start = 0; start < rows_; start += kBlockRows) {
+        const std::size_t n = std::min(kBlockRows, rows_ - start);
+        flags = flags_;
+        map = map_;
+        // column of a register (X, Y, Z, T or LASTX) within the block
+        auto Reg = [&](std::size_t reg) { return Column(map[reg]) + start; };
+        auto StoReg = [&](int idx) { return &sto_regs_[idx * rows_ + start]; };
+        //--------------------------------------------------
+        // stack intrinsics as column permutations
+        //--------------------------------------------------
+        auto ShiftUp = [&]() {
+            // T is discarded so its column is reused for X
+            map = {map[IDX_REG_T], map[IDX_REG_X], map[IDX_REG_Y],
+                   map[IDX_REG_Z], map[kIdxLastX]};
+        };
+        auto ShiftDown = [&]() {
+            // X is discarded so its column is reused for T
+            map = {map[IDX_REG_Y], map[IDX_REG_Z], map[IDX_REG_T],
+                   map[IDX_REG_X], map[kIdxLastX]};
+            // replicate the old T
+            std::copy_n(Reg(IDX_REG_Z), n, Reg(IDX_REG_T));
+        };
+        auto Insert = [&](double num) {
+            if (flags.eex_pressed) {
+                const double factor = std::pow(10, num);
+                double* x = Reg(IDX_REG_X);
+                for (std::size_t i = 0; i < n; ++i)
+                    x[i] *= factor;
+            } else {
+                if (flags.shift_up)
+                    ShiftUp();
+                std::fill_n(Reg(IDX_REG_X), n, num);
+            }
+            flags.shift_up = true;
+            flags.eex_pressed = false;
+        };
+        auto Enter = [&]() {
+            ShiftUp();
+            std::copy_n(Reg(IDX_REG_Y), n, Reg(IDX_REG_X));
+            flags.eex_pressed = false;
+            flags.shift_up = false;
+        };
+
+        for (std::size_t k = 0; k < instructions.size(); ++k) {
+            const auto& instruction = instructions[k];
+            switch (instruction.opcode) {
+                case kOpInsert:
+                    Insert(instruction.operand);
+                    break;
+                case kOpEnter:
+                    Enter();
+                    break;
+                case kOpRdn:
+                    map = {map[IDX_REG_Y], map[IDX_REG_Z], map[IDX_REG_T],
+                           map[IDX_REG_X], map[kIdxLastX]};
+                    flags.eex_pressed = false;
+                    break;
+                case kOpSwap:
+                    std::swap(map[IDX_REG_X], map[IDX_REG_Y]);
+                    flags.eex_pressed = false;
+                    break;
+                case kOpLastX:
+                    ShiftUp();
+                    std::copy_n(Reg(kIdxLastX), n, Reg(IDX_REG_X));
+                    flags.eex_pressed = false;
+                    break;
+                case kOpClx:
+                    std::fill_n(Reg(IDX_REG_X), n, 0.0);
+                    flags.shift_up = false;
+                    break;
+                case kOpClr:
+                    std::fill_n(Reg(IDX_REG_X), n, 0.0);
+                    Enter();
+                    Enter();
+                    Enter();
+                    break;
+                case kOpPi:
+                    flags.eex_pressed = false;
+                    Insert(M_PI);
+                    break;
+                case kOpEex: {
+                    const double exponent = (instruction.has_operand) ?
+                                            instruction.operand : 0.0;
+                    const double factor = std::pow(10, exponent);
+                    double* x = Reg(IDX_REG_X);
+                    for (std::size_t i = 0; i < n; ++i) {
+                        if (IsNearZero(exponent) && IsNearZero(x[i]))
+                            x[i] = 1;
+                        else if (flags.eex_pressed)
+                            x[i] *= factor;
+                        else if (!IsNearZero(exponent))
+                            x[i] = exponent;
+                    }
+                    flags.shift_up = false;
+                    flags.eex_pressed = true;
+                    break;
+                }
+                case kOpSto: {
+                    const int idx = key::GenRegIndex(instruction.key);
+                    if (idx < 0)
+                        break;
+                    std::copy_n(Reg(IDX_REG_X), n, StoReg(idx));
+                    flags.shift_up = true;
+                    flags.eex_pressed = false;
+                    break;
+                }
+                case kOpRcl: {
+                    const int idx = key::GenRegIndex(instruction.key);
+                    if (idx < 0)
+                        break;
+                    std::copy_n(Reg(IDX_REG_X), n, Reg(kIdxLastX));
+                    std::copy_n(StoReg(idx), n, Reg(IDX_REG_X));
+                    flags.shift_up = true;
+                    flags.eex_pressed = false;
+                    break;
+                }
+                case kOpSingleArg: {
+                    flags.shift_up = true;
+                    // LASTX takes over the column of X and the
+                    // result is written to the old LASTX column
+                    std::swap(map[IDX_REG_X], map[kIdxLastX]);
+                    double* x = Reg(IDX_REG_X);
+                    const double* lastx = Reg(kIdxLastX);
+                    if (kernels[k]) {
+                        kernels[k](x, lastx, n);
+                    } else {
+                        const auto& function = *instruction.single_arg;
+                        for (std::size_t i = 0; i < n; ++i)
+                            x[i] = function(lastx[i]);
+                    }
+                    break;
+                }
+                case kOpDoubleArg: {
+                    flags.shift_up = true;
+                    std::swap(map[IDX_REG_X], map[kIdxLastX]);
+                    double* y = Reg(IDX_REG_Y);
+                    const double* lastx = Reg(kIdxLastX);
+                    if (kernels2[k]) {
+                        kernels2[k](y, lastx, n);
+                    } else {
+                        const auto& function = *instruction.double_arg;
+                        for (std::size_t i = 0; i < n; ++i)
+                            y[i] = function(lastx[i], y[i]);
+                    }
+                    // drop old register X
+                    ShiftDown();
+                    break;
+                }
+                case kOpConstant:
+                    if (flags.shift_up)
+                        ShiftUp();
+                    for (unsigned i = 0; i < instruction.lifts; ++i)
+                        ShiftUp();
+                    for (unsigned i = 0; i < instruction.lifts; ++i)
+                        ShiftDown();
+                    std::fill_n(Reg(IDX_REG_X), n, instruction.operand);
+                    std::fill_n(Reg(kIdxLastX), n, instruction.lastx);
+                    flags.shift_up = true;
+                    flags.eex_pressed = false;
+                    break;
+                case kOpMultiplyAdd: {
+                    flags.shift_up = true;
+                    const double sign = (instruction.key == key::kKeyMinus) ? -1.0 : 1.0;
+                    const double* x = Reg(IDX_REG_X);
+                    const double* y = Reg(IDX_REG_Y);
+                    double* z = Reg(IDX_REG_Z);
+                    double* lastx = Reg(kIdxLastX);
+                    for (std::size_t i = 0; i < n; ++i) {
+                        lastx[i] = x[i] * y[i];
+                        z[i] = std::fma(sign * x[i], y[i], z[i]);
+                    }
+                    ShiftDown();
+                    ShiftDown();
+                    break;
+                }
+            }
+        }
+    }
+    flags_ = flags;
+    map_ = map;
+    return (*this)[IDX_REG_X];
+}
+
+} /* namespace backend */
@@ -0,0 +1,183 @@
+#include "decoder.hpp"
+#include "backend.hpp"
+#include "keypad.hpp"
+#include <string>      // string
+#include <string_view> // string_view
+#include <vector>      // vector
+#include <optional>    // optional
+
+namespace backend {
+
+void Execute(Backend& backend, const Instruction& instruction) {
+    switch (instruction.opcode) {
+        case kOpInsert:
+            backend.Insert(instruction.operand);
+            break;
+        case kOpEnter:
+            backend.Enter();
+            break;
+        case kOpRdn:
+            backend.Rdn();
+            break;
+        case kOpSwap:
+            backend.SwapXY();
+            break;
+        case kOpLastX:
+            backend.LastX();
+            break;
+        case kOpClx:
+            backend.Clx();
+            break;
+        case kOpClr:
+            backend.Clr();
+            break;
+        case kOpPi:
+            backend.Pi();
+            break;
+        case kOpEex: {
+            // it can be unset (no operand typed) or a decimal
+            std::optional<double> token;
+            if (instruction.has_operand)
+                token = instruction.operand;
+            backend.Eex(token);
+            break;
+        }
+        case kOpSto:
+            backend.Sto(instruction.key);
+            break;
+        case kOpRcl:
+            backend.Rcl(instruction.key);
+            break;
+        case kOpSingleArg:
+            backend.CalculateSingleArg(*instruction.single_arg, instruction.key);
+            break;
+        case kOpDoubleArg:
+            backend.CalculateDoubleArg(*instruction.double_arg, instruction.key);
+            break;
+        case kOpConstant:
+            backend.InsertConstant(instruction.operand, instruction.lastx,
+                                   instruction.lifts);
+            break;
+        case kOpMultiplyAdd:
+            backend.MultiplyAdd(instruction.key == key::kKeyMinus);
+            break;
+    }
+}
+
+Decoder::Decoder(const key::Keypad& keypad):
+    keypad_(keypad),
+    operand_(),
+    storage_op_(""),
+    is_prev_op_storage_(false) {}
+
+void Decoder::Reset() {
+    operand_.Clear();
+    storage_op_ = "";
+    is_prev_op_storage_ = false;
+}
+
+double Decoder::OperandValue() const {
+    return operand_.Value();
+}
+
+void Decoder::FlushOperand(std::vector<Instruction>& out) {
+    if (!operand_.empty())
+        out.push_back(Instruction{kOpInsert, operand_.Value(), true,
+                                  "", nullptr, nullptr});
+    // empty the operand to prepare for a new one
+    operand_.Clear();
+}
+
+TokenType Decoder::Decode(std::string_view keypress,
+                          std::vector<Instruction>& out) {
+    auto key_type = kTypeNone;
+    //------------------------------------------------------
+    // Determine operation type
+    //------------------------------------------------------
+    const auto& entry = key::LookupKey(keypad_, keypress);
+
+    if (keypress == key::kKeyEnter)
+        key_type = kTypeEnter;
+    else if (entry.category == key::kCategoryStack)
+        key_type = kTypeStack;
+    else if (entry.category == key::kCategorySingleArg ||
+             entry.category == key::kCategoryDoubleArg)
+        key_type = kTypeNumeric;
+    else if (entry.category == key::kCategoryStorage)
+        key_type = kTypeStorage;
+    //------------------------------------------------------
+    // Append to operand if necessary
+    //------------------------------------------------------
+    if (operand_.Append(keypress)) {
+        key_type = kTypeOperand;
+    } else if (operand_.empty() && (keypress == "~")) {
+        operand_.Append("-0");
+        key_type = kTypeOperand;
+    }
+
+    //------------------------------------------------------
+    // Resolve the keypress to instructions
+    //------------------------------------------------------
+    if (is_prev_op_storage_) {
+        // check this first as storage may use the same keys as the
+        // keypad functions, e.g. register E and EEX
+        const auto opcode = (storage_op_ == key::kKeyStore) ? kOpSto : kOpRcl;
+        out.push_back(Instruction{opcode, 0.0, false,
+                                  std::string(keypress), nullptr, nullptr});
+        operand_.Clear();
+        is_prev_op_storage_ = false;
+        return kTypeRegister;
+    } else if (keypress == key::kKeyEex) {
+        const bool has_operand = !operand_.empty();
+        const double token = operand_.Value();
+        out.push_back(Instruction{kOpEex, token, has_operand,
+                                  std::string(keypress), nullptr, nullptr});
+        operand_.Clear();
+        return kTypeEex;
+    } else if (key_type == kTypeNumeric) {
+        // write currently typed number in the stack first
+        FlushOperand(out);
+        if (entry.arity == 1)
+            out.push_back(Instruction{kOpSingleArg, 0.0, false, std::string(keypress),
+                                      &entry.single_arg->function, nullptr});
+        else
+            out.push_back(Instruction{kOpDoubleArg, 0.0, false, std::string(keypress),
+                                      nullptr, &entry.double_arg->function});
+        is_prev_op_storage_ = false;
+    } else if (key_type == kTypeStorage) {
+        FlushOperand(out);
+        // Storage/recall op/s are in prefix notation, e.g.
+        // STO 2. Remember the operation so that the next
+        // keypress is treated as its argument.
+        storage_op_ = keypress;
+        is_prev_op_storage_ = true;
+    } else if (key_type == kTypeEnter) {
+        FlushOperand(out);
+        out.push_back(Instruction{kOpEnter, 0.0, false,
+                                  std::string(keypress), nullptr, nullptr});
+        is_prev_op_storage_ = false;
+    } else if (key_type == kTypeStack) {
+        FlushOperand(out);
+        Opcode opcode = kOpRdn;
+        if (keypress == key::kKeyRdn)
+            opcode = kOpRdn;
+        else if (keypress == key::kKeyLastX)
+            opcode = kOpLastX;
+        else if (keypress == key::kKeySwap)
+            opcode = kOpSwap;
+        else if (keypress == key::kKeyPi)
+            opcode = kOpPi;
+        else if (keypress == key::kKeyClx)
+            opcode = kOpClx;
+        else if (keypress == key::kKeyClr)
+            opcode = kOpClr;
+        out.push_back(Instruction{opcode, 0.0, false,
+                                  std::string(keypress), nullptr, nullptr});
+        is_prev_op_storage_ = false;
+    } else if (key_type == kTypeOperand) {
+        is_prev_op_storage_ = false;
+    }
+    return key_type;
+}
+
+} /* namespace backend */
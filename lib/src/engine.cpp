@@ -0,0 +1,74 @@
+#include "engine.hpp"
+#include "backend.hpp"
+#include "decoder.hpp"
+#include "journal.hpp"
+#include "keypad.hpp"
+#include "metrics.hpp"
+#include "tokenizer.hpp"
+#include <memory>      // make_unique
+#include <stdexcept>   // invalid_argument
+#include <string>      // string
+#include <string_view> // string_view
+
+namespace backend {
+
+Engine::Engine(const key::Keypad& keypad, std::size_t depth):
+    observer_(),
+    backend_(keypad, depth),
+    decoder_(keypad),
+    instructions_(),
+    journal_(nullptr) {
+    backend_.Attach(&observer_);
+}
+
+TokenType Engine::Press(std::string_view keypress) {
+    instructions_.clear();
+    const auto key_type = decoder_.Decode(keypress, instructions_);
+    // keys that only type an operand change nothing yet
+    const bool journaled = journal_ && !instructions_.empty();
+    if (journaled)
+        journal_->Checkpoint();
+    try {
+        for (const auto& instruction: instructions_)
+            Execute(backend_, instruction);
+    } catch (const std::invalid_argument&) {
+        if (journaled)
+            journal_->Rollback();
+        // argument of STO/RCL: don't do anything and wait for next key
+        if (key_type != kTypeRegister)
+            throw;
+    } catch (...) {
+        if (journaled)
+            journal_->Rollback();
+        throw;
+    }
+    return key_type;
+}
+
+void Engine::EnableUndo(std::size_t max_bytes) {
+    journal_ = (max_bytes > 0) ? std::make_unique<Journal>(backend_, max_bytes) : nullptr;
+}
+
+bool Engine::Undo() {
+    decoder_.Reset();
+    return journal_ && journal_->Undo();
+}
+
+bool Engine::Redo() {
+    decoder_.Reset();
+    return journal_ && journal_->Redo();
+}
+
+double Engine::EvalString(std::string_view expression) {
+    const metrics::Scope scope(metrics::kSlotEvalString);
+    // every expression starts without a half-typed operand
+    decoder_.Reset();
+    Tokenizer tokenizer(expression);
+    std::string_view token;
+    // long keys such as LOG10 are reversed to their short key, e.g. L
+    while (tokenizer.Next(token))
+        Press(key::ShortKey(decoder_.keypad(), token));
+    return observer_.GetState().second.first;
+}
+
+} /* namespace backend */
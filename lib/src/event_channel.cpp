@@ -0,0 +1,113 @@
+#include "event_channel.hpp"
+#include <chrono>  // microseconds
+#include <string>  // string
+#include <thread>  // yield, sleep_for
+
+namespace backend {
+
+EventChannel::EventChannel(std::size_t capacity,
+                           OverflowPolicy policy,
+                           bool multi_producer):
+    mask_(0),
+    policy_(policy),
+    multi_producer_(multi_producer),
+    head_(0),
+    tail_(0),
+    dropped_(0),
+    has_pending_(false),
+    pending_{0, '\0', 0.0, 0.0} {
+    std::size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    mask_ = size - 1;
+    slots_ = std::make_unique<Slot[]>(size);
+    // slot i is free for the producer that pushes the i-th event
+    for (std::size_t i = 0; i < size; ++i)
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool EventChannel::PushFull(const Event& event) {
+    switch (policy_) {
+        case kOverflowBlock:
+            while (!TryPush(event))
+                std::this_thread::yield();
+            return true;
+        case kOverflowCoalesce:
+            Coalesce(event);
+            return true;
+        case kOverflowDrop:
+        default:
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+    }
+}
+
+void EventChannel::Coalesce(const Event& event) {
+    while (pending_lock_.test_and_set(std::memory_order_acquire))
+        std::this_thread::yield();
+    if (!has_pending_.load(std::memory_order_relaxed)) {
+        pending_ = event;
+    } else {
+        // the newest operation and registers win
+        if (event.kinds & kEventOperation)
+            pending_.operation = event.operation;
+        if (event.kinds & kEventRegisters) {
+            pending_.x = event.x;
+            pending_.y = event.y;
+        }
+        pending_.kinds |= event.kinds;
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    has_pending_.store(true, std::memory_order_release);
+    pending_lock_.clear(std::memory_order_release);
+}
+
+bool EventChannel::TakePending(Event& event) {
+    while (pending_lock_.test_and_set(std::memory_order_acquire))
+        std::this_thread::yield();
+    const bool taken = has_pending_.load(std::memory_order_relaxed);
+    if (taken) {
+        event = pending_;
+        has_pending_.store(false, std::memory_order_release);
+    }
+    pending_lock_.clear(std::memory_order_release);
+    return taken;
+}
+
+EventPump::EventPump(EventChannel& channel, IObserver& observer):
+    channel_(channel),
+    observer_(observer),
+    stop_(false),
+    thread_(&EventPump::Run, this) {}
+
+EventPump::~EventPump() {
+    stop_.store(true, std::memory_order_release);
+    thread_.join();
+}
+
+void EventPump::Forward(const Event& event) {
+    if (event.kinds & kEventOperation)
+        observer_.UpdateOperation(std::string(1, event.operation));
+    if (event.kinds & kEventRegisters)
+        observer_.UpdateRegisters(std::make_pair(event.x, event.y));
+}
+
+void EventPump::Run() {
+    auto forward = [this](const Event& event) { Forward(event); };
+    unsigned idle = 0;
+    while (!stop_.load(std::memory_order_acquire)) {
+        if (channel_.Consume(forward) > 0) {
+            idle = 0;
+        } else if (++idle < 64) {
+            std::this_thread::yield();
+        } else {
+            // nothing for a while; don't keep a core busy
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    // the events pushed before the pump was destroyed
+    while (channel_.Consume(forward) > 0)
+        ;
+}
+
+} /* namespace backend */
@@ -0,0 +1,113 @@
+#include "format.hpp"
+#include <charconv>     // to_chars, chars_format
+#include <cmath>        // fabs, isfinite
+#include <cfloat>       // DBL_MIN
+#include <cstring>      // memmove, memcpy, memset
+#include <system_error> // errc
+
+namespace format {
+
+char* Fixed(char* first, char* last, double num, int precision) {
+    const auto res = std::to_chars(first, last, num, std::chars_format::fixed, precision);
+    return (res.ec == std::errc()) ? res.ptr : nullptr;
+}
+
+char* Engineering(char* first, char* last, double num, int precision) {
+    if (!std::isfinite(num)) {
+        const auto res = std::to_chars(first, last, num);
+        return (res.ec == std::errc()) ? res.ptr : nullptr;
+    }
+    // e.g. -1.235000e-04; rounding the mantissa may carry into the
+    // exponent, which to_chars takes care of
+    char sci[kBufferSize];
+    const auto res = std::to_chars(sci, sci + sizeof(sci), num,
+                                   std::chars_format::scientific, precision);
+    if (res.ec != std::errc())
+        return nullptr;
+    const char* e = sci;
+    while (*e != 'e')
+        ++e;
+    // erase any trailing zeros of the mantissa
+    const char* mantissa_end = e;
+    while (mantissa_end - 1 > sci && mantissa_end[-1] == '0')
+        --mantissa_end;
+    // exponent without the plus sign and leading zeros
+    const char* exp = e + 1;
+    const bool negative = (*exp == '-');
+    ++exp;
+    while (exp + 1 < res.ptr && *exp == '0')
+        ++exp;
+    const std::size_t mantissa_len = mantissa_end - sci;
+    const std::size_t exp_len = res.ptr - exp;
+    if (static_cast<std::size_t>(last - first) < mantissa_len + 2 + negative + exp_len)
+        return nullptr;
+    std::memcpy(first, sci, mantissa_len);
+    first += mantissa_len;
+    *first++ = ' ';
+    *first++ = 'E';
+    if (negative)
+        *first++ = '-';
+    std::memcpy(first, exp, exp_len);
+    return first + exp_len;
+}
+
+char* Shortest(char* first, char* last, double num) {
+    const auto res = std::to_chars(first, last, num);
+    return (res.ec == std::errc()) ? res.ptr : nullptr;
+}
+
+char* PadLeft(char* first, char* end, char* last, std::size_t width) {
+    if (end == nullptr)
+        return nullptr;
+    const std::size_t len = end - first;
+    if (len >= width)
+        return end;
+    if (static_cast<std::size_t>(last - first) < width)
+        return nullptr;
+    const std::size_t pad = width - len;
+    std::memmove(first + pad, first, len);
+    std::memset(first, ' ', pad);
+    return first + width;
+}
+
+char* Display(char* first, char* last, double num, unsigned screen_width) {
+    const double abs = std::fabs(num);
+    char* end;
+    if (abs < DBL_MIN*100)
+        end = Fixed(first, last, num, 5);
+    else if (abs < 0.01)
+        end = Engineering(first, last, num, 6);
+    else if (abs < 1e3)
+        end = Fixed(first, last, num, 5);
+    else if (abs < 1e6)
+        end = Fixed(first, last, num, 1);
+    else if (abs < 1e12)
+        end = Engineering(first, last, num, 6);
+    else if (abs < 1e18)
+        end = Engineering(first, last, num, 7);
+    else
+        end = Engineering(first, last, num, 8);
+    // pad to overwrite the previous number without clearing the screen
+    return PadLeft(first, end, last, screen_width - 4);
+}
+
+char* GenRegister(char* first, char* last, double num, unsigned width) {
+    const double abs = std::fabs(num);
+    char* end;
+    if (abs < 1e-22) { // display zero for negligible values
+        end = (last - first >= 3) ? first + 3 : nullptr;
+        if (end != nullptr)
+            std::memcpy(first, "0.0", 3);
+    } else if (abs < 1e-3) {
+        end = Engineering(first, last, num, 2);
+    } else if (abs < 100) {
+        end = Fixed(first, last, num, 4);
+    } else if (abs < 1e6) {
+        end = Fixed(first, last, num, 1);
+    } else {
+        end = Engineering(first, last, num, 1);
+    }
+    return PadLeft(first, end, last, width - 1);
+}
+
+} // namespace format
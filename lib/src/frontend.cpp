@@ -1,138 +1,15 @@
 #include "keypad.hpp"
 #include "frontend.hpp"
+#include "format.hpp"
 #include <utility>      // make_pair, pair
 #include <string>       // to_string
 #include <iostream>     // cout 
-#include <sstream>      // cout 
-#include <iomanip>      // setprecision
-#include <ncurses.h>    // wrefresh, wprintw, etc.
+#include <ncurses.h>    // wnoutrefresh, doupdate, wprintw, etc.
 #include <termios.h>    // tcgetattr, tcsetattr
 #include <unistd.h>     // STDIN_FILENO
-#include <chrono>       // sleep_for, milliseconds
-#include <thread>       // this_thread
-#include <cfloat>       // DBL_MIN 
-#include <algorithm>    // max_element 
+#include <chrono>       // steady_clock, milliseconds
+#include <algorithm>    // max_element, min
                         
-//-------------------------------------------------------------//
-// Static helper functions                                     //
-//-------------------------------------------------------------//
-/**
- * @brief  Formats a number in fixed decimal precision format, e.g.
- *         with precision = 2:  
- *          3.14159 ->  3.14
- *         -3.1     -> -3.10
- *         NOTE: trailing zeros are preserved.
- *
- * @param num  A number in 64-bit signed double range
- * @param prec How many decimals to retain in the format 
- *
- * @return A number string formatted in fixed precision
- */
-static std::string FmtFixedPrecision(double num, unsigned prec = 5) {
-    std::ostringstream num_fmt;
-    num_fmt << std::fixed << std::setprecision(prec) << num;
-    auto num_fmt_string = num_fmt.str();
-    return num_fmt_string;
-}
-
-/**
- * @brief Pads the beginning of a string with spaces up to a specified 
- *        length.
- *
- * @param input Input string (read only)
- * @param N     The desired length
- *
- * @return The padded version of the input string
- */
-static std::string PadString(const std::string& input, std::size_t N) {
-    if (input.length() >= N) {
-        // No need to pad, return the original string
-        return input;
-    } else {
-        // Calculate the number of spaces needed
-        std::size_t spacesToAdd = N - input.length();
-        // Create a string of spaces
-        std::string padding(spacesToAdd, ' ');
-        // Concatenate the padding and the input string
-        return padding + input;
-    }
-}
-
-/**
- * @brief  Formats a number to a string that represents it in
- *         scientific format. The scientific format is defined as
- *         follows:  
- *         m * 10^E  
- *         m is the mantissa, with 1 <= |m| < 10. It can have a given
- *         precision of decimals. E is the exponent. Any trailing
- *         zeros are truncated from the mantissa, so 1.20 would
- *         become 1.2. Examples (`E-4` denotes `10^(-4)`):  
- *         @verbatim
- *          -.000123456, 3  -> -1.235 E-4 
- *          -.000123456, 14 -> -1.2356 E-4 
- *          123.12345,   2  ->  1.23, E2
- *          @endverbatim
- *
- * @param number    Number to convert
- * @param precision The number of decimals of the mantissa
- *
- * @return A string representing the number in scientific format:  
- *         m * 10^E
- */
-static std::string FmtEngineeringNotation(double number, int precision = 5) {
-    // order of magnitude (power of 10) of the number
-    const int magnitude = static_cast<int>(std::floor(
-                              std::log10(std::fabs(number))));
-    // the mantissa m (coefficient of the exponent)
-    const double mantissa = number / std::pow(10, magnitude);
-    // we will append the mantissa to an output string stream
-    std::ostringstream mantissa_fmt;
-    // then format it to the given precision
-    mantissa_fmt << std::fixed << std::setprecision(precision)
-                       << mantissa;
-    std::string mantissa_string = mantissa_fmt.str();
-    // erase any trailing zeros
-    mantissa_string.erase(mantissa_string.find_last_not_of('0') + 1, 
-                          std::string::npos); 
-    std::string scientific_fmt = mantissa_string + " E" + std::to_string(magnitude);
-    return scientific_fmt;
-}
-
-/**
- * @brief Formats a numbers base on its magnitude. It selects format
- *        (fixed precision/engineering) and number of decimals. The 
- *        scheme is somewhat arbitrary but works well for a 
- *        calculator.
- *
- * @param num          A number in 64-bit signed double range
- * @param screen_width Calculator's screen width. Required to pad 
- *                     the number with spaces and avoid redrawing 
- *                     with ncurses.
- *
- * @return A formatted number string 
- */
-static inline std::string FmtBasedOnRange(double num, unsigned screen_width) {
-    std::string ret = "";
-    const unsigned nspaces = screen_width - 4;
-    // below we pad with spaces to avoid having to redraw with ncurses
-    if (std::abs(num) < DBL_MIN*100)
-        ret = PadString(FmtFixedPrecision(num, 5), nspaces);
-    else  if (std::abs(num) < 0.01)
-        ret = PadString(FmtEngineeringNotation(num, 6), nspaces);
-    else if (std::abs(num) < 1e3)
-        ret = PadString(FmtFixedPrecision(num, 5), nspaces);
-    else if (std::abs(num) < 1e6)
-        ret = PadString(FmtFixedPrecision(num, 1), nspaces);
-    else if (std::abs(num) < 1e12)
-        ret = PadString(FmtEngineeringNotation(num, 6), nspaces);
-    else if (std::abs(num) < 1e18)
-        ret = PadString(FmtEngineeringNotation(num, 7), nspaces);
-    else
-        ret = ::PadString(FmtEngineeringNotation(num, 8), nspaces);
-    return ret;
-}
-
-
 namespace gui {
 //-------------------------------------------------------------//
 // Class methods                                               // 
@@ -145,7 +22,10 @@ Frontend::Frontend(const key::Keypad& keypad):
     max_width_pixels_(0),
     max_height_pixels_(0),
     dimensions_set_(false),
-    gen_reg_width_(12)
+    gen_reg_width_(12),
+    dirty_(false),
+    frame_interval_(std::chrono::milliseconds(16)),
+    last_frame_()
 {
     // state where each button is to be drawn
 	InitKeypadGrid();
@@ -153,6 +33,7 @@ Frontend::Frontend(const key::Keypad& keypad):
     InitTerminal();
     DrawKeypad();
     DrawDisplay();
+    Render(true);
 }
 
 Frontend::~Frontend() {
@@ -228,21 +109,19 @@ void Frontend::PrintGenRegister(const std::string& name, double val)  {
         xy = gen_regs_[ToUpper(name)];
     else // silently ignore errors
         return;
-    std::string val_str = "";
-    const auto nspaces = gen_reg_width_ - 1;
-    // select a scheme (format) to display general registers
-    if (std::fabs(val) < 1e-22) // display zero for negligible values
-        val_str = PadString("0.0", nspaces);
-    else if (std::fabs(val) < 1e-3)
-        val_str = PadString(::FmtEngineeringNotation(val, 2), nspaces);
-    else if (std::fabs(val) < 100)
-        val_str = PadString(::FmtFixedPrecision(val, 4), nspaces);
-    else if (std::fabs(val) < 1e6)
-        val_str = PadString(::FmtFixedPrecision(val, 1), nspaces);
-    else
-        val_str = PadString(::FmtEngineeringNotation(val, 1), nspaces);
+    char val_str[format::kBufferSize];
+    const char* end = format::GenRegister(val_str, val_str + sizeof(val_str),
+                                          val, gen_reg_width_);
+    if (end == nullptr)
+        return;
+    const std::size_t len = end - val_str;
+    auto& shown = shown_gen_regs_[key::GenRegIndex(name)];
+    if (shown.compare(0, std::string::npos, val_str, len) == 0)
+        return;
     wmove(win_, xy.y, xy.x+1);
-    wprintw(win_, val_str.c_str());
+    waddnstr(win_, val_str, len);
+    shown.assign(val_str, len);
+    dirty_ = true;
 }
 
 void Frontend::InitKeypadGrid() {
@@ -253,45 +132,13 @@ void Frontend::InitKeypadGrid() {
 }
 
 bool Frontend::DrawKey(const std::string& key, bool highlight) {
-    const auto it1 = keypad_.stack_keys.find(key);
-    const auto it2 = keypad_.single_arg_keys.find(key);
-    const auto it3 = keypad_.double_arg_keys.find(key);
-    const auto it4 = keypad_.storage_keys.find(key);
-    const auto it5 = keypad_.eex_key.find(key);
+    const auto& entry = key::LookupKey(keypad_, key);
     // whether the keypress corresponds to a key in the keypad
-    bool found = false;
-
-    key::Point grid_pos{0, 0};
-    std::string text_on_key = "";
-    // search which map key belongs to and get the info from there
-    if (it1 != keypad_.stack_keys.end()) {
-        grid_pos = it1->second.point;
-        text_on_key = key::AnnotateKey(
-               it1, key);
-        found = true;
-    } else if (it2 != keypad_.single_arg_keys.end()) {
-        grid_pos = it2->second.point;
-        text_on_key = key::AnnotateKey(
-               it2, key);
-        found = true;
-    } else if (it3 != keypad_.double_arg_keys.end()) {
-        grid_pos = it3->second.point;
-        text_on_key = key::AnnotateKey(
-               it3, key);
-        found = true;
-    } else if (it4 != keypad_.storage_keys.end()) {
-        grid_pos = it4->second.point;
-        text_on_key = key::AnnotateKey(
-               it4, key);
-        found = true;
-    } else if (it5 != keypad_.eex_key.end()) {
-        grid_pos = it5->second.point;
-        text_on_key = key::AnnotateKey(
-               it5, key);
-        found = true;
-    }
+    const bool found = entry.category != key::kCategoryNone;
     if (!found)
         return found;
+    const key::Point grid_pos = entry.point;
+    const std::string text_on_key = key::AnnotateKey(*entry.annotation, key);
 
     //Point grid_pos = key_mappings_[key].second;
     Point top_left_coords {grid_pos.x * Frontend::key_width_ + 1,
@@ -306,13 +153,70 @@ bool Frontend::DrawKey(const std::string& key, bool highlight) {
 
 bool Frontend::HighlightKey(const std::string& key,
                             std::chrono::milliseconds ms) {
-    bool found = false;
-    found = DrawKey(key, true);
-    std::this_thread::sleep_for(ms);
-    DrawKey(key);
+    const bool found = DrawKey(key, true);
+    if (!found)
+        return found;
+    const auto expiry = std::chrono::steady_clock::now() + ms;
+    for (auto& highlight: highlights_) {
+        if (highlight.key == key) {
+            highlight.expiry = expiry;
+            return found;
+        }
+    }
+    highlights_.push_back(Highlight{key, expiry});
     return found;
 }
 
+void Frontend::ExpireHighlights() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = highlights_.begin(); it != highlights_.end(); ) {
+        if (it->expiry <= now) {
+            DrawKey(it->key);
+            it = highlights_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int Frontend::MsToNextExpiry() const {
+    if (highlights_.empty())
+        return -1;
+    auto next = highlights_.front().expiry;
+    for (const auto& highlight: highlights_)
+        next = std::min(next, highlight.expiry);
+    const auto left = next - std::chrono::steady_clock::now();
+    if (left <= left.zero())
+        return 0;
+    // round up so that waiting that long always reaches the expiry
+    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(left).count());
+}
+
+void Frontend::Render(bool force) {
+    if (!dirty_)
+        return;
+    const auto now = std::chrono::steady_clock::now();
+    if (!force && now - last_frame_ < frame_interval_)
+        return;
+    // copy the window to the virtual screen and send the difference
+    // between that and the terminal in one go
+    wnoutrefresh(win_);
+    doupdate();
+    last_frame_ = now;
+    dirty_ = false;
+}
+
+int Frontend::MsToNextUpdate() const {
+    int ms = MsToNextExpiry();
+    if (dirty_) {
+        const auto left = last_frame_ + frame_interval_ - std::chrono::steady_clock::now();
+        const int frame_ms = (left <= left.zero()) ? 0 :
+            static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(left).count());
+        ms = (ms < 0) ? frame_ms : std::min(ms, frame_ms);
+    }
+    return ms;
+}
+
 void Frontend::DrawBox(const std::string& text,
                           const Point& coords,
                           bool highlight) {
@@ -352,7 +256,7 @@ void Frontend::DrawBox(const std::string& text,
     wmove(win_, y+1, x+2);
     wprintw(win_, text.c_str());
 
-    wrefresh(win_);
+    dirty_ = true;
     // turn off highlighting
     if (highlight)
         wattroff(win_, A_BOLD);
@@ -459,22 +363,33 @@ bool Frontend::DrawDisplay() {
     wvline(win_, '|', 4);
     wmove(win_, 2, screen_width_ - 1);
     wvline(win_, '|', 4);
-    wrefresh(win_);
+    dirty_ = true;
     return dimensions_set_;
 }
 
 bool Frontend::PrintRegisters(double regx, double regy) {
-    // make sure that they're represented concisely on the screen
-    // by choosing format based on their range
-    std::string regx_str= ::FmtBasedOnRange(regx, screen_width_);
-    std::string regy_str= ::FmtBasedOnRange(regy, screen_width_);
     // top screen row
-    wmove(win_, 3, 3);
-    wprintw(win_, regy_str.c_str());
+    PrintRegister(3, regy, shown_regy_);
     // bottom screen row
-    wmove(win_, 4, 3);
-    wprintw(win_, regx_str.c_str());
-    wrefresh(win_);
+    PrintRegister(4, regx, shown_regx_);
     return dimensions_set_;
 }
+
+void Frontend::PrintRegister(int row, double val, std::string& shown) {
+    // make sure that it's represented concisely on the screen by
+    // choosing format based on its range
+    char val_str[format::kBufferSize];
+    const char* end = format::Display(val_str, val_str + sizeof(val_str),
+                                      val, screen_width_);
+    if (end == nullptr)
+        return;
+    const std::size_t len = end - val_str;
+    if (shown.compare(0, std::string::npos, val_str, len) == 0)
+        return;
+    wmove(win_, row, 3);
+    waddnstr(win_, val_str, len);
+    // no allocation once the string has grown to a screen's width
+    shown.assign(val_str, len);
+    dirty_ = true;
+}
 } // namespace gui
@@ -0,0 +1,102 @@
+#include "incremental.hpp"
+#include "backend.hpp"
+#include "decoder.hpp"
+#include "keypad.hpp"
+#include "tokenizer.hpp"
+#include <algorithm> // upper_bound, min
+#include <stdexcept> // invalid_argument
+
+namespace backend {
+
+IncrementalEvaluator::IncrementalEvaluator(const key::Keypad& keypad, std::size_t depth,
+                                           std::size_t interval):
+    keypad_(keypad),
+    backend_(keypad, depth),
+    decoder_(keypad),
+    interval_(interval == 0 ? 1 : interval),
+    state_bytes_(backend_.StateSize()),
+    keys_(),
+    offsets_({0}),
+    states_(state_bytes_),
+    changed_(0),
+    evaluated_(true),
+    result_(0.0),
+    pressed_(0) {
+    backend_.SaveState(states_.data());
+}
+
+void IncrementalEvaluator::Invalidate(std::size_t index) {
+    changed_ = std::min(changed_, index);
+    evaluated_ = false;
+}
+
+void IncrementalEvaluator::Edit(std::size_t index, std::string_view key) {
+    keys_.at(index) = key::ShortKey(keypad_, key);
+    Invalidate(index);
+}
+
+double IncrementalEvaluator::Eval(std::string_view expression) {
+    Tokenizer tokenizer(expression);
+    std::string_view token;
+    std::size_t count = 0;
+    // long keys such as LOG10 are reversed to their short key, e.g. L
+    while (tokenizer.Next(token)) {
+        const auto key = key::ShortKey(keypad_, token);
+        if (count == keys_.size()) {
+            keys_.emplace_back(key);
+            Invalidate(count);
+        } else if (keys_[count] != key) {
+            keys_[count] = key;
+            Invalidate(count);
+        }
+        ++count;
+    }
+    if (count < keys_.size()) {
+        keys_.resize(count);
+        Invalidate(count);
+    }
+    return Eval();
+}
+
+double IncrementalEvaluator::Eval() {
+    pressed_ = 0;
+    if (evaluated_)
+        return result_;
+    // the states saved before the first changed key are still valid
+    const std::size_t kept = std::upper_bound(offsets_.begin(), offsets_.end(), changed_) -
+                             offsets_.begin();
+    offsets_.resize(kept);
+    states_.resize(kept * state_bytes_);
+    backend_.LoadState(&states_[(kept - 1) * state_bytes_]);
+    decoder_.Reset();
+    for (std::size_t i = offsets_.back(); i < keys_.size(); ++i) {
+        // if the key throws, the next evaluation resumes before it
+        changed_ = i;
+        Press(keys_[i]);
+        ++pressed_;
+        if (i + 1 - offsets_.back() >= interval_ && decoder_.idle()) {
+            offsets_.push_back(i + 1);
+            states_.resize(states_.size() + state_bytes_);
+            backend_.SaveState(&states_[states_.size() - state_bytes_]);
+        }
+    }
+    changed_ = keys_.size();
+    evaluated_ = true;
+    result_ = backend_.Peek().first;
+    return result_;
+}
+
+void IncrementalEvaluator::Press(std::string_view key) {
+    instructions_.clear();
+    const auto key_type = decoder_.Decode(key, instructions_);
+    try {
+        for (const auto& instruction: instructions_)
+            Execute(backend_, instruction);
+    } catch (const std::invalid_argument&) {
+        // argument of STO/RCL: don't do anything and wait for next key
+        if (key_type != kTypeRegister)
+            throw;
+    }
+}
+
+} /* namespace backend */
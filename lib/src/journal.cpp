@@ -0,0 +1,59 @@
+#include "journal.hpp"
+#include "backend.hpp"
+
+namespace backend {
+
+Journal::Journal(Backend& backend, std::size_t max_bytes):
+    backend_(backend),
+    state_bytes_(backend.StateSize()),
+    capacity_(max_bytes / state_bytes_ < 2 ? 2 : max_bytes / state_bytes_),
+    states_(capacity_ * state_bytes_),
+    first_(0),
+    size_(0),
+    cursor_(0) {}
+
+void Journal::Push() {
+    if (size_ == capacity_) {
+        first_ = (first_ + 1 == capacity_) ? 0 : first_ + 1;
+        --size_;
+        if (cursor_ > 0)
+            --cursor_;
+    }
+    backend_.SaveState(State(size_++));
+}
+
+void Journal::Checkpoint() {
+    // a new change forks the history
+    size_ = cursor_;
+    Push();
+    cursor_ = size_;
+}
+
+bool Journal::Rollback() {
+    if (cursor_ == 0)
+        return false;
+    backend_.LoadState(State(--cursor_));
+    size_ = cursor_;
+    return true;
+}
+
+bool Journal::Undo() {
+    if (cursor_ == 0)
+        return false;
+    if (cursor_ == size_) {
+        // keep the current state to redo to
+        Push();
+        cursor_ = size_ - 1;
+    }
+    backend_.LoadState(State(--cursor_));
+    return true;
+}
+
+bool Journal::Redo() {
+    if (cursor_ + 1 >= size_)
+        return false;
+    backend_.LoadState(State(++cursor_));
+    return true;
+}
+
+} /* namespace backend */
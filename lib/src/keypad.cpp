@@ -1,8 +1,20 @@
 #include "keypad.hpp" 
 #include "backend.hpp" 
+#include "static_keypad.hpp"
+#include <algorithm> // max, transform
 
 namespace key {
 
+int GenRegIndex(const std::string& name) {
+    std::string upper = name, lower = name;
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    for (std::size_t i = 0; i < kNamesGenRegs.size(); ++i)
+        if (kNamesGenRegs[i] == upper || kNamesGenRegs[i] == lower)
+            return static_cast<int>(i);
+    return -1;
+}
+
 static const StackKeys stack_keys = {
     {kKeyRdn, StackKeyInfo { 
         [](backend::Backend& b) -> void { b.Rdn(); },
@@ -45,73 +57,67 @@ static const StackKeys stack_keys = {
 // Single-argument numeric functions
 //----------------------------------------------------------------
 
-static inline double Deg2Rad(double deg) {
-    return deg * M_PI / 180.0;
-}
-
-static inline double Rad2Deg(double rad) {
-    return rad * 180.0 / M_PI;;
-}
+// see key::fn in static_keypad.hpp for the implementations
 
 // Calculate
 static const SingleArgKeys single_arg_keys = {
     {kKeyChs, SingleKeyInfo {
-        [](double x) -> double { return -x; },
+        fn::Chs,
         "chs",
         Point{1, 4},
         "CHS"}},
     {kKeyInv, SingleKeyInfo { 
-        [](double x) -> double { return 1/x; },
+        fn::Inv,
         "1/x",
         Point{0, 3},
         "INV"}},
     {kKeySin, SingleKeyInfo { 
-        [](double x) -> double { return sin(Deg2Rad(x)); },
+        fn::Sin,
         "sin",
         Point{1, 1},
         "SIN"}},
     {kKeyCos, SingleKeyInfo { 
-        [](double x) -> double { return cos(Deg2Rad(x)); },
+        fn::Cos,
         "cos",
         Point{2, 1},
         "COS"}},
     {kKeyTan, SingleKeyInfo { 
-        [](double x) -> double { return tan(Deg2Rad(x)); },
+        fn::Tan,
         "tan",
         Point{3, 1},
         "TAN"}},
     {kKeyAsin, SingleKeyInfo { 
-        [](double x) -> double { return Rad2Deg(asin(x)); },
+        fn::Asin,
         "asin",
         Point{1, 2},
         "ASIN"}},
     {kKeyAcos, SingleKeyInfo { 
-        [](double x) -> double { return Rad2Deg(acos(x)); },
+        fn::Acos,
         "acos",
         Point{2, 2},
         "ACOS"}},
     {kKeyAtan, SingleKeyInfo { 
-        [](double x) -> double { return Rad2Deg(atan(x)); },
+        fn::Atan,
         "atan",
         Point{3, 2},
         "ATAN"}},
     {kKeyExp, SingleKeyInfo { 
-        [](double x) -> double { return exp(x); },
+        fn::Exp,
         "e^x",
         Point{3, 0},
         "EXP"}},
     {kKeyLn, SingleKeyInfo { 
-        [](double x) -> double { return log(x); },
+        fn::Ln,
         "ln",
         Point{2, 0},
         "LN"}},
     {kKeyLog10, SingleKeyInfo { 
-        [](double x) -> double { return log10(x); },
+        fn::Log10,
         "log10",
         Point{1, 0},
         "LOG10"}},
     {kKeySqrt, SingleKeyInfo { 
-        [](double x) -> double { return sqrt(x); },
+        fn::Sqrt,
         "sqrt",
         Point{0, 1},
         "SQRT"}},
@@ -122,30 +128,27 @@ static const SingleArgKeys single_arg_keys = {
 //----------------------------------------------------------------
 static const DoubleArgKeys double_arg_keys = {
     {kKeyPlus, DoubleKeyInfo { 
-        [](double x, double y) -> double { return x + y; },
+        fn::Plus,
         "+",
         Point{0, 5},
         "+"}},
     {kKeyMinus, DoubleKeyInfo { 
-        [](double x, double y) -> double { return y - x; },
+        fn::Minus,
         "y-x",
         Point{1, 5},
         "-"}},
     {kKeyMul, DoubleKeyInfo { 
-        [](double x, double y) -> double { return x * y; },
+        fn::Mul,
         "*",
         Point{2, 5},
         "*"}},
     {kKeyDiv, DoubleKeyInfo {
-        [](double x, double y) -> double {
-            if (std::fabs(x) < 1e-10)
-                throw std::invalid_argument("[FATAL]: Backend: Division by zero.\n");
-            return y/x; },
+        fn::Div,
         "y/x",
         Point{3, 5},
         "/"}},
     {kKeyPower, DoubleKeyInfo { 
-        [](double x, double y) -> double { return pow(x, y); },
+        fn::Power,
         "x^y",
         Point{4, 5},
         "^"}}
@@ -194,16 +197,86 @@ static std::unordered_map<std::string, std::string> reverse_keys = []{
         ret[pair.second.long_key] = pair.first;
     for (const auto& pair: double_arg_keys)
         ret[pair.second.long_key] = pair.first;
+    for (const auto& pair: storage_keys)
+        ret[pair.second.long_key] = pair.first;
     for (const auto& pair: eex_key)
         ret[pair.second.long_key] = pair.first;
     return ret;
 }();
 
-const Keypad keypad{stack_keys,
+std::string_view ShortKey(const Keypad& keypad, std::string_view token) {
+    // longer tokens, e.g. numbers with many digits, can't be long keys;
+    // skip them so that building the key to look up doesn't allocate
+    if (token.size() > keypad.longest_long_key)
+        return token;
+    const auto it = keypad.reverse_keys.find(std::string(token));
+    if (it != keypad.reverse_keys.end())
+        return it->second;
+    return token;
+}
+
+KeyTable CompileKeyTable(const Keypad& keypad) {
+    KeyTable table;
+    table.fill(KeyEntry{kCategoryNone, 0, Point{0, 0},
+                        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr});
+    // the entry of a single character key; nullptr for longer keys
+    auto Entry = [&table](const std::string& keypress) -> KeyEntry* {
+        if (keypress.size() != 1)
+            return nullptr;
+        return &table[static_cast<unsigned char>(keypress[0])];
+    };
+    for (const auto& pair: keypad.stack_keys)
+        if (auto entry = Entry(pair.first))
+            *entry = KeyEntry{kCategoryStack, 0, pair.second.point,
+                              &pair.second.annotation,
+                              &pair.second, nullptr, nullptr, nullptr, nullptr};
+    for (const auto& pair: keypad.single_arg_keys)
+        if (auto entry = Entry(pair.first))
+            *entry = KeyEntry{kCategorySingleArg, 1, pair.second.point,
+                              &pair.second.annotation,
+                              nullptr, &pair.second, nullptr, nullptr, nullptr};
+    for (const auto& pair: keypad.double_arg_keys)
+        if (auto entry = Entry(pair.first))
+            *entry = KeyEntry{kCategoryDoubleArg, 2, pair.second.point,
+                              &pair.second.annotation,
+                              nullptr, nullptr, &pair.second, nullptr, nullptr};
+    for (const auto& pair: keypad.storage_keys)
+        if (auto entry = Entry(pair.first))
+            *entry = KeyEntry{kCategoryStorage, 0, pair.second.point,
+                              &pair.second.annotation,
+                              nullptr, nullptr, nullptr, &pair.second, nullptr};
+    for (const auto& pair: keypad.eex_key)
+        if (auto entry = Entry(pair.first))
+            *entry = KeyEntry{kCategoryEex, 0, pair.second.point,
+                              &pair.second.annotation,
+                              nullptr, nullptr, nullptr, nullptr, &pair.second};
+    return table;
+}
+
+Keypad::Keypad(const StackKeys& stack_keys,
+               const SingleArgKeys& single_arg_keys,
+               const DoubleArgKeys& double_arg_keys,
+               const StorageKeys& storage_keys,
+               const EexKey& eex_key,
+               const std::unordered_map<std::string, std::string>& reverse_keys):
+    stack_keys(stack_keys),
+    single_arg_keys(single_arg_keys),
+    double_arg_keys(double_arg_keys),
+    storage_keys(storage_keys),
+    eex_key(eex_key),
+    reverse_keys(reverse_keys),
+    longest_long_key(0),
+    // the maps are in place by now
+    table(CompileKeyTable(*this)) {
+    for (const auto& pair: this->reverse_keys)
+        longest_long_key = std::max(longest_long_key, pair.first.size());
+}
+
+const Keypad keypad(stack_keys,
                     single_arg_keys,
                     double_arg_keys,
                     storage_keys,
                     eex_key,
-                    reverse_keys};
+                    reverse_keys);
 
 } // namespace key
@@ -0,0 +1,227 @@
+#include "metrics.hpp"
+#include <algorithm> // max, find
+#include <atomic>    // atomic
+#include <cctype>    // isprint
+#include <cstdio>    // snprintf
+#include <memory>    // unique_ptr, make_unique
+#include <mutex>     // mutex, lock_guard
+#include <vector>    // vector
+
+namespace metrics {
+
+namespace {
+
+/**
+ * @brief One thread's counters of an operation. Only the thread
+ *        increments them; they're atomic so that snapshots can read
+ *        them and `Reset` can zero them.
+ */
+struct alignas(64) OperationCounters {
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> exceptions{0};
+    std::array<std::atomic<std::uint64_t>, kBuckets> latency{};
+};
+
+struct ThreadCounters {
+    std::array<OperationCounters, kSlots> ops;
+};
+
+/** @brief The counters of the live threads and those of the finished ones */
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadCounters*> live;
+    Snapshot retired;
+};
+
+Registry& GetRegistry() {
+    // never destroyed so that threads finishing after main can still
+    // retire their counters
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+void Add(Snapshot& snapshot, const ThreadCounters& counters) {
+    for (std::size_t slot = 0; slot < kSlots; ++slot) {
+        const auto& from = counters.ops[slot];
+        auto& to = snapshot.ops[slot];
+        to.calls += from.calls.load(std::memory_order_relaxed);
+        to.exceptions += from.exceptions.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < kBuckets; ++i)
+            to.latency[i] += from.latency[i].load(std::memory_order_relaxed);
+    }
+}
+
+/** @brief Registers a thread's counters on its first call; retires them when it exits */
+class LocalCounters {
+public:
+    LocalCounters(): counters_(std::make_unique<ThreadCounters>()) {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(counters_.get());
+    }
+    ~LocalCounters() {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        Add(registry.retired, *counters_);
+        registry.live.erase(std::find(registry.live.begin(), registry.live.end(),
+                                      counters_.get()));
+    }
+    ThreadCounters& get() { return *counters_; }
+
+private:
+    std::unique_ptr<ThreadCounters> counters_;
+};
+
+inline void Increment(std::atomic<std::uint64_t>& counter) {
+    // uncontended since only this thread writes the counter; atomic
+    // so that a concurrent Reset isn't overwritten
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+/** @return The histogram bucket of a latency: the bit width of `ns` */
+inline std::size_t Bucket(std::uint64_t ns) {
+    std::size_t bucket = 0;
+    while (ns != 0 && bucket < kBuckets - 1) {
+        ns >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+/** @return A slot's name, e.g. `SIN`, or its byte, e.g. `0x0a`, if it isn't a key */
+std::string SlotName(const key::Keypad& keypad, std::size_t slot) {
+    if (slot == kSlotInsert)
+        return "INSERT";
+    if (slot == kSlotEvalString)
+        return "EVAL";
+    if (slot == kSlotUnknown)
+        return "UNKNOWN";
+    const auto& entry = key::LookupKey(keypad, std::string(1, static_cast<char>(slot)));
+    switch (entry.category) {
+        case key::kCategoryStack:     return entry.stack->long_key;
+        case key::kCategorySingleArg: return entry.single_arg->long_key;
+        case key::kCategoryDoubleArg: return entry.double_arg->long_key;
+        case key::kCategoryStorage:   return entry.storage->long_key;
+        case key::kCategoryEex:       return entry.eex->long_key;
+        default:                      break;
+    }
+    char name[24];
+    if (std::isprint(static_cast<int>(slot)))
+        std::snprintf(name, sizeof(name), "%c", static_cast<char>(slot));
+    else
+        std::snprintf(name, sizeof(name), "0x%02zx", slot);
+    return name;
+}
+
+} // namespace
+
+void Record(std::size_t slot, std::uint64_t ns, bool threw) {
+    static thread_local LocalCounters local;
+    auto& counters = local.get().ops[slot];
+    Increment(counters.calls);
+    if (threw)
+        Increment(counters.exceptions);
+    Increment(counters.latency[Bucket(ns)]);
+}
+
+Snapshot TakeSnapshot() {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Snapshot snapshot = registry.retired;
+    for (const auto* counters: registry.live)
+        Add(snapshot, *counters);
+    return snapshot;
+}
+
+void Reset() {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.retired = Snapshot();
+    for (auto* counters: registry.live) {
+        for (auto& op: counters->ops) {
+            op.calls.store(0, std::memory_order_relaxed);
+            op.exceptions.store(0, std::memory_order_relaxed);
+            for (auto& bucket: op.latency)
+                bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+double Snapshot::Percentile(std::size_t slot, double p) const {
+    const auto& op = ops[slot];
+    std::uint64_t total = 0;
+    for (const auto count: op.latency)
+        total += count;
+    if (total == 0)
+        return 0.0;
+    // the rank of the percentile, at least the first call
+    const double rank = std::max(1.0, p / 100.0 * total);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        seen += op.latency[i];
+        if (seen >= rank)
+            return static_cast<double>(1ULL << i);
+    }
+    return static_cast<double>(1ULL << (kBuckets - 1));
+}
+
+std::string Snapshot::ToText(const key::Keypad& keypad) const {
+    std::string text;
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-10s %12s %10s %10s %10s %10s\n",
+                  "operation", "calls", "exceptions", "p50 ns", "p90 ns", "p99 ns");
+    text += line;
+    for (std::size_t slot = 0; slot < kSlots; ++slot) {
+        if (ops[slot].calls == 0)
+            continue;
+        std::snprintf(line, sizeof(line), "%-10s %12llu %10llu %10.0f %10.0f %10.0f\n",
+                      SlotName(keypad, slot).c_str(),
+                      static_cast<unsigned long long>(ops[slot].calls),
+                      static_cast<unsigned long long>(ops[slot].exceptions),
+                      Percentile(slot, 50), Percentile(slot, 90), Percentile(slot, 99));
+        text += line;
+    }
+    return text;
+}
+
+std::string Snapshot::ToJson(const key::Keypad& keypad) const {
+    std::string json = "{\"operations\": [";
+    char field[96];
+    bool first = true;
+    for (std::size_t slot = 0; slot < kSlots; ++slot) {
+        const auto& op = ops[slot];
+        if (op.calls == 0)
+            continue;
+        json += first ? "\n" : ",\n";
+        first = false;
+        // names are printable so only the quote and the backslash
+        // need escaping
+        std::string name = SlotName(keypad, slot);
+        if (name == "\"" || name == "\\")
+            name = "\\" + name;
+        json += "  {\"name\": \"" + name + "\"";
+        std::snprintf(field, sizeof(field),
+                      ", \"calls\": %llu, \"exceptions\": %llu",
+                      static_cast<unsigned long long>(op.calls),
+                      static_cast<unsigned long long>(op.exceptions));
+        json += field;
+        std::snprintf(field, sizeof(field),
+                      ", \"p50_ns\": %.0f, \"p90_ns\": %.0f, \"p99_ns\": %.0f",
+                      Percentile(slot, 50), Percentile(slot, 90), Percentile(slot, 99));
+        json += field;
+        std::size_t last = kBuckets;
+        while (last > 0 && op.latency[last - 1] == 0)
+            --last;
+        json += ", \"histogram\": [";
+        for (std::size_t i = 0; i < last; ++i) {
+            std::snprintf(field, sizeof(field), "%s%llu", i ? ", " : "",
+                          static_cast<unsigned long long>(op.latency[i]));
+            json += field;
+        }
+        json += "]}";
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+} // namespace metrics
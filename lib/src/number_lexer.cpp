@@ -0,0 +1,38 @@
+#include "number_lexer.hpp"
+#include <charconv>     // from_chars
+#include <cstdlib>      // strtod
+#include <system_error> // errc
+
+namespace backend {
+
+bool NumberLexer::Append(std::string_view chars) {
+    State state = state_;
+    for (const char c: chars) {
+        state = Next(state, c);
+        if (state == kStateStart)
+            return false;
+    }
+    if (!IsComplete(state))
+        return false;
+    text_.append(chars);
+    state_ = state;
+    return true;
+}
+
+double NumberLexer::Value() const {
+    if (text_.empty())
+        return 0.0;
+    const char* first = text_.data();
+    const char* last = text_.data() + text_.size();
+    // from_chars doesn't take a plus sign
+    if (*first == '+')
+        ++first;
+    double value = 0.0;
+    const auto result = std::from_chars(first, last, value);
+    if (result.ec == std::errc::result_out_of_range)
+        // strtod saturates to inf or rounds to (sub)normal/zero
+        value = std::strtod(text_.c_str(), nullptr);
+    return value;
+}
+
+} /* namespace backend */
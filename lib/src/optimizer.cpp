@@ -0,0 +1,286 @@
+#include "optimizer.hpp"
+#include "decoder.hpp"
+#include "keypad.hpp"
+#include "program.hpp"
+#include <algorithm> // max
+#include <cmath>     // M_PI
+#include <exception> // exception
+#include <string>    // string
+#include <utility>   // swap, move
+#include <vector>    // vector
+
+namespace backend {
+
+namespace {
+
+/**
+ * @brief The flags before an instruction, as far as the program alone
+ *        determines them. EEX is assumed not to be pending at the
+ *        start so it's always known; the lift flag is known after
+ *        the first key that sets it.
+ */
+typedef struct {
+    bool shift_up_known;
+    bool shift_up;
+    bool eex_pressed;
+} KnownFlags;
+
+/** @brief Updates the flags as the `Backend` method of an instruction does */
+void Step(KnownFlags& flags, const Instruction& instruction) {
+    switch (instruction.opcode) {
+        case kOpInsert:
+        case kOpPi:
+        case kOpConstant:
+            flags = {true, true, false};
+            break;
+        case kOpEnter:
+        case kOpClr:
+            flags = {true, false, false};
+            break;
+        case kOpRdn:
+        case kOpSwap:
+        case kOpLastX:
+            flags.eex_pressed = false;
+            break;
+        case kOpClx:
+            flags.shift_up_known = true;
+            flags.shift_up = false;
+            break;
+        case kOpEex:
+            flags = {true, false, true};
+            break;
+        case kOpSto:
+        case kOpRcl:
+            // invalid registers are ignored
+            if (key::GenRegIndex(instruction.key) >= 0)
+                flags = {true, true, false};
+            break;
+        case kOpSingleArg:
+        case kOpDoubleArg:
+        case kOpMultiplyAdd:
+            flags.shift_up_known = true;
+            flags.shift_up = true;
+            break;
+    }
+}
+
+/** @brief Whether an instruction is a numeric key of `key::keypad` */
+bool IsKey(const Instruction& instruction, const std::string& name) {
+    const auto& entry = key::LookupKey(key::keypad, name);
+    if (instruction.opcode == kOpSingleArg)
+        return entry.single_arg != nullptr &&
+               &entry.single_arg->function == instruction.single_arg;
+    if (instruction.opcode == kOpDoubleArg)
+        return entry.double_arg != nullptr &&
+               &entry.double_arg->function == instruction.double_arg;
+    return false;
+}
+
+bool WritesLastX(const Instruction& instruction) {
+    switch (instruction.opcode) {
+        case kOpSingleArg:
+        case kOpDoubleArg:
+        case kOpConstant:
+        case kOpMultiplyAdd:
+            return true;
+        case kOpRcl:
+            return key::GenRegIndex(instruction.key) >= 0;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Follows the keys from `begin` as long as they only compute
+ *        with numbers they inserted themselves.
+ *
+ * @param in     Instructions
+ * @param begin  Instruction to start from
+ * @param depth  Fewest levels of the stack
+ * @param folded Written with the `kOpConstant` of the longest run of
+ *               keys that ends with a single number in the stack
+ *
+ * @return The end of the keys folded into `folded`, or `begin` if
+ *         there are none
+ */
+std::size_t Fold(const std::vector<Instruction>& in, std::size_t begin,
+                 std::size_t depth, Instruction& folded) {
+    const auto Number = [](const Instruction& instruction) {
+        return (instruction.opcode == kOpPi) ? M_PI : instruction.operand;
+    };
+    if (in[begin].opcode != kOpInsert && in[begin].opcode != kOpPi)
+        return begin;
+    // the numbers in the stack from X up; the levels above them hold
+    // the stack the keys started with
+    std::vector<double> numbers = {Number(in[begin])};
+    bool shift_up = true;
+    double lastx = 0.0;
+    std::size_t lifts = 0;
+    std::size_t end = begin;
+    for (std::size_t i = begin + 1; i < in.size(); ++i) {
+        const auto& instruction = in[i];
+        bool computed = false;
+        try {
+            if (instruction.opcode == kOpInsert || instruction.opcode == kOpPi) {
+                if (shift_up)
+                    numbers.insert(numbers.begin(), Number(instruction));
+                else
+                    numbers[0] = Number(instruction);
+                shift_up = true;
+            } else if (instruction.opcode == kOpEnter) {
+                numbers.insert(numbers.begin(), numbers[0]);
+                shift_up = false;
+            } else if (instruction.opcode == kOpClx) {
+                numbers[0] = 0.0;
+                shift_up = false;
+            } else if (instruction.opcode == kOpSwap && numbers.size() >= 2) {
+                std::swap(numbers[0], numbers[1]);
+            } else if (instruction.opcode == kOpSingleArg) {
+                const double result = (*instruction.single_arg)(numbers[0]);
+                lastx = numbers[0];
+                numbers[0] = result;
+                shift_up = true;
+                computed = true;
+            } else if (instruction.opcode == kOpDoubleArg && numbers.size() >= 2) {
+                const double result = (*instruction.double_arg)(numbers[0], numbers[1]);
+                lastx = numbers[0];
+                numbers.erase(numbers.begin());
+                numbers[0] = result;
+                shift_up = true;
+                computed = true;
+            } else {
+                // reads the stack the keys started with, LASTX etc.
+                break;
+            }
+        } catch (const std::exception&) {
+            // leave it to throw when the program runs
+            break;
+        }
+        // a stack full of numbers would replicate one into T
+        if (numbers.size() >= depth)
+            break;
+        lifts = std::max(lifts, numbers.size() - 1);
+        if (computed && numbers.size() == 1) {
+            end = i + 1;
+            folded = Instruction{kOpConstant, numbers[0], false, "", nullptr, nullptr,
+                                 lastx, static_cast<unsigned>(lifts)};
+        }
+    }
+    return end;
+}
+
+std::vector<Instruction> FoldConstants(const std::vector<Instruction>& in,
+                                       std::size_t depth) {
+    std::vector<Instruction> out;
+    KnownFlags flags = {false, false, false};
+    std::size_t i = 0;
+    while (i < in.size()) {
+        Instruction folded;
+        // the first number would be an exponent
+        const std::size_t end = flags.eex_pressed ? i : Fold(in, i, depth, folded);
+        if (end > i) {
+            out.push_back(folded);
+            Step(flags, folded);
+            i = end;
+        } else {
+            out.push_back(in[i]);
+            Step(flags, in[i]);
+            ++i;
+        }
+    }
+    return out;
+}
+
+std::vector<Instruction> RemoveNoops(const std::vector<Instruction>& in) {
+    const std::size_t n = in.size();
+    // flags before each instruction
+    std::vector<KnownFlags> flags(n);
+    KnownFlags known = {false, false, false};
+    for (std::size_t i = 0; i < n; ++i) {
+        flags[i] = known;
+        Step(known, in[i]);
+    }
+    // whether LASTX after each instruction may still be read; it's
+    // part of the result at the end
+    std::vector<bool> lastx_live(n);
+    bool live = true;
+    for (std::size_t i = n; i-- > 0;) {
+        lastx_live[i] = live;
+        if (in[i].opcode == kOpLastX)
+            live = true;
+        else if (WritesLastX(in[i]))
+            live = false;
+    }
+
+    std::vector<Instruction> out;
+    for (std::size_t i = 0; i < n; ++i) {
+        const auto& instruction = in[i];
+        const bool has_next = (i + 1 < n);
+        const Opcode next = has_next ? in[i + 1].opcode : instruction.opcode;
+        // SWAP SWAP: only clears EEX
+        if (instruction.opcode == kOpSwap && has_next && next == kOpSwap &&
+            !flags[i].eex_pressed) {
+            ++i;
+            continue;
+        }
+        // CHS CHS: raises the lift flag and changes LASTX
+        if (IsKey(instruction, key::kKeyChs) && has_next && IsKey(in[i + 1], key::kKeyChs) &&
+            flags[i].shift_up_known && flags[i].shift_up && !lastx_live[i + 1]) {
+            ++i;
+            continue;
+        }
+        // SWAP after ENTER swaps equal values; CLX after CLX clears a 0
+        if ((instruction.opcode == kOpEnter || instruction.opcode == kOpClx) &&
+            has_next && next == (instruction.opcode == kOpEnter ? kOpSwap : kOpClx)) {
+            out.push_back(instruction);
+            ++i;
+            continue;
+        }
+        // stack keys before CLR, e.g. ENTER ENTER ENTER CLR
+        if (has_next && next == kOpClr &&
+            (instruction.opcode == kOpInsert || instruction.opcode == kOpPi ||
+             instruction.opcode == kOpEnter || instruction.opcode == kOpRdn ||
+             instruction.opcode == kOpSwap || instruction.opcode == kOpClx ||
+             instruction.opcode == kOpEex || instruction.opcode == kOpClr))
+            continue;
+        out.push_back(instruction);
+    }
+    return out;
+}
+
+std::vector<Instruction> FuseMultiplyAdd(const std::vector<Instruction>& in) {
+    std::vector<Instruction> out;
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        if (i + 1 < in.size() && IsKey(in[i], key::kKeyMul) &&
+            (IsKey(in[i + 1], key::kKeyPlus) || IsKey(in[i + 1], key::kKeyMinus))) {
+            out.push_back(Instruction{kOpMultiplyAdd, 0.0, false, in[i + 1].key,
+                                      nullptr, nullptr});
+            ++i;
+        } else {
+            out.push_back(in[i]);
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+Program Optimize(const Program& program, const OptimizeOptions& options,
+                 std::size_t depth) {
+    std::vector<Instruction> instructions = program.instructions();
+    // removing keys may let more keys fold and the other way round
+    std::size_t size;
+    do {
+        size = instructions.size();
+        if (options.fold_constants)
+            instructions = FoldConstants(instructions, depth);
+        if (options.remove_noops)
+            instructions = RemoveNoops(instructions);
+    } while (instructions.size() < size);
+    // MultiplyAdd writes Z
+    if (options.fuse_multiply_add && depth >= 3)
+        instructions = FuseMultiplyAdd(instructions);
+    return Program(std::move(instructions));
+}
+
+} /* namespace backend */
@@ -0,0 +1,65 @@
+#include "parallel.hpp"
+#include "backend.hpp"
+#include "program.hpp"
+#include "result_cache.hpp"
+#include "thread_pool.hpp"
+#include <algorithm> // min
+#include <exception> // exception
+#include <limits>    // numeric_limits
+#include <memory>    // make_unique
+#include <string>    // string
+
+namespace backend {
+
+ParallelEvaluator::ParallelEvaluator(const key::Keypad& keypad, unsigned threads,
+                                     ResultCache* cache):
+    keypad_(keypad),
+    cache_(cache),
+    pool_(threads) {
+    for (unsigned i = 0; i < pool_.size(); ++i)
+        backends_.push_back(std::make_unique<Backend>(keypad_));
+}
+
+std::vector<EvalResult> ParallelEvaluator::Eval(const std::vector<std::string>& expressions) {
+    std::vector<EvalResult> results(expressions.size());
+    // several expressions per task so that the queues aren't contended,
+    // but enough tasks per worker to balance the load by stealing
+    const std::size_t tasks = static_cast<std::size_t>(pool_.size()) * 16;
+    const std::size_t grain = std::max<std::size_t>(1,
+        std::min<std::size_t>(256, expressions.size() / tasks));
+    for (std::size_t begin = 0; begin < expressions.size(); begin += grain) {
+        const std::size_t end = std::min(begin + grain, expressions.size());
+        pool_.Submit([this, &expressions, &results, begin, end](unsigned worker) {
+            auto& backend = *backends_[worker];
+            std::string key;
+            for (std::size_t i = begin; i < end; ++i) {
+                auto& result = results[i];
+                if (cache_ != nullptr) {
+                    ResultCache::Key(keypad_, expressions[i], key);
+                    if (cache_->Lookup(key, result.value)) {
+                        result.ok = true;
+                        continue;
+                    }
+                }
+                try {
+                    backend.Reset();
+                    const Program program(expressions[i], keypad_);
+                    result.value = program.Run(backend);
+                    result.ok = true;
+                    // from a reset backend the result only depends on
+                    // the expression
+                    if (cache_ != nullptr)
+                        cache_->Insert(key, result.value);
+                } catch (const std::exception& e) {
+                    result.value = std::numeric_limits<double>::quiet_NaN();
+                    result.ok = false;
+                    result.error = e.what();
+                }
+            }
+        });
+    }
+    pool_.Wait();
+    return results;
+}
+
+} /* namespace backend */
@@ -0,0 +1,91 @@
+#include "program.hpp"
+#include "decoder.hpp"
+#include "backend.hpp"
+#include "stack.hpp"
+#include "machine.hpp"
+#include "keypad.hpp"
+#include "tokenizer.hpp"
+#include <string>      // string
+#include <string_view> // string_view
+#include <vector>      // vector
+
+namespace backend {
+
+Program::Program(const std::string& expression, const key::Keypad& keypad) {
+    Decoder decoder(keypad);
+    Tokenizer tokenizer(expression);
+    std::string_view token;
+    // long keys such as LOG10 are reversed to their short key, e.g. L
+    while (tokenizer.Next(token))
+        decoder.Decode(key::ShortKey(keypad, token), instructions_);
+}
+
+double Program::Run(Backend& backend) const {
+    for (const auto& instruction: instructions_)
+        Execute(backend, instruction);
+    return backend.Peek().first;
+}
+
+double Program::Run(Stack& stack) const {
+    // LASTX, the general registers and the flags last for this run
+    Machine<Stack&> machine(stack);
+    for (const auto& instruction: instructions_) {
+        switch (instruction.opcode) {
+            case kOpInsert:
+                machine.Insert(instruction.operand);
+                break;
+            case kOpEnter:
+                machine.Enter();
+                break;
+            case kOpRdn:
+                machine.Rdn();
+                break;
+            case kOpSwap:
+                machine.SwapXY();
+                break;
+            case kOpLastX:
+                machine.LastX();
+                break;
+            case kOpClx:
+                machine.Clx();
+                break;
+            case kOpClr:
+                machine.Clr();
+                break;
+            case kOpPi:
+                machine.Pi();
+                break;
+            case kOpEex:
+                machine.Eex(instruction.has_operand ? instruction.operand : 0.0);
+                break;
+            case kOpSto:
+            case kOpRcl: {
+                // unknown registers are ignored, as by `Backend::Sto`
+                const int idx = key::GenRegIndex(instruction.key);
+                if (idx < 0)
+                    break;
+                if (instruction.opcode == kOpSto)
+                    machine.Sto(idx);
+                else
+                    machine.Rcl(idx);
+                break;
+            }
+            case kOpSingleArg:
+                machine.CalculateSingleArg(*instruction.single_arg);
+                break;
+            case kOpDoubleArg:
+                machine.CalculateDoubleArg(*instruction.double_arg);
+                break;
+            case kOpConstant:
+                machine.InsertConstant(instruction.operand, instruction.lastx,
+                                       instruction.lifts);
+                break;
+            case kOpMultiplyAdd:
+                machine.MultiplyAdd(instruction.key == key::kKeyMinus);
+                break;
+        }
+    }
+    return stack[IDX_REG_X];
+}
+
+} /* namespace backend */
@@ -0,0 +1,101 @@
+#include "result_cache.hpp"
+#include "keypad.hpp"
+#include "tokenizer.hpp"
+#include <cstdint>    // uint64_t
+#include <functional> // hash
+#include <memory>     // make_unique
+
+namespace backend {
+
+ResultCache::ResultCache(std::size_t max_bytes, unsigned shards) {
+    if (shards == 0)
+        shards = 1;
+    for (unsigned i = 0; i < shards; ++i)
+        shards_.push_back(std::make_unique<Shard>());
+    shard_bytes_ = max_bytes / shards;
+}
+
+void ResultCache::Key(const key::Keypad& keypad, std::string_view expression,
+                      std::string& key) {
+    key.clear();
+    Tokenizer tokenizer(expression);
+    std::string_view token;
+    while (tokenizer.Next(token)) {
+        if (!key.empty())
+            key += ' ';
+        key += key::ShortKey(keypad, token);
+    }
+}
+
+ResultCache::Shard& ResultCache::ShardOf(std::string_view key) {
+    // the map hashes the key again; the high bits pick the shard so
+    // that a shard's keys still spread over the map's buckets
+    const std::uint64_t hash = std::hash<std::string_view>()(key);
+    return *shards_[(hash >> 32 ^ hash) % shards_.size()];
+}
+
+bool ResultCache::Lookup(std::string_view key, double& value) {
+    auto& shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++shard.misses;
+        return false;
+    }
+    ++shard.hits;
+    // most recently used first
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    value = it->second->value;
+    return true;
+}
+
+void ResultCache::Insert(std::string_view key, double value) {
+    const std::size_t bytes = Bytes(key);
+    if (bytes > shard_bytes_)
+        return;
+    auto& shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        // another thread evaluated it meanwhile
+        it->second->value = value;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    while (shard.bytes + bytes > shard_bytes_) {
+        const auto& oldest = shard.lru.back();
+        shard.bytes -= Bytes(oldest.key);
+        shard.index.erase(oldest.key);
+        shard.lru.pop_back();
+        ++shard.evictions;
+    }
+    shard.lru.push_front({std::string(key), value});
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += bytes;
+    ++shard.insertions;
+}
+
+CacheStats ResultCache::Stats() const {
+    CacheStats stats = {0, 0, 0, 0, 0, 0};
+    for (const auto& shard: shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.insertions += shard->insertions;
+        stats.evictions += shard->evictions;
+        stats.entries += shard->lru.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
+
+void ResultCache::Clear() {
+    for (auto& shard: shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->index.clear();
+        shard->lru.clear();
+        shard->bytes = 0;
+    }
+}
+
+} /* namespace backend */
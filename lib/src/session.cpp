@@ -0,0 +1,48 @@
+#include "session.hpp"
+#include "backend.hpp"
+#include "engine.hpp"
+#include <memory>      // unique_ptr
+#include <string_view> // string_view
+
+namespace backend {
+
+double EvalSession(Engine& engine, Session& session, std::string_view expression) {
+    engine.backend().LoadSession(session);
+    double result;
+    try {
+        result = engine.EvalString(expression);
+    } catch (...) {
+        engine.backend().SaveSession(session);
+        throw;
+    }
+    engine.backend().SaveSession(session);
+    return result;
+}
+
+SessionPool::SessionPool():
+    slabs_(),
+    free_(),
+    size_(0) {}
+
+Session* SessionPool::Acquire() {
+    if (free_.empty()) {
+        slabs_.emplace_back(new Session[kSlabSessions]);
+        Session* slab = slabs_.back().get();
+        // hand out the slab from its start
+        free_.reserve(slabs_.size() * kSlabSessions);
+        for (std::size_t i = kSlabSessions; i-- > 0;)
+            free_.push_back(&slab[i]);
+    }
+    Session* session = free_.back();
+    free_.pop_back();
+    *session = kNewSession;
+    ++size_;
+    return session;
+}
+
+void SessionPool::Release(Session* session) {
+    free_.push_back(session);
+    --size_;
+}
+
+} /* namespace backend */
@@ -0,0 +1,275 @@
+#include "tape.hpp"
+#include "engine.hpp"
+#include "keypad.hpp"
+#include <chrono>      // steady_clock, system_clock, duration_cast
+#include <cstring>     // memcpy, memcmp
+#include <exception>   // exception
+#include <stdexcept>   // runtime_error
+#include <string>      // string
+#include <string_view> // string_view
+#include <utility>     // move
+
+namespace backend {
+
+namespace {
+
+constexpr std::string_view kMagic = "HP35TAPE";
+constexpr std::uint64_t kVersion = 1;
+
+// opcode flags
+constexpr unsigned kChangedX = 1;
+constexpr unsigned kChangedY = 2;
+constexpr unsigned kThrew = 4;
+constexpr unsigned kFlagBits = 3;
+
+void PutVarint(std::uint64_t value, std::string& out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void PutDouble(double value, std::string& out) {
+    char bytes[sizeof(double)];
+    std::memcpy(bytes, &value, sizeof(double));
+    out.append(bytes, sizeof(double));
+}
+
+/** @brief Equal bit for bit, so that NaNs compare equal */
+bool SameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+} // namespace
+
+void EncodeTapeHeader(const TapeHeader& header, std::string& out) {
+    out.append(kMagic);
+    PutVarint(kVersion, out);
+    PutVarint(header.start_us, out);
+    PutVarint(header.depth, out);
+    PutVarint(header.undo_bytes, out);
+    PutVarint(header.state.size(), out);
+    out.append(header.state);
+}
+
+TapeEncoder::TapeEncoder():
+    count_(0),
+    x_(0.0),
+    y_(0.0) {
+    codes_.fill(-1);
+}
+
+void TapeEncoder::Encode(const TapeRecord& record, std::string& out) {
+    const bool is_new = codes_[record.key] < 0;
+    if (is_new)
+        codes_[record.key] = static_cast<std::int16_t>(count_++);
+    unsigned flags = (record.threw) ? kThrew : 0;
+    if (!SameBits(record.x, x_))
+        flags |= kChangedX;
+    if (!SameBits(record.y, y_))
+        flags |= kChangedY;
+    PutVarint(static_cast<std::uint64_t>(codes_[record.key]) << kFlagBits | flags, out);
+    if (is_new)
+        out.push_back(static_cast<char>(record.key));
+    PutVarint(record.delta_us, out);
+    if (flags & kChangedX)
+        PutDouble(record.x, out);
+    if (flags & kChangedY)
+        PutDouble(record.y, out);
+    x_ = record.x;
+    y_ = record.y;
+}
+
+TapeDecoder::TapeDecoder(std::string_view tape):
+    tape_(tape),
+    pos_(kMagic.size()),
+    header_(),
+    keys_(),
+    count_(0),
+    x_(0.0),
+    y_(0.0) {
+    if (tape_.substr(0, kMagic.size()) != kMagic)
+        throw std::runtime_error("[FATAL]: Tape: not a tape.\n");
+    if (ReadVarint() != kVersion)
+        throw std::runtime_error("[FATAL]: Tape: unsupported version.\n");
+    header_.start_us = ReadVarint();
+    header_.depth = ReadVarint();
+    header_.undo_bytes = ReadVarint();
+    const std::size_t state_size = ReadVarint();
+    if (state_size > tape_.size() - pos_)
+        throw std::runtime_error("[FATAL]: Tape: truncated header.\n");
+    header_.state.assign(tape_.substr(pos_, state_size));
+    pos_ += state_size;
+}
+
+std::uint64_t TapeDecoder::ReadVarint() {
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos_ == tape_.size())
+            throw std::runtime_error("[FATAL]: Tape: truncated record.\n");
+        const auto byte = static_cast<unsigned char>(tape_[pos_++]);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return value;
+    }
+    throw std::runtime_error("[FATAL]: Tape: invalid varint.\n");
+}
+
+bool TapeDecoder::Next(TapeRecord& record) {
+    if (pos_ == tape_.size())
+        return false;
+    const std::uint64_t opcode = ReadVarint();
+    const std::uint64_t index = opcode >> kFlagBits;
+    if (index == count_ && count_ < keys_.size()) {
+        // a key that's new to the tape; its byte follows
+        if (pos_ == tape_.size())
+            throw std::runtime_error("[FATAL]: Tape: truncated record.\n");
+        keys_[count_++] = static_cast<unsigned char>(tape_[pos_++]);
+    } else if (index >= count_) {
+        throw std::runtime_error("[FATAL]: Tape: invalid opcode.\n");
+    }
+    record.key = keys_[index];
+    record.threw = opcode & kThrew;
+    record.delta_us = ReadVarint();
+    const std::size_t doubles = ((opcode & kChangedX) ? 1 : 0) + ((opcode & kChangedY) ? 1 : 0);
+    if (doubles * sizeof(double) > tape_.size() - pos_)
+        throw std::runtime_error("[FATAL]: Tape: truncated record.\n");
+    if (opcode & kChangedX) {
+        std::memcpy(&x_, &tape_[pos_], sizeof(double));
+        pos_ += sizeof(double);
+    }
+    if (opcode & kChangedY) {
+        std::memcpy(&y_, &tape_[pos_], sizeof(double));
+        pos_ += sizeof(double);
+    }
+    record.x = x_;
+    record.y = y_;
+    return true;
+}
+
+TapeWriter::TapeWriter(const std::string& path, TapeHeader header):
+    file_(std::fopen(path.c_str(), "wb")),
+    encoder_(),
+    last_(std::chrono::steady_clock::now()),
+    stop_(false),
+    failed_(false) {
+    if (!file_)
+        throw std::runtime_error("[FATAL]: Tape: cannot open " + path + "\n");
+    header.start_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    buffer_.reserve(kBufferBytes + kBufferBytes / 4);
+    EncodeTapeHeader(header, buffer_);
+    thread_ = std::thread(&TapeWriter::Run, this);
+}
+
+TapeWriter::~TapeWriter() {
+    try {
+        Close();
+    } catch (const std::runtime_error&) {
+        // destructors don't throw; `Close` reports it to callers
+    }
+}
+
+void TapeWriter::Record(unsigned char key, bool threw, double x, double y) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - last_);
+    last_ = now;
+    encoder_.Encode({key, threw, static_cast<std::uint64_t>(delta.count()), x, y}, buffer_);
+    if (buffer_.size() >= kBufferBytes)
+        Handoff();
+}
+
+void TapeWriter::Flush() {
+    if (!buffer_.empty() && thread_.joinable())
+        Handoff();
+}
+
+void TapeWriter::Handoff() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // the thread takes a buffer as soon as it's done with the previous
+    cv_.wait(lock, [this]() { return pending_.empty(); });
+    if (failed_)
+        throw std::runtime_error("[FATAL]: Tape: cannot write the tape.\n");
+    // `pending_` is empty but keeps its memory for the next keys
+    pending_.swap(buffer_);
+    cv_.notify_all();
+}
+
+void TapeWriter::Close() {
+    if (!thread_.joinable())
+        return;
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    const bool closed = std::fclose(file_) == 0;
+    file_ = nullptr;
+    if (failed_ || !closed)
+        throw std::runtime_error("[FATAL]: Tape: cannot write the tape.\n");
+}
+
+void TapeWriter::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return !pending_.empty() || stop_; });
+        if (pending_.empty())
+            break; // closed and everything written
+        writing_.swap(pending_);
+        cv_.notify_all();
+        lock.unlock();
+        // after a failed write the rest is dropped; the tape is broken
+        const bool failed = failed_ ||
+            std::fwrite(writing_.data(), 1, writing_.size(), file_) != writing_.size() ||
+            std::fflush(file_) != 0;
+        writing_.clear();
+        lock.lock();
+        failed_ = failed;
+    }
+}
+
+ReplayReport ReplayTape(std::string_view tape, const key::Keypad& keypad) {
+    TapeDecoder decoder(tape);
+    const auto& header = decoder.header();
+    Engine engine(keypad, header.depth);
+    if (engine.backend().StateSize() != header.state.size())
+        throw std::runtime_error("[FATAL]: Tape: state doesn't match the depth.\n");
+    engine.backend().LoadState(header.state.data());
+    engine.EnableUndo(header.undo_bytes);
+    const auto& observer = engine.observer();
+
+    ReplayReport report = {0, 0, 0, 0};
+    TapeRecord record;
+    while (decoder.Next(record)) {
+        bool threw = false;
+        // undo and redo are handled by the UI, not by the keys
+        if (record.key == 'u') {
+            engine.Undo();
+        } else if (record.key == 'U') {
+            engine.Redo();
+        } else {
+            const char key = static_cast<char>(record.key);
+            try {
+                engine.Press(std::string_view(&key, 1));
+            } catch (const std::exception&) {
+                threw = true;
+            }
+        }
+        const auto registers = observer.GetState().second;
+        if (threw != record.threw || !SameBits(registers.first, record.x) ||
+            !SameBits(registers.second, record.y)) {
+            if (report.mismatches++ == 0)
+                report.first_mismatch = report.keys;
+        }
+        report.recorded_us += record.delta_us;
+        ++report.keys;
+    }
+    if (report.mismatches == 0)
+        report.first_mismatch = report.keys;
+    return report;
+}
+
+} /* namespace backend */
@@ -0,0 +1,95 @@
+#include "thread_pool.hpp"
+#include <mutex>   // lock_guard, unique_lock
+#include <thread>  // hardware_concurrency
+#include <utility> // move
+
+namespace backend {
+
+ThreadPool::ThreadPool(unsigned threads):
+    queued_(0),
+    pending_(0),
+    next_(0),
+    stop_(false) {
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    for (unsigned i = 0; i < threads; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; ++i)
+        threads_.emplace_back(&ThreadPool::Work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& thread: threads_)
+        thread.join();
+}
+
+void ThreadPool::Submit(Task task) {
+    auto& queue = *queues_[next_++ % queues_.size()];
+    pending_++;
+    {
+        // count the task under its queue's lock so that no worker can
+        // take it, and count it down, before it's counted
+        std::lock_guard<std::mutex> queue_lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        // modify under the lock so that a worker about to sleep sees it
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+    }
+    work_cv_.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool ThreadPool::Take(unsigned index, Task& task) {
+    const unsigned n = static_cast<unsigned>(queues_.size());
+    for (unsigned i = 0; i < n; ++i) {
+        auto& queue = *queues_[(index + i) % n];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == 0) {
+            // own queue - newest task first as it's likely cached
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            // steal the oldest task from another worker
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued_--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::Work(unsigned index) {
+    Task task;
+    while (true) {
+        if (Take(index, task)) {
+            task(index);
+            task = nullptr;
+            if (--pending_ == 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                done_cv_.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0)
+            return;
+    }
+}
+
+} /* namespace backend */
@@ -0,0 +1,107 @@
+/**
+ * Replays keystroke tapes recorded by the UI (`demo -r session.tape`)
+ * on a new calculator and checks that every key leaves the X and Y
+ * it left when it was recorded. Example:
+ *     hip35replay session.tape other.tape
+ * prints, for each tape, the keys replayed, the first key whose
+ * result differs and how many keys per second were replayed. Exits
+ * with 1 if any key differs, so tapes can serve as regression tests;
+ * with -n they're replayed repeatedly as a benchmark.
+ *
+ * Tapes are memory-mapped and decoded in place.
+ */
+#include "keypad.hpp"
+#include "tape.hpp"
+#include <algorithm>   // max
+#include <chrono>      // steady_clock, duration
+#include <cstdio>      // printf, fprintf
+#include <cstdlib>     // atoi
+#include <exception>   // exception
+#include <string_view> // string_view
+#include <fcntl.h>     // open
+#include <sys/mman.h>  // mmap, madvise
+#include <sys/stat.h>  // fstat
+#include <unistd.h>    // close, getopt
+
+namespace {
+
+void PrintUsage(const char* name) {
+    std::fprintf(stderr,
+        "Usage: %s [-n REPEAT] TAPE...\n"
+        "Replays tapes and verifies the result of each key.\n"
+        "  -n REPEAT  replay each tape REPEAT times (default 1)\n",
+        name);
+}
+
+/** @brief Replays a tape; false if it can't be read or a key differs */
+bool Replay(const char* path, int repeat) {
+    const int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::fprintf(stderr, "Cannot open %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    const std::size_t size = st.st_size;
+    void* addr = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) :
+                              MAP_FAILED;
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::fprintf(stderr, "Cannot map %s\n", path);
+        return false;
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    const std::string_view tape(static_cast<const char*>(addr), size);
+
+    bool ok = true;
+    try {
+        backend::ReplayReport report;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i)
+            report = backend::ReplayTape(tape, key::keypad);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        const double keys_per_s = report.keys * static_cast<double>(repeat) /
+                                  std::max(elapsed.count(), 1e-9);
+        std::printf("%s: %zu keys recorded over %.1f s, ", path, report.keys,
+                    report.recorded_us / 1e6);
+        if (report.mismatches == 0)
+            std::printf("all match");
+        else
+            std::printf("%zu differ (first: key %zu)", report.mismatches,
+                        report.first_mismatch);
+        std::printf(", %.2f M keys/s\n", keys_per_s / 1e6);
+        ok = report.mismatches == 0;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s: %s", path, e.what());
+        ok = false;
+    }
+    munmap(addr, size);
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int repeat = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                repeat = std::max(1, std::atoi(optarg));
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind == argc) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    bool ok = true;
+    for (int i = optind; i < argc; ++i)
+        ok = Replay(argv[i], repeat) && ok;
+    return ok ? 0 : 1;
+}
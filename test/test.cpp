@@ -1,9 +1,45 @@
-#include "hip35.hpp"
+#include "engine.hpp"
+#include "event_channel.hpp"
+#include "program.hpp"
+#include "batch.hpp"
+#include "optimizer.hpp"
+#include "parallel.hpp"
+#include "result_cache.hpp"
+#include "static_backend.hpp"
+#include "static_keypad.hpp"
+#include "static_program.hpp"
+#include "tokenizer.hpp"
+#include "number_lexer.hpp"
+#include "format.hpp"
+#include "incremental.hpp"
+#include "journal.hpp"
+#include "tape.hpp"
+#include "session.hpp"
+#include "metrics.hpp"
 #include "nanotest.h"
 #include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace backend::literals;
 
 int main() {
-    auto hp = std::make_unique<Ui::Hip35>(key::keypad);
+    // headless calculator; the same engine the UI drives
+    auto hp = std::make_unique<backend::Engine>(key::keypad);
     // --pN shall mean page N from the manual:
     // http://h10032.www1.hp.com/ctg/Manual/c01579350
 
@@ -57,10 +93,15 @@ int main() {
     //------------------------------------------------------------------//
     // store/recall                                                     //
     //------------------------------------------------------------------//
-    // NOTE:
-    // store/recall do not work in EvalString yet however it
-    // works in the UI. To see why, read TODO comment in
-    // method's definition
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString(""
+        "3 STO A 4 ENTER RCL A *"),                               12);
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString(""
+        "2 STO b 5 RCL B +"),                                     4);
+    // register E isn't taken for EEX
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString(""
+        "3 STO E CLX RCL E"),                                     3);
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString(""
+        "5 STO e 2 E 1 ENTER RCL E +"),                           25);
 
     //------------------------------------------------------------------//
     // postfix exponent (EEX)                                           //
@@ -75,4 +116,1011 @@ int main() {
     //------------------------------------------------------------------//
     NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString(""
         "123 CLX 2 ENTER 3 *"),                                   6);
+
+    //------------------------------------------------------------------//
+    // compiled programs                                                //
+    //------------------------------------------------------------------//
+    const std::vector<std::pair<std::string, double>> programs = {
+        {"12 ENTER 6 /",                                         2},
+        {"1.5 ENTER ENTER ENTER 100 * * *",                      337.5},
+        {"2 ENTER 3 + 4 ENTER 5 + * SQRT 6 ENTER 7 + 8 ENTER 9 + * SQRT +",
+                                                                 21.5743},
+        {"2 ENTER 3 + 4 * 5 / 30 SIN / 1.5 CHS ENTER 4 ^ *",     1},
+        {"13 ENTER 37 RDN RDN RDN RDN",                          37},
+        {"60 SIN LASTX 2 / TAN *",                               0.5},
+        {"16 ENTER 19 - LASTX + LASTX *",                        16*19},
+        {"2 EEX 3 ENTER 3 EEX 3 + 42 +",                         5042},
+        {"123 CLX 2 ENTER 3 *",                                  6},
+    };
+    for (const auto& expected: programs) {
+        const backend::Program program(expected.first, key::keypad);
+        backend::Backend backend(key::keypad);
+        backend::Stack stack;
+        NTEST_ASSERT_FLOAT_CLOSE(program.Run(backend),           expected.second);
+        NTEST_ASSERT_FLOAT_CLOSE(program.Run(stack),             expected.second);
+        NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString(expected.first), expected.second);
+    }
+    // running a program again continues from the backend's state
+    backend::Backend backend(key::keypad);
+    const backend::Program add_one("1 +", key::keypad);
+    backend.Insert(41);
+    add_one.Run(backend);
+    NTEST_ASSERT_FLOAT_CLOSE(add_one.Run(backend),                43);
+
+    //------------------------------------------------------------------//
+    // stack depth                                                      //
+    //------------------------------------------------------------------//
+    // the ring buffer against shifting every level, at HP35's depth
+    // and a deep one
+    for (std::size_t depth: {backend::kStackDepth, std::size_t(1000)}) {
+        backend::Stack stack(depth);
+        std::vector<double> levels(depth, 0.0);
+        std::mt19937 gen(depth);
+        bool same = stack.size() == depth;
+        for (int i = 0; i < 10000; ++i) {
+            switch (gen() % 4) {
+                case 0:
+                    stack.ShiftUp();
+                    levels.insert(levels.begin(), 0.0);
+                    levels.pop_back();
+                    break;
+                case 1:
+                    stack.ShiftDown();
+                    levels.erase(levels.begin());
+                    levels.push_back(levels.back());
+                    break;
+                case 2:
+                    stack.RollDown();
+                    levels.push_back(levels.front());
+                    levels.erase(levels.begin());
+                    break;
+                default:
+                    stack.writeX(i);
+                    levels.front() = i;
+                    break;
+            }
+            same &= stack[backend::IDX_REG_X] == levels.front() &&
+                    stack[depth - 1] == levels.back();
+        }
+        for (std::size_t i = 0; i < depth; ++i)
+            same &= stack[i] == levels[i];
+        NTEST_ASSERT(same);
+    }
+    {
+        // a deep stack keeps operands that a 4-level one discards
+        backend::Engine deep(key::keypad, 8);
+        NTEST_ASSERT_FLOAT_CLOSE(deep.EvalString(
+            "1 ENTER 2 ENTER 3 ENTER 4 ENTER 5 ENTER 6 ENTER 7 ENTER 8 + + + + + + +"), 36);
+        NTEST_ASSERT_FLOAT_CLOSE(deep.EvalString("CLR 1 ENTER 2 RDN"),                  1);
+        // back to where it started after rolling all 8 levels
+        NTEST_ASSERT_FLOAT_CLOSE(deep.EvalString("RDN RDN RDN RDN RDN RDN RDN"),        2);
+        backend::Engine hp35(key::keypad);
+        NTEST_ASSERT_FLOAT_CLOSE(hp35.EvalString(
+            "1 ENTER 2 ENTER 3 ENTER 4 ENTER 5 ENTER 6 ENTER 7 ENTER 8 + + + + + + +"), 46);
+        backend::Stack stack(1000);
+        const backend::Program program("1 ENTER 2 ENTER 3 * * CLR 4 +", key::keypad);
+        NTEST_ASSERT_FLOAT_CLOSE(program.Run(stack),                                    4);
+        NTEST_ASSERT_FLOAT_CLOSE(stack[999],                                            0);
+    }
+    // a 2-operand key returns the new X, not what the ring buffer
+    // rotated into the old X's slot, at any depth
+    for (std::size_t depth: {backend::kStackDepth, std::size_t(5), std::size_t(1000)}) {
+        backend::Backend subject(key::keypad, depth);
+        bool returns_x = true;
+        for (const double num: {7, 8, 2, 3}) {
+            subject.Insert(num);
+            if (num != 3)
+                subject.Enter();
+        }
+        returns_x &= subject.Calculate("+") == 5 && subject.Peek().first == 5;
+        returns_x &= subject.Calculate("*") == 40 && subject.Peek().first == 40;
+        subject.Clr();
+        subject.Insert(2);
+        subject.Enter();
+        subject.Insert(3);
+        returns_x &= subject.Calculate("^") == 9 && subject.Peek().first == 9;
+        NTEST_ASSERT(returns_x);
+    }
+
+    //------------------------------------------------------------------//
+    // batch evaluation                                                 //
+    //------------------------------------------------------------------//
+    // every key over rows with different stacks; each row must match
+    // the program executed on its own stack
+    const std::vector<std::string> batch_programs = {
+        "ENTER + 3 - 2 * 4 / CHS INV SQRT 1.5 ^",
+        "SIN LASTX COS + LASTX TAN - 0.5 ASIN * 0.5 ACOS +",
+        "1 ATAN SWAP RDN EXP LN + LOG10 PI * CLX 7 ENTER ENTER *",
+        "2 EEX 3 + ENTER 1 EEX 2 * # A RDN RDN ? A CLR 5 +",
+    };
+    constexpr std::size_t rows = 1031;
+    for (const auto& expression: batch_programs) {
+        const backend::Program program(expression, key::keypad);
+        backend::Batch batch(rows);
+        std::vector<backend::Stack> stacks(rows);
+        for (std::size_t i = 0; i < rows; ++i) {
+            for (std::size_t reg = backend::IDX_REG_X; reg <= backend::IDX_REG_T; ++reg) {
+                batch[reg][i] = 0.25 + 0.01 * i + reg;
+                stacks[i][reg] = 0.25 + 0.01 * i + reg;
+            }
+        }
+        batch.Run(program);
+        bool all_equal = true;
+        for (std::size_t i = 0; i < rows; ++i) {
+            program.Run(stacks[i]);
+            for (std::size_t reg = backend::IDX_REG_X; reg <= backend::IDX_REG_T; ++reg)
+                all_equal &= (batch[reg][i] == stacks[i][reg]) ||
+                             (std::isnan(batch[reg][i]) && std::isnan(stacks[i][reg]));
+        }
+        NTEST_ASSERT(all_equal);
+    }
+
+    //------------------------------------------------------------------//
+    // parallel evaluation                                              //
+    //------------------------------------------------------------------//
+    std::vector<std::string> expressions;
+    for (const auto& expected: programs)
+        expressions.push_back(expected.first);
+    // division by zero fails only its own expression
+    expressions.push_back("1 ENTER 0 /");
+    for (int i = 0; i < 1000; ++i)
+        expressions.push_back(std::to_string(i) + " ENTER 2 *");
+    backend::ParallelEvaluator evaluator(key::keypad, 4);
+    const auto results = evaluator.Eval(expressions);
+    NTEST_ASSERT(results.size() == expressions.size());
+    for (std::size_t i = 0; i < programs.size(); ++i)
+        NTEST_ASSERT_FLOAT_CLOSE(results[i].value,              programs[i].second);
+    NTEST_ASSERT(!results[programs.size()].ok);
+    NTEST_ASSERT(!results[programs.size()].error.empty());
+    bool all_doubled = true;
+    for (int i = 0; i < 1000; ++i)
+        all_doubled &= results[programs.size() + 1 + i].ok &&
+                       results[programs.size() + 1 + i].value == 2 * i;
+    NTEST_ASSERT(all_doubled);
+
+    //------------------------------------------------------------------//
+    // result cache                                                     //
+    //------------------------------------------------------------------//
+    {
+        std::string key;
+        backend::ResultCache::Key(key::keypad, "  30  SIN 2 ENTER", key);
+        NTEST_ASSERT(key == "30 s 2  ");
+        // room for 2 entries with keys of up to 8 characters
+        backend::ResultCache cache(2 * (backend::ResultCache::kEntryOverhead + 8), 1);
+        double value = 0.0;
+        NTEST_ASSERT(!cache.Lookup("1", value));
+        cache.Insert("1", 1.0);
+        cache.Insert("2", 2.0);
+        NTEST_ASSERT(cache.Lookup("1", value) && value == 1.0);
+        // 2 is the least recently used
+        cache.Insert("3", 3.0);
+        NTEST_ASSERT(!cache.Lookup("2", value));
+        NTEST_ASSERT(cache.Lookup("3", value) && value == 3.0);
+        const auto stats = cache.Stats();
+        NTEST_ASSERT(stats.hits == 2 && stats.misses == 2);
+        NTEST_ASSERT(stats.insertions == 3 && stats.evictions == 1 && stats.entries == 2);
+        NTEST_ASSERT(stats.bytes == 2 * (backend::ResultCache::kEntryOverhead + 1));
+        cache.Clear();
+        NTEST_ASSERT(cache.Stats().entries == 0 && !cache.Lookup("1", value));
+    }
+    {
+        // evaluators share a cache; the second run looks up every
+        // result
+        backend::ResultCache cache(1 << 20);
+        backend::ParallelEvaluator first(key::keypad, 4, &cache);
+        backend::ParallelEvaluator second(key::keypad, 3, &cache);
+        const auto evaluated = first.Eval(expressions);
+        const auto misses = cache.Stats().misses;
+        const auto looked_up = second.Eval(expressions);
+        bool same = true;
+        for (std::size_t i = 0; i < expressions.size(); ++i)
+            same &= (evaluated[i].ok == looked_up[i].ok) &&
+                    (!evaluated[i].ok || evaluated[i].value == looked_up[i].value) &&
+                    (!looked_up[i].ok || looked_up[i].value == results[i].value);
+        NTEST_ASSERT(same);
+        const auto stats = cache.Stats();
+        // all but the division by zero
+        NTEST_ASSERT(stats.entries == expressions.size() - 1);
+        NTEST_ASSERT(stats.hits == expressions.size() - 1);
+        NTEST_ASSERT(stats.misses == misses + 1);
+    }
+    {
+        // also expressions that read the stack, LASTX or a register
+        // before writing them; every one starts from a reset backend
+        const std::vector<std::string> reading = {"3 +", "LASTX 1 +", "RCL A 1 +", "SWAP 2 +"};
+        backend::ResultCache cache(1 << 20);
+        backend::ParallelEvaluator evaluator(key::keypad, 2, &cache);
+        evaluator.Eval(reading);
+        const auto looked_up = evaluator.Eval(reading);
+        bool same = cache.Stats().hits == reading.size();
+        for (std::size_t i = 0; i < reading.size(); ++i)
+            same &= looked_up[i].ok &&
+                    looked_up[i].value == backend::Engine(key::keypad).EvalString(reading[i]);
+        NTEST_ASSERT(same);
+    }
+
+    //------------------------------------------------------------------//
+    // optimizer                                                        //
+    //------------------------------------------------------------------//
+    {
+        const auto count = [](const std::string& expression,
+                              const backend::OptimizeOptions& options) {
+            const backend::Program program(expression, key::keypad);
+            return backend::Optimize(program, options).instructions().size();
+        };
+        NTEST_ASSERT(count("2 ENTER 3 + * 1 CHS CHS +", backend::kOptimizeExact) == 4);
+        NTEST_ASSERT(count("2 ENTER 3 + SQRT",          backend::kOptimizeExact) == 1);
+        NTEST_ASSERT(count("SWAP SWAP 1 +",             backend::kOptimizeExact) == 2);
+        NTEST_ASSERT(count("ENTER ENTER RDN CLR 1 +",   backend::kOptimizeExact) == 3);
+        NTEST_ASSERT(count("ENTER ENTER * +",           backend::kOptimizeAll) == 3);
+        // the folded keys would fill a 4-level stack with constants
+        const backend::Program fill("1 ENTER ENTER ENTER + + +", key::keypad);
+        NTEST_ASSERT(backend::Optimize(fill).instructions().size() == 7);
+        NTEST_ASSERT(backend::Optimize(fill, backend::kOptimizeExact, 5).instructions().size() == 1);
+        // folding would hide the division by zero
+        NTEST_ASSERT(count("1 ENTER 0 /",               backend::kOptimizeExact) == 4);
+        bool division_throws = false;
+        try {
+            backend::Backend subject(key::keypad);
+            backend::Optimize(backend::Program("1 ENTER 0 /", key::keypad)).Run(subject);
+        } catch (const std::invalid_argument&) {
+            division_throws = true;
+        }
+        NTEST_ASSERT(division_throws);
+    }
+    {
+        // random programs from random states: the exact passes leave
+        // the state the program would, bit for bit
+        const std::vector<std::string> tokens = {
+            "1.5", "2", "0", "PI", "ENTER", "SWAP", "RDN", "CHS", "+", "-", "*",
+            "/", "SQRT", "SIN", "CLX", "CLR", "LASTX", "EEX", "STO A", "RCL A"};
+        const std::vector<std::string> prefixes = {
+            "", "7 ENTER 8 EEX 2 ENTER", "3 STO A 9 SIN", "1 ENTER 2", "4 ENTER CLX"};
+        const auto same = [](double a, double b) {
+            return a == b || (std::isnan(a) && std::isnan(b));
+        };
+        // what a backend shows of its state: its levels, LASTX, a
+        // general register and what the next number does
+        const auto observe = [](const backend::Backend& subject, std::size_t depth) {
+            std::vector<double> seen;
+            for (const char* suffix: {"7 SWAP", "LASTX", "RCL A"}) {
+                backend::Backend copy(subject);
+                seen.push_back(backend::Program(suffix, key::keypad).Run(copy));
+            }
+            backend::Backend copy(subject);
+            for (std::size_t i = 0; i < depth; ++i, copy.Rdn())
+                seen.push_back(copy.Peek().first);
+            return seen;
+        };
+        std::mt19937 gen(19);
+        bool exact = true;
+        std::size_t folded = 0;
+        for (int i = 0; i < 2000; ++i) {
+            std::string expression;
+            for (std::size_t n = 1 + gen() % 12; n > 0; --n)
+                expression += tokens[gen() % tokens.size()] + " ";
+            const backend::Program program(expression, key::keypad);
+            for (std::size_t depth: {backend::kStackDepth, std::size_t(5), std::size_t(8)}) {
+                const auto optimized = backend::Optimize(program, backend::kOptimizeExact, depth);
+                folded += program.instructions().size() - optimized.instructions().size();
+                for (const auto& prefix: prefixes) {
+                    backend::Backend original(key::keypad, depth);
+                    backend::Program(prefix, key::keypad).Run(original);
+                    backend::Backend rewritten(original);
+                    bool threw[2] = {false, false};
+                    try { program.Run(original); } catch (const std::exception&) { threw[0] = true; }
+                    try { optimized.Run(rewritten); } catch (const std::exception&) { threw[1] = true; }
+                    exact &= threw[0] == threw[1];
+                    if (threw[0] || threw[1])
+                        continue;
+                    const auto expected = observe(original, depth);
+                    const auto seen = observe(rewritten, depth);
+                    for (std::size_t j = 0; j < expected.size(); ++j)
+                        exact &= same(expected[j], seen[j]);
+                }
+                // on a bare stack
+                backend::Stack stacks[2] = {backend::Stack(depth), backend::Stack(depth)};
+                for (std::size_t level = 0; level < depth; ++level)
+                    stacks[0][level] = stacks[1][level] = gen() % 100 - 50.0;
+                try {
+                    program.Run(stacks[0]);
+                    optimized.Run(stacks[1]);
+                    for (std::size_t level = 0; level < depth; ++level)
+                        exact &= same(stacks[0][level], stacks[1][level]);
+                } catch (const std::exception&) {}
+            }
+        }
+        NTEST_ASSERT(exact);
+        NTEST_ASSERT(folded > 0);
+        // and on a batch
+        for (const auto& expression: batch_programs) {
+            const backend::Program program(expression, key::keypad);
+            backend::Batch batches[2] = {backend::Batch(rows), backend::Batch(rows)};
+            for (auto& batch: batches)
+                for (std::size_t reg = backend::IDX_REG_X; reg <= backend::IDX_REG_T; ++reg)
+                    for (std::size_t i = 0; i < rows; ++i)
+                        batch[reg][i] = 0.25 + 0.01 * i + reg;
+            batches[0].Run(program);
+            batches[1].Run(backend::Optimize(program));
+            bool all_equal = true;
+            for (std::size_t reg = backend::IDX_REG_X; reg <= backend::IDX_REG_T; ++reg)
+                for (std::size_t i = 0; i < rows; ++i)
+                    all_equal &= same(batches[0][reg][i], batches[1][reg][i]);
+            for (std::size_t i = 0; i < rows; ++i)
+                all_equal &= same(batches[0].lastx()[i], batches[1].lastx()[i]);
+            NTEST_ASSERT(all_equal);
+        }
+        // fused multiply-adds round once
+        for (const auto& expected: programs) {
+            backend::Backend subject(key::keypad);
+            const auto program = backend::Optimize(
+                backend::Program(expected.first, key::keypad), backend::kOptimizeAll);
+            NTEST_ASSERT_FLOAT_CLOSE(program.Run(subject),      expected.second);
+        }
+        backend::Backend subject(key::keypad);
+        subject.Insert(3);
+        const auto fused = backend::Optimize(
+            backend::Program("ENTER ENTER * +", key::keypad), backend::kOptimizeAll);
+        NTEST_ASSERT_FLOAT_CLOSE(fused.Run(subject),            12);
+    }
+
+    //------------------------------------------------------------------//
+    // state snapshots and undo                                         //
+    //------------------------------------------------------------------//
+    for (std::size_t depth: {backend::kStackDepth, std::size_t(8)}) {
+        // a rolled stack, registers and a pending EEX come back
+        backend::Backend subject(key::keypad, depth);
+        backend::Program("1 ENTER 2 ENTER 3 RDN 5 STO C SIN 2 EEX", key::keypad).Run(subject);
+        std::vector<unsigned char> state(subject.StateSize());
+        subject.SaveState(state.data());
+        backend::Backend restored(key::keypad, depth);
+        restored.LoadState(state.data());
+        bool same = true;
+        for (const char* suffix: {"3 SWAP", "LASTX", "RCL C", "RDN RDN", "RDN RDN RDN RDN"}) {
+            backend::Backend copy(subject);
+            same &= backend::Program(suffix, key::keypad).Run(copy) ==
+                    backend::Program(suffix, key::keypad).Run(restored);
+            restored.LoadState(state.data());
+        }
+        NTEST_ASSERT(same);
+    }
+    {
+        backend::Backend subject(key::keypad);
+        backend::Journal journal(subject, 1 << 10);
+        NTEST_ASSERT(!journal.Undo() && !journal.Redo() && !journal.Rollback());
+        for (int i = 1; i <= 3; ++i) {
+            journal.Checkpoint();
+            subject.Insert(i);
+        }
+        NTEST_ASSERT(journal.undo_size() == 3 && journal.redo_size() == 0);
+        NTEST_ASSERT(journal.Undo() && subject.Peek().first == 2);
+        NTEST_ASSERT(journal.Undo() && subject.Peek().first == 1);
+        NTEST_ASSERT(journal.redo_size() == 2);
+        NTEST_ASSERT(journal.Redo() && subject.Peek().first == 2);
+        NTEST_ASSERT(journal.Redo() && subject.Peek().first == 3);
+        NTEST_ASSERT(!journal.Redo());
+        // a new key forks the history
+        NTEST_ASSERT(journal.Undo() && subject.Peek().first == 2);
+        journal.Checkpoint();
+        subject.Insert(7);
+        NTEST_ASSERT(journal.redo_size() == 0 && !journal.Redo());
+        NTEST_ASSERT(journal.Undo() && subject.Peek().first == 2);
+        // the cap drops the oldest states
+        backend::Journal small(subject, 3 * subject.StateSize());
+        for (int i = 0; i < 10; ++i) {
+            small.Checkpoint();
+            subject.Insert(i);
+        }
+        int undone = 0;
+        while (small.Undo())
+            ++undone;
+        NTEST_ASSERT(undone == 2 && subject.Peek().first == 7);
+    }
+    {
+        backend::Engine engine(key::keypad);
+        engine.EnableUndo(1 << 10);
+        engine.EvalString("1 ENTER 2 + 5 STO A");
+        // STO A, then the 5 it entered, then +
+        NTEST_ASSERT(engine.Undo() && engine.backend().GenRegister(0) == 0);
+        NTEST_ASSERT(engine.Undo() && engine.backend().Peek().first == 3);
+        NTEST_ASSERT(engine.Undo() && engine.backend().Peek().first == 1);
+        NTEST_ASSERT(engine.Redo() && engine.backend().Peek().first == 3);
+        // a key that fails is rolled back with the operand it entered
+        bool division_throws = false;
+        try {
+            engine.EvalString("CHS 0 /");
+        } catch (const std::invalid_argument&) {
+            division_throws = true;
+        }
+        NTEST_ASSERT(division_throws);
+        NTEST_ASSERT_FLOAT_CLOSE(engine.EvalString("LASTX"),        3);
+        NTEST_ASSERT_FLOAT_CLOSE(engine.EvalString("SWAP"),         -3);
+    }
+
+    //------------------------------------------------------------------//
+    // incremental re-evaluation                                        //
+    //------------------------------------------------------------------//
+    {
+        const std::vector<std::string> tokens = {
+            "1.5", "2", "0.5", "12", "PI", "ENTER", "SWAP", "RDN", "CHS", "+", "-",
+            "*", "SQRT", "SIN", "CLX", "LASTX", "EEX", "STO", "RCL", "A", "b"};
+        std::mt19937 gen(21);
+        const auto Join = [](const std::vector<std::string>& keys) {
+            std::string expression;
+            for (const auto& key: keys)
+                expression += key + " ";
+            return expression;
+        };
+        // what a new engine gives, or NaN if it throws
+        const auto Expected = [](const std::string& expression) {
+            try {
+                return backend::Engine(key::keypad).EvalString(expression);
+            } catch (const std::exception&) {
+                return std::nan("");
+            }
+        };
+        std::vector<std::string> keys(2000);
+        for (auto& key: keys)
+            key = tokens[gen() % tokens.size()];
+        backend::IncrementalEvaluator evaluator(key::keypad, backend::kStackDepth, 16);
+        const auto Evaluate = [&evaluator](const std::string& expression) {
+            try {
+                return evaluator.Eval(expression);
+            } catch (const std::exception&) {
+                return std::nan("");
+            }
+        };
+        bool same = true;
+        bool near_end = true;
+        for (int edit = 0; edit < 200; ++edit) {
+            // mostly near the end, sometimes anywhere
+            const std::size_t index = (edit % 10 == 0) ? gen() % keys.size()
+                                                        : keys.size() - 1 - gen() % 40;
+            keys[index] = tokens[gen() % tokens.size()];
+            const auto expression = Join(keys);
+            const double expected = Expected(expression);
+            const double evaluated = Evaluate(expression);
+            same &= (expected == evaluated) || (std::isnan(expected) && std::isnan(evaluated));
+            // only keys after the last state saved before the edit
+            if (edit % 10 != 0 && !std::isnan(expected))
+                near_end &= evaluator.pressed() <= keys.size() - index + 32;
+        }
+        NTEST_ASSERT(same);
+        NTEST_ASSERT(near_end);
+        // an unchanged expression isn't evaluated again
+        Evaluate(Join(keys));
+        NTEST_ASSERT(evaluator.pressed() == 0 || std::isnan(Expected(Join(keys))));
+        // shorter and longer expressions, and edits by position
+        backend::IncrementalEvaluator edited(key::keypad, backend::kStackDepth, 1);
+        NTEST_ASSERT_FLOAT_CLOSE(edited.Eval("2 ENTER 3 + 4 *"),        20);
+        NTEST_ASSERT_FLOAT_CLOSE(edited.Eval("2 ENTER 3 +"),            5);
+        NTEST_ASSERT_FLOAT_CLOSE(edited.Eval("2 ENTER 3 + 10 * SQRT"),  std::sqrt(50));
+        edited.Edit(4, "20");
+        NTEST_ASSERT_FLOAT_CLOSE(edited.Eval(),                         10);
+        NTEST_ASSERT(edited.size() == 7 && edited.pressed() == 3);
+        // a key that throws is pressed again by the next evaluation
+        bool division_throws = false;
+        try {
+            edited.Eval("2 ENTER 3 + 0 /");
+        } catch (const std::invalid_argument&) {
+            division_throws = true;
+        }
+        NTEST_ASSERT(division_throws);
+        NTEST_ASSERT_FLOAT_CLOSE(edited.Eval("2 ENTER 3 + 2 /"),        2.5);
+    }
+
+    //------------------------------------------------------------------//
+    // keystroke tapes                                                  //
+    //------------------------------------------------------------------//
+    {
+        // what the UI records: each byte it receives and the X and Y
+        // the key leaves; `u` and `U` undo and redo
+        backend::Engine recorded(key::keypad);
+        recorded.EnableUndo(1 << 10);
+        backend::TapeHeader header = {123, backend::kStackDepth, 1 << 10, ""};
+        header.state.resize(recorded.backend().StateSize());
+        recorded.backend().SaveState(&header.state[0]);
+        std::string tape;
+        backend::EncodeTapeHeader(header, tape);
+        const std::size_t header_size = tape.size();
+        backend::TapeEncoder encoder;
+        const std::string keys = "12 3.5+uU E2!#A!r?A<vx@p2 0/1111+++q";
+        std::vector<backend::TapeRecord> records;
+        for (const char c: keys) {
+            bool threw = false;
+            if (c == 'u') {
+                recorded.Undo();
+            } else if (c == 'U') {
+                recorded.Redo();
+            } else {
+                try {
+                    recorded.Press(std::string(1, c));
+                } catch (const std::exception&) {
+                    threw = true;
+                }
+            }
+            const auto registers = recorded.observer().GetState().second;
+            records.push_back({static_cast<unsigned char>(c), threw, 1000u * records.size(),
+                               registers.first, registers.second});
+            encoder.Encode(records.back(), tape);
+        }
+        // decoded as encoded, in a few bytes per key
+        backend::TapeDecoder decoder(tape);
+        NTEST_ASSERT(decoder.header().start_us == 123 &&
+                     decoder.header().undo_bytes == 1 << 10 &&
+                     decoder.header().state == header.state);
+        bool decoded = true;
+        backend::TapeRecord record;
+        for (const auto& expected: records) {
+            decoded &= decoder.Next(record) && record.key == expected.key &&
+                       record.threw == expected.threw &&
+                       record.delta_us == expected.delta_us &&
+                       record.x == expected.x && record.y == expected.y;
+        }
+        NTEST_ASSERT(decoded && !decoder.Next(record));
+        NTEST_ASSERT(tape.size() - header_size < records.size() * 12);
+        // the division by zero threw when recorded and throws again
+        NTEST_ASSERT(records[keys.find('/')].threw);
+        auto report = backend::ReplayTape(tape, key::keypad);
+        NTEST_ASSERT(report.keys == keys.size() && report.mismatches == 0 &&
+                     report.first_mismatch == keys.size());
+        NTEST_ASSERT(report.recorded_us == 1000u * keys.size() * (keys.size() - 1) / 2);
+        // a key whose result differs is reported
+        auto altered = records;
+        altered[5].x += 1;
+        std::string altered_tape;
+        backend::EncodeTapeHeader(header, altered_tape);
+        backend::TapeEncoder altered_encoder;
+        for (const auto& r: altered)
+            altered_encoder.Encode(r, altered_tape);
+        report = backend::ReplayTape(altered_tape, key::keypad);
+        NTEST_ASSERT(report.mismatches == 1 && report.first_mismatch == 5);
+        // the writer's file replays the same
+        const char* path = "test.tape";
+        {
+            backend::TapeWriter writer(path, header);
+            for (const auto& r: records) {
+                writer.Record(r.key, r.threw, r.x, r.y);
+                if (r.key == 'E')
+                    writer.Flush();
+            }
+        }
+        std::ifstream file(path, std::ios::binary);
+        const std::string written((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+        std::remove(path);
+        report = backend::ReplayTape(written, key::keypad);
+        NTEST_ASSERT(report.keys == keys.size() && report.mismatches == 0);
+        // neither a file that isn't a tape nor a truncated one is replayed
+        for (const std::string& invalid: {std::string("HP35TAPX") + tape.substr(8),
+                                          tape.substr(0, tape.size() - 3)}) {
+            bool throws = false;
+            try {
+                backend::ReplayTape(invalid, key::keypad);
+            } catch (const std::runtime_error&) {
+                throws = true;
+            }
+            NTEST_ASSERT(throws);
+        }
+        // a tape that can't be written isn't closed silently
+        bool full_throws = false;
+        try {
+            backend::TapeWriter writer("/dev/full", header);
+            for (const auto& r: records)
+                writer.Record(r.key, r.threw, r.x, r.y);
+            writer.Close();
+        } catch (const std::runtime_error&) {
+            full_throws = true;
+        }
+        NTEST_ASSERT(full_throws);
+    }
+
+    //------------------------------------------------------------------//
+    // sessions                                                         //
+    //------------------------------------------------------------------//
+    {
+        // a new session is a new backend, and a saved one continues
+        // where its backend left off
+        backend::Backend fresh(key::keypad);
+        backend::Session session;
+        fresh.SaveSession(session);
+        NTEST_ASSERT(std::memcmp(&session, &backend::kNewSession, sizeof(session)) == 0);
+        backend::Backend subject(key::keypad);
+        backend::Program("1 ENTER 2 ENTER 3 RDN 5 STO C SIN 2 EEX", key::keypad).Run(subject);
+        subject.SaveSession(session);
+        bool same = true;
+        for (const char* suffix: {"3 SWAP", "LASTX", "RCL C", "RDN RDN", "RDN RDN RDN RDN"}) {
+            backend::Backend copy(subject);
+            fresh.LoadSession(session);
+            same &= backend::Program(suffix, key::keypad).Run(copy) ==
+                    backend::Program(suffix, key::keypad).Run(fresh);
+        }
+        NTEST_ASSERT(same);
+        bool deep_throws = false;
+        try {
+            backend::Backend(key::keypad, 8).SaveSession(session);
+        } catch (const std::invalid_argument&) {
+            deep_throws = true;
+        }
+        NTEST_ASSERT(deep_throws);
+
+        // sessions that take turns on one engine give what an engine
+        // per session gives
+        const std::vector<std::string> expressions = {
+            "2 ENTER 3 +", "STO A", "RCL A *", "LASTX +", "SQRT", "1 ENTER 0 /",
+            "RCL B RDN", "7 STO B", "SWAP -", "PI *"};
+        backend::SessionPool pool;
+        backend::Engine shared(key::keypad);
+        std::vector<backend::Session*> sessions;
+        std::vector<std::unique_ptr<backend::Engine>> engines;
+        for (int i = 0; i < 1000; ++i) {
+            sessions.push_back(pool.Acquire());
+            engines.push_back(std::make_unique<backend::Engine>(key::keypad));
+        }
+        const auto Eval = [](const auto& evaluate) {
+            try {
+                return evaluate();
+            } catch (const std::exception&) {
+                return std::nan("");
+            }
+        };
+        std::mt19937 gen(25);
+        same = true;
+        for (int i = 0; i < 20000; ++i) {
+            const std::size_t s = gen() % sessions.size();
+            const auto& expression = expressions[gen() % expressions.size()];
+            const double expected = Eval([&]() { return engines[s]->EvalString(expression); });
+            const double evaluated = Eval([&]() {
+                return backend::EvalSession(shared, *sessions[s], expression); });
+            same &= (expected == evaluated) || (std::isnan(expected) && std::isnan(evaluated));
+        }
+        NTEST_ASSERT(same);
+        // released sessions are reused as new ones, aligned to a cache line
+        const std::size_t bytes = pool.bytes();
+        for (std::size_t i = 0; i < sessions.size(); i += 2)
+            pool.Release(sessions[i]);
+        bool reused = true;
+        for (std::size_t i = 0; i < sessions.size(); i += 2) {
+            sessions[i] = pool.Acquire();
+            reused &= std::memcmp(sessions[i], &backend::kNewSession, sizeof(backend::Session)) == 0 &&
+                      reinterpret_cast<std::uintptr_t>(sessions[i]) % 64 == 0;
+        }
+        NTEST_ASSERT(reused && pool.size() == 1000 && pool.bytes() == bytes);
+        NTEST_ASSERT(bytes < 1000 * 2 * sizeof(backend::Session));
+    }
+
+    //------------------------------------------------------------------//
+    // key dispatch table                                               //
+    //------------------------------------------------------------------//
+    // the table agrees with the maps it was compiled from
+    bool table_matches = true;
+    for (const auto& pair: key::keypad.single_arg_keys) {
+        const auto& entry = key::LookupKey(key::keypad, pair.first);
+        table_matches &= entry.category == key::kCategorySingleArg &&
+                         entry.arity == 1 && entry.single_arg == &pair.second;
+    }
+    for (const auto& pair: key::keypad.double_arg_keys) {
+        const auto& entry = key::LookupKey(key::keypad, pair.first);
+        table_matches &= entry.category == key::kCategoryDoubleArg &&
+                         entry.arity == 2 && entry.double_arg == &pair.second;
+    }
+    for (const auto& pair: key::keypad.stack_keys)
+        table_matches &= key::LookupKey(key::keypad, pair.first).stack == &pair.second;
+    for (const auto& pair: key::keypad.storage_keys)
+        table_matches &= key::LookupKey(key::keypad, pair.first).storage == &pair.second;
+    NTEST_ASSERT(table_matches);
+    NTEST_ASSERT(key::LookupKey(key::keypad, key::kKeyEex).category == key::kCategoryEex);
+    NTEST_ASSERT(key::LookupKey(key::keypad, "7").category == key::kCategoryNone);
+    NTEST_ASSERT(key::LookupKey(key::keypad, "SIN").category == key::kCategoryNone);
+    NTEST_ASSERT(key::LookupKey(key::keypad, "").category == key::kCategoryNone);
+    // another keypad's table points into its own maps, not the ones it
+    // was built from
+    static_assert(!std::is_copy_constructible_v<key::Keypad>);
+    const auto other = std::make_unique<key::Keypad>(
+        key::keypad.stack_keys, key::keypad.single_arg_keys,
+        key::keypad.double_arg_keys, key::keypad.storage_keys,
+        key::keypad.eex_key, key::keypad.reverse_keys);
+    NTEST_ASSERT(key::LookupKey(*other, "+").double_arg == &other->double_arg_keys.at("+"));
+    NTEST_ASSERT_FLOAT_CLOSE(backend::Engine(*other).EvalString("2 ENTER 3 +"), 5);
+    // long keys resolve to short ones; longer tokens are left as they are
+    NTEST_ASSERT(key::ShortKey(key::keypad, "LOG10") == "L");
+    NTEST_ASSERT(key::keypad.longest_long_key == 5);
+    NTEST_ASSERT(key::ShortKey(key::keypad, "0.12345678901234567") == "0.12345678901234567");
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString("0.12345678901234567 ENTER +"), 0.24691358);
+
+    //------------------------------------------------------------------//
+    // compile-time keypad                                              //
+    //------------------------------------------------------------------//
+    // it describes the same keys as the runtime keypad: every key of
+    // one is a key of the other, with the same category, position,
+    // annotation, long key and function
+    std::size_t runtime_keys = 0;
+    bool known_keys = true;
+    const auto CountKeys = [&](const auto& map, key::KeyCategory category) {
+        for (const auto& pair: map) {
+            ++runtime_keys;
+            const auto idx = pair.first.size() == 1 ?
+                key::static_keypad.Find(pair.first[0]) : key::static_keypad.size();
+            known_keys &= idx < key::static_keypad.size() &&
+                          key::static_keypad.keys[idx].category == category;
+        }
+    };
+    CountKeys(key::keypad.stack_keys,      key::kCategoryStack);
+    CountKeys(key::keypad.single_arg_keys, key::kCategorySingleArg);
+    CountKeys(key::keypad.double_arg_keys, key::kCategoryDoubleArg);
+    CountKeys(key::keypad.storage_keys,    key::kCategoryStorage);
+    CountKeys(key::keypad.eex_key,         key::kCategoryEex);
+    NTEST_ASSERT(known_keys && runtime_keys == key::static_keypad.size());
+    NTEST_ASSERT(key::keypad.reverse_keys.size() == key::static_keypad.size());
+    bool same_keys = true;
+    for (const auto& info: key::static_keypad.keys) {
+        const std::string keypress(1, info.key);
+        const auto& entry = key::LookupKey(key::keypad, keypress);
+        same_keys &= entry.category == info.category &&
+                     entry.point.x == info.point.x && entry.point.y == info.point.y &&
+                     *entry.annotation == info.annotation &&
+                     key::keypad.reverse_keys.count(info.long_key) == 1 &&
+                     key::keypad.reverse_keys.at(info.long_key) == keypress;
+        if (info.single_arg)
+            same_keys &= entry.single_arg->function(0.3) == info.single_arg(0.3);
+        if (info.double_arg)
+            same_keys &= entry.double_arg->function(0.3, 0.7) == info.double_arg(0.3, 0.7);
+    }
+    NTEST_ASSERT(same_keys);
+    // and a backend specialized on it calculates like the runtime one
+    backend::StaticBackend<key::static_keypad> static_backend;
+    backend::Backend runtime_backend(key::keypad);
+    for (auto* b: std::vector<backend::Backend*>{&static_backend, &runtime_backend}) {
+        b->Insert(30);
+        b->Calculate(key::kKeySin);
+        b->Enter();
+        b->Insert(4);
+        b->Calculate(key::kKeyMul);
+        b->Insert(3);
+        b->Calculate(key::kKeyMinus);
+    }
+    NTEST_ASSERT_FLOAT_CLOSE(static_backend.Peek().first,       runtime_backend.Peek().first);
+    NTEST_ASSERT_FLOAT_CLOSE(static_backend.Peek().first,       -1);
+    NTEST_ASSERT_FLOAT_CLOSE(static_backend.Calculate<'^'>(),   runtime_backend.Calculate("^"));
+    bool invalid_throws = false;
+    try {
+        static_backend.Calculate(key::kKeyEnter);
+    } catch (const std::runtime_error&) {
+        invalid_throws = true;
+    }
+    NTEST_ASSERT(invalid_throws);
+
+    //------------------------------------------------------------------//
+    // compile-time programs                                            //
+    //------------------------------------------------------------------//
+    static_assert("2 ENTER 3 + 4 *"_rpn() == 20);
+    static_assert("~ 2 . 5 ENTER +"_rpn() == -5);
+    static_assert("3 STO A 4 ENTER RCL a *"_rpn() == 12);
+    static_assert("2 EEX 3 ENTER 3 EEX 3 + 42 +"_rpn() == 5042);
+    // the stack is the function's arguments and T is replicated
+    static_assert("-"_rpn(2, 7) == 5 && "+ + +"_rpn(1, 2, 3, 4) == 10);
+    static_assert("ENTER *"_rpn.Inputs() == 1 && "SWAP"_rpn.Inputs() == 2);
+    static_assert("5 ENTER CLR"_rpn.Inputs() == 0 && "1 +"_rpn.Inputs() == 1);
+    {
+        // same results as programs compiled at run time, on any stack
+        bool same = true;
+        for (const auto& expected: programs) {
+            const backend::StaticProgram compiled(expected.first);
+            const backend::Program program(expected.first, key::keypad);
+            for (double x: {0.0, 0.5, -3.0}) {
+                backend::Stack stack;
+                stack[backend::IDX_REG_X] = x;
+                stack[backend::IDX_REG_Y] = x + 1;
+                stack[backend::IDX_REG_Z] = x + 2;
+                stack[backend::IDX_REG_T] = x + 3;
+                same &= compiled(x, x + 1, x + 2, x + 3) == program.Run(stack);
+            }
+        }
+        NTEST_ASSERT(same);
+        static constexpr auto area = "ENTER * PI *"_rpn;
+        static constexpr auto boss = "2 ENTER 3 + 4 * 5 / 30 SIN / 1.5 CHS ENTER 4 ^ *"_rpn;
+        NTEST_ASSERT(backend::StaticProgram::Inline<area>(2) == area(2));
+        NTEST_ASSERT(backend::StaticProgram::Inline<boss>() == boss());
+        bool invalid_throws = false;
+        try {
+            backend::StaticProgram("2 ENTER FOO +");
+        } catch (const std::invalid_argument&) {
+            invalid_throws = true;
+        }
+        NTEST_ASSERT(invalid_throws);
+    }
+
+    //------------------------------------------------------------------//
+    // operand entry                                                    //
+    //------------------------------------------------------------------//
+    {
+        backend::NumberLexer lexer;
+        // a keypress is accepted only if it completes a number
+        NTEST_ASSERT(!lexer.Append(".") && lexer.empty());
+        NTEST_ASSERT(lexer.Append("1") && lexer.Append(".") && lexer.Append("5"));
+        NTEST_ASSERT(!lexer.Append("e") && !lexer.Append("-") && !lexer.Append("."));
+        NTEST_ASSERT(lexer.Append("e-2") && lexer.text() == "1.5e-2");
+        NTEST_ASSERT_FLOAT_CLOSE(lexer.Value(),                 0.015);
+        lexer.Clear();
+        NTEST_ASSERT(lexer.Append("+.25") && lexer.Value() == 0.25);
+        lexer.Clear();
+        NTEST_ASSERT(lexer.Append("1e999") && std::isinf(lexer.Value()));
+        NTEST_ASSERT(backend::NumberLexer().Value() == 0.0);
+    }
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString("1.5e3 ENTER 2 *"),  3000);
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString("~ 2 . 5 ENTER +"),  -5);
+    // e after an operand is the e^x key
+    NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString("1 e"),              M_E);
+
+    //------------------------------------------------------------------//
+    // tokenizer                                                        //
+    //------------------------------------------------------------------//
+    {
+        backend::Tokenizer tokenizer("  2 ENTER\t\t3\n+  ");
+        std::vector<std::string> tokens;
+        std::string_view token;
+        while (tokenizer.Next(token))
+            tokens.emplace_back(token);
+        NTEST_ASSERT((tokens == std::vector<std::string>{"2", "ENTER", "3", "+"}));
+        NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString("  2 ENTER\t\t3\n+  "), 5);
+        // long generated programs
+        std::string sum = "0 ENTER";
+        for (int i = 0; i < 50000; ++i)
+            sum += " 1 +";
+        NTEST_ASSERT_FLOAT_CLOSE(hp->EvalString(sum),             50000);
+        NTEST_ASSERT_FLOAT_CLOSE(backend::Program(sum, key::keypad).Run(backend),
+                                                                  50000);
+    }
+
+    //------------------------------------------------------------------//
+    // event channel                                                    //
+    //------------------------------------------------------------------//
+    {
+        // events arrive in order
+        backend::EventChannel channel(16);
+        backend::Backend subject(key::keypad);
+        subject.AttachChannel(&channel);
+        subject.Insert(2);
+        subject.Enter();
+        subject.Insert(3);
+        subject.Calculate(key::kKeyPlus);
+        std::string operations;
+        backend::Event last{0, '\0', 0.0, 0.0};
+        channel.Consume([&](const backend::Event& event) {
+            if (event.kinds & backend::kEventOperation)
+                operations += event.operation;
+            last = event;
+        });
+        NTEST_ASSERT(operations == key::kKeyEnter + key::kKeyPlus);
+        NTEST_ASSERT(last.kinds == backend::kEventRegisters && last.x == 5);
+        // nothing is sent after detaching
+        subject.AttachChannel(nullptr);
+        subject.Enter();
+        NTEST_ASSERT(channel.Consume([](const backend::Event&) {}) == 0);
+    }
+    {
+        // a full channel drops new events or merges them
+        backend::EventChannel dropping(4, backend::kOverflowDrop);
+        backend::EventChannel coalescing(4, backend::kOverflowCoalesce);
+        for (int i = 0; i < 10; ++i) {
+            dropping.Push(backend::Event{backend::kEventRegisters, '\0', double(i), 0.0});
+            coalescing.Push(backend::Event{backend::kEventRegisters, '\0', double(i), 0.0});
+        }
+        coalescing.Push(backend::Event{backend::kEventOperation, '+', 0.0, 0.0});
+        std::vector<backend::Event> events;
+        NTEST_ASSERT(dropping.Consume([](const backend::Event&) {}) == 4);
+        NTEST_ASSERT(dropping.dropped() == 6);
+        NTEST_ASSERT(coalescing.Consume([&](const backend::Event& e) {
+            events.push_back(e); }) == 5);
+        NTEST_ASSERT(events.back().kinds == (backend::kEventRegisters |
+                                             backend::kEventOperation));
+        NTEST_ASSERT(events.back().x == 9 && events.back().operation == '+');
+    }
+    {
+        // an observer on its own thread sees every event of a blocking channel
+        backend::EventChannel channel(8, backend::kOverflowBlock);
+        Observer logger;
+        backend::Backend subject(key::keypad);
+        {
+            backend::EventPump pump(channel, logger);
+            subject.AttachChannel(&channel);
+            for (int i = 0; i < 10000; ++i) {
+                subject.Insert(i);
+                subject.Calculate(key::kKeyChs);
+            }
+        }
+        NTEST_ASSERT(logger.GetState().first == key::kKeyChs);
+        NTEST_ASSERT(logger.GetState().second.first == -9999);
+    }
+    //------------------------------------------------------------------//
+    // number formatting                                                //
+    //------------------------------------------------------------------//
+    {
+        char buf[format::kBufferSize];
+        auto fmt = [&](char* (*f)(char*, char*, double, int), double num, int prec) {
+            return std::string(buf, f(buf, buf + sizeof(buf), num, prec));
+        };
+        NTEST_ASSERT(fmt(format::Fixed, -3.1, 2) ==               "-3.10");
+        NTEST_ASSERT(fmt(format::Engineering, -.000123456, 3) ==  "-1.235 E-4");
+        NTEST_ASSERT(fmt(format::Engineering, 123.12345, 2) ==    "1.23 E2");
+        NTEST_ASSERT(fmt(format::Engineering, 5e300, 6) ==        "5. E300");
+        // the mantissa rounds up to 10
+        NTEST_ASSERT(fmt(format::Engineering, 99999, 2) ==        "1. E5");
+        NTEST_ASSERT(fmt(format::Engineering, 1.0/0.0, 2) ==      "inf");
+        NTEST_ASSERT(std::string(buf, format::Shortest(buf, buf + sizeof(buf), 0.1)) == "0.1");
+        NTEST_ASSERT(format::Fixed(buf, buf + 4, 1234.5, 1) == nullptr);
+        char* end = format::Display(buf, buf + sizeof(buf), 1234.5, 24);
+        NTEST_ASSERT(std::string(buf, end) == "              1234.5");
+        // same as the previous formatting with streams
+        auto fixed = [](double num, int prec) {
+            std::ostringstream os;
+            os << std::fixed << std::setprecision(prec) << num;
+            return os.str();
+        };
+        auto engineering = [](double num, int prec) {
+            const int mag = static_cast<int>(std::floor(std::log10(std::fabs(num))));
+            std::ostringstream os;
+            os << std::fixed << std::setprecision(prec) << num / std::pow(10, mag);
+            std::string mantissa = os.str();
+            mantissa.erase(mantissa.find_last_not_of('0') + 1);
+            return mantissa + " E" + std::to_string(mag);
+        };
+        std::mt19937 rng(35);
+        std::uniform_real_distribution<double> mantissa(1, 9.99), exponent(-300, 300);
+        bool same = true;
+        for (int i = 0; i < 10000 && same; ++i) {
+            const double num = ((i % 2) ? -1 : 1) * mantissa(rng) *
+                               std::pow(10, std::floor(exponent(rng)));
+            // fixed format is only used up to 1e6 on the display
+            same = (std::fabs(num) >= 1e6 || fmt(format::Fixed, num, 5) == fixed(num, 5)) &&
+                   fmt(format::Engineering, num, 6) == engineering(num, 6);
+        }
+        NTEST_ASSERT(same);
+    }
+    //------------------------------------------------------------------//
+    // metrics                                                          //
+    //------------------------------------------------------------------//
+    {
+        metrics::Reset();
+        backend::Backend subject(key::keypad);
+        subject.Insert(1);
+        subject.Enter();
+        subject.Insert(0);
+        try {
+            subject.Calculate(key::kKeyDiv);
+        } catch (const std::invalid_argument&) {}
+        subject.Clr();
+        hp->EvalString("2 ENTER 3 +");
+        // counters of finished threads are kept
+        std::thread([]() {
+            backend::Backend other(key::keypad);
+            for (int i = 0; i < 100; ++i)
+                other.Rdn();
+        }).join();
+        const auto snapshot = metrics::TakeSnapshot();
+        const auto& div = snapshot.ops[metrics::KeySlot(key::kKeyDiv)];
+        if constexpr (metrics::kEnabled) {
+            NTEST_ASSERT(div.calls == 1 && div.exceptions == 1);
+            // the ENTERs of CLR are part of it
+            NTEST_ASSERT(snapshot.ops[metrics::KeySlot(key::kKeyEnter)].calls == 2);
+            NTEST_ASSERT(snapshot.ops[metrics::KeySlot(key::kKeyClr)].calls == 1);
+            NTEST_ASSERT(snapshot.ops[metrics::KeySlot(key::kKeyRdn)].calls == 100);
+            NTEST_ASSERT(snapshot.ops[metrics::kSlotEvalString].calls == 1);
+            NTEST_ASSERT(snapshot.Percentile(metrics::kSlotEvalString, 99) > 0);
+            NTEST_ASSERT(snapshot.ToJson(key::keypad).find("{\"name\": \"CLR\", \"calls\": 1") !=
+                         std::string::npos);
+        } else {
+            NTEST_ASSERT(div.calls == 0 && snapshot.ToText(key::keypad).find("CLR") ==
+                                           std::string::npos);
+        }
+        // 99 calls under 8 ns and one under 1024 ns
+        metrics::Snapshot made;
+        made.ops[metrics::kSlotInsert].latency[3] = 99;
+        made.ops[metrics::kSlotInsert].latency[10] = 1;
+        NTEST_ASSERT(made.Percentile(metrics::kSlotInsert, 50) == 8);
+        NTEST_ASSERT(made.Percentile(metrics::kSlotInsert, 99) == 8);
+        NTEST_ASSERT(made.Percentile(metrics::kSlotInsert, 100) == 1024);
+        NTEST_ASSERT(made.Percentile(metrics::kSlotEvalString, 50) == 0);
+    }
+    return ntest_result;
 }